@@ -4,9 +4,12 @@
 
 #ifndef PROJECT_BASE_COMMON_H
 #define PROJECT_BASE_COMMON_H
+#include <algorithm>
 #include <string>
 #include <fstream>
+#include <iostream>
 #include <sstream>
+#include <vector>
 
 std::string readFileContents(std::string path) {
     std::ifstream in(path);
@@ -15,5 +18,90 @@ std::string readFileContents(std::string path) {
     return buffer.str();
 }
 
+// directory part of path including the trailing slash, empty for a bare file name
+std::string directoryOf(const std::string &path) {
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+}
+
+// One shader's include expansion: every file expanded so far, in the order they were
+// first included. A file's index is its GLSL source string number in #line directives, so
+// a driver error at 2(15) is line 15 of files[2]; the shader's own file is 0.
+struct IncludeState {
+    std::vector<std::string> files;
+};
+
+std::string expandIncludes(const std::string &source, const std::string &path, IncludeState &state) {
+    unsigned int fileIndex = state.files.size();
+    state.files.push_back(path);
+    std::string directory = directoryOf(path);
+    std::istringstream lines(source);
+    std::stringstream out;
+    std::string line;
+    unsigned int lineNumber = 0;
+    // the included file's first line is line 1 of its own source string; the shader's own
+    // file needs nothing, its #version has to stay first
+    if (fileIndex != 0)
+        out << "#line 1 " << fileIndex << '\n';
+    while (std::getline(lines, line)) {
+        lineNumber++;
+        size_t start = line.find_first_not_of(" \t");
+        size_t open = line.find('"');
+        size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+        if (start == std::string::npos || line.compare(start, 8, "#include") != 0 || close == std::string::npos) {
+            out << line << '\n';
+            continue;
+        }
+        std::string includePath = directory + line.substr(open + 1, close - open - 1);
+        // once per shader, which also ends include cycles
+        if (std::find(state.files.begin(), state.files.end(), includePath) != state.files.end()) {
+            out << '\n';
+            continue;
+        }
+        std::ifstream in(includePath);
+        if (!in) {
+            std::cout << "ERROR::SHADER::INCLUDE_NOT_FOUND: " << includePath << " (" << path << ':'
+                      << lineNumber << ')' << std::endl;
+            out << '\n';
+            continue;
+        }
+        std::stringstream buffer;
+        buffer << in.rdbuf();
+        out << expandIncludes(buffer.str(), includePath, state);
+        // back in this file, on the line after the #include
+        out << "#line " << lineNumber + 1 << ' ' << fileIndex << '\n';
+    }
+    return out.str();
+}
+
+// GLSL has no #include: replaces every #include "file" line in source, read from path, with
+// that file's contents, looked up relative to path's directory, expanding the included
+// file's own includes too. A file already expanded into this shader is left out the second
+// time, and #line directives keep the driver's line numbers those of the original files.
+std::string expandIncludes(const std::string &source, const std::string &path) {
+    IncludeState state;
+    return expandIncludes(source, path, state);
+}
+
+// #version has to stay the first line: adds a #define NAME line after it for each name,
+// which is how rg/ShaderVariants.h specializes one source into its variants
+std::string insertDefines(const std::string &source, const std::vector<std::string> &defines) {
+    if (defines.empty())
+        return source;
+    std::string lines;
+    for (const std::string &define : defines)
+        lines += "#define " + define + '\n';
+    size_t version = source.find("#version");
+    if (version == std::string::npos)
+        return lines + source;
+    size_t lineEnd = source.find('\n', version);
+    if (lineEnd == std::string::npos)
+        return source + '\n' + lines;
+    // the line after #version keeps its number in error messages
+    size_t versionLine = std::count(source.begin(), source.begin() + lineEnd, '\n') + 1;
+    lines += "#line " + std::to_string(versionLine + 1) + '\n';
+    return source.substr(0, lineEnd + 1) + lines + source.substr(lineEnd + 1);
+}
+
 
 #endif //PROJECT_BASE_COMMON_H
@@ -7,7 +7,14 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <learnopengl/shader.h>
-
+#include <rg/Bounds.h>
+#include <rg/InstanceBuffer.h>
+#include <rg/Material.h>
+#include <rg/RenderStats.h>
+#include <rg/TextureArray.h>
+
+#include <algorithm>
+#include <cmath>
 #include <string>
 #include <vector>
 using namespace std;
@@ -26,13 +33,6 @@ struct Vertex {
 };
 
 
-
-struct Texture {
-    unsigned int id;
-    string type;
-    string path;
-};
-
 class Mesh {
 public:
     // mesh Data
@@ -42,6 +42,13 @@ public:
 
     unsigned int VAO;
     std::string glslIdentifierPrefix;
+    // when set, textures and render state come from here instead of the textures above
+    Material *material = nullptr;
+    // layer in the material's texture arrays, -1 when it samples plain 2D textures
+    int textureLayer = -1;
+    // object-space bounds, filled in by the loader
+    AABB bounds;
+    BoundingSphere sphere;
     // constructor
     Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
     {
@@ -56,41 +63,73 @@ public:
     // render the mesh
     void Draw(Shader &shader)
     {
-        // bind appropriate textures
-        unsigned int diffuseNr  = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr   = 1;
-        unsigned int heightNr   = 1;
-        for(unsigned int i = 0; i < textures.size(); i++)
-        {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
-            if(name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if(name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to stream
-            else if(name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to stream
-            else if(name == "texture_height")
-                number = std::to_string(heightNr++); // transfer unsigned int to stream
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (glslIdentifierPrefix + name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
-        }
+        bindMaterial(shader);
+        DrawGeometry();
 
+        // always good practice to set everything back to defaults once configured.
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // render instances.Count() copies in one call, each with its own model matrix
+    void DrawInstanced(Shader &shader, InstanceBuffer &instances)
+    {
+        if (instances.Count() == 0)
+            return;
+        bindMaterial(shader);
+        DrawGeometry(&instances);
 
+        glActiveTexture(GL_TEXTURE0);
+    }
 
-        // draw mesh
+    // issues the draw call only; textures are expected to be bound already
+    void DrawGeometry(InstanceBuffer *instances = nullptr)
+    {
         glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+        if (textureLayer >= 0)
+            setTextureLayer(textureLayer);
+        if (instances != nullptr) {
+            instances->Attach();
+            glDrawElementsInstanced(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0, instances->Count());
+            InstanceBuffer::Detach();
+            renderStats().AddDraw(indices.size(), instances->Count());
+        } else {
+            glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+            renderStats().AddDraw(indices.size());
+        }
         glBindVertexArray(0);
+    }
 
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+    // frees the GL objects; the mesh can't be drawn afterwards
+    void Delete()
+    {
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+    }
+
+    // Sphere centered on the box, with the radius of the farthest vertex. Tighter than the
+    // box's half diagonal for rounded meshes.
+    static BoundingSphere sphereAround(const AABB &box, const vector<Vertex> &vertices)
+    {
+        BoundingSphere result;
+        if (box.Empty())
+            return result;
+        result.center = box.Center();
+        float radiusSquared = 0.0f;
+        for (const Vertex &vertex : vertices) {
+            glm::vec3 offset = vertex.Position - result.center;
+            radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+        }
+        result.radius = std::sqrt(radiusSquared);
+        return result;
+    }
+
+    void bindMaterial(Shader &shader)
+    {
+        if (material != nullptr)
+            material->Bind(shader);
+        else
+            bindTextures(shader, textures, glslIdentifierPrefix);
     }
 
 private:
@@ -13,11 +13,13 @@
 #include <learnopengl/mesh.h>
 #include <learnopengl/shader.h>
 
+#include <algorithm>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <vector>
 using namespace std;
 
@@ -31,8 +33,14 @@ public:
     // model data
     vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
     vector<Mesh>    meshes;
+    // one per assimp material, shared by the meshes that use it
+    vector<unique_ptr<Material>> materials;
     string directory;
     bool gammaCorrection;
+    // object-space bounds of all meshes together
+    AABB bounds;
+    BoundingSphere sphere;
+    unsigned int triangleCount = 0;
 
     // constructor, expects a filepath to a 3D model.
     Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
@@ -45,14 +53,47 @@ public:
     {
         for(unsigned int i = 0; i < meshes.size(); i++)
             meshes[i].Draw(shader);
+        renderStats().modelMeshes += meshes.size();
+        renderStats().modelDrawCalls += meshes.size();
+    }
+
+    // draws every instance of the model with one call per mesh
+    void DrawInstanced(Shader &shader, InstanceBuffer &instances)
+    {
+        if (instances.Count() == 0)
+            return;
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].DrawInstanced(shader, instances);
+        renderStats().modelMeshes += meshes.size();
+        renderStats().modelDrawCalls += meshes.size();
     }
 
     void SetShaderTextureNamePrefix(std::string prefix) {
         for (Mesh& mesh: meshes) {
             mesh.glslIdentifierPrefix = prefix;
         }
+        for (auto& material: materials) {
+            material->SetGlslIdentifierPrefix(prefix);
+        }
+    }
+
+    // textures for materials that reference none in the model file (sofa, lamp)
+    void SetFallbackTextures(const vector<Texture> &textures) {
+        for (auto& material: materials) {
+            if (material->Textures().empty())
+                material->SetTextures(textures);
+        }
+    }
+
+    void SetRenderState(bool blend, bool cullFace) {
+        for (auto& material: materials) {
+            material->blend = blend;
+            material->cullFace = cullFace;
+        }
     }
 private:
+    map<unsigned int, Material*> materialsByIndex;
+
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
     void loadModel(string const &path)
     {
@@ -70,6 +111,18 @@ private:
 
         // process ASSIMP's root node recursively
         processNode(scene->mRootNode, scene);
+
+        for (const Mesh &mesh : meshes) {
+            bounds.Expand(mesh.bounds);
+            triangleCount += mesh.indices.size() / 3;
+        }
+        if (!bounds.Empty()) {
+            sphere.center = bounds.Center();
+            sphere.radius = 0.0f;
+            for (const Mesh &mesh : meshes)
+                if (!mesh.sphere.Empty())
+                    sphere.radius = std::max(sphere.radius, glm::length(mesh.sphere.center - sphere.center) + mesh.sphere.radius);
+        }
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
@@ -97,6 +150,7 @@ private:
         vector<Vertex> vertices;
         vector<unsigned int> indices;
         vector<Texture> textures;
+        AABB bounds;
 
         // walk through each of the mesh's vertices
         for(unsigned int i = 0; i < mesh->mNumVertices; i++)
@@ -108,6 +162,7 @@ private:
             vector.y = mesh->mVertices[i].y;
             vector.z = mesh->mVertices[i].z;
             vertex.Position = vector;
+            bounds.Expand(vector);
             // normals
             if (mesh->HasNormals())
             {
@@ -179,7 +234,22 @@ private:
 
 
         // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        Mesh result(vertices, indices, textures);
+        result.material = materialFor(mesh->mMaterialIndex, textures);
+        result.bounds = bounds;
+        result.sphere = Mesh::sphereAround(bounds, result.vertices);
+        return result;
+    }
+
+    // meshes that share an assimp material share one Material
+    Material *materialFor(unsigned int materialIndex, const vector<Texture> &textures)
+    {
+        auto it = materialsByIndex.find(materialIndex);
+        if (it != materialsByIndex.end())
+            return it->second;
+        materials.push_back(unique_ptr<Material>(new Material(textures)));
+        materialsByIndex[materialIndex] = materials.back().get();
+        return materials.back().get();
     }
 
     // checks all material textures of a given type and loads the textures if they're not loaded yet.
@@ -13,6 +13,8 @@ class Shader
 {
 public:
     unsigned int ID;
+    // wraps a program linked elsewhere, such as a variant from rg/ShaderVariants.h
+    explicit Shader(unsigned int program) : ID(program) {}
     // constructor generates the shader on the fly
     // ------------------------------------------------------------------------
     Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
@@ -46,8 +48,8 @@ public:
             vShaderFile.close();
             fShaderFile.close();
             // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();			
+            vertexCode = expandIncludes(vShaderStream.str(), vertexPathString);
+            fragmentCode = expandIncludes(fShaderStream.str(), fragmentPathString);
             // if geometry shader path is present, also load a geometry shader
             if(geometryPath != nullptr)
             {
@@ -57,7 +59,7 @@ public:
                 std::stringstream gShaderStream;
                 gShaderStream << gShaderFile.rdbuf();
                 gShaderFile.close();
-                geometryCode = gShaderStream.str();
+                geometryCode = expandIncludes(gShaderStream.str(), geometryPathString);
             }
         }
         catch (std::ifstream::failure& e)
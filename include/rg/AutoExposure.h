@@ -0,0 +1,186 @@
+//
+// Exposure from a luminance histogram of the HDR frame, adapted over time like an eye.
+//
+
+#ifndef PROJECT_BASE_AUTOEXPOSURE_H
+#define PROJECT_BASE_AUTOEXPOSURE_H
+
+#include <glad/glad.h>
+
+#include <rg/ComputeShader.h>
+#include <rg/GLExt.h>
+
+#include <algorithm>
+#include <cmath>
+
+const unsigned int LUMINANCE_HISTOGRAM_BINS = 256;
+// log2 luminance covered by bins 1..255; below is bin 0, above is the last bin
+const float MIN_LOG_LUMINANCE = -10.0f;
+const float MAX_LOG_LUMINANCE = 6.0f;
+// the part of the histogram averaged: the darkest pixels up to the low percentile and the
+// brightest above the high one are left out
+const float EXPOSURE_LOW_PERCENTILE = 0.5f;
+const float EXPOSURE_HIGH_PERCENTILE = 0.95f;
+const float EXPOSURE_MIDDLE_GRAY = 0.18f;
+// rate constants per second toward the measured luminance
+const float EXPOSURE_ADAPT_SPEED_UP = 3.0f;
+const float EXPOSURE_ADAPT_SPEED_DOWN = 1.0f;
+
+// luminance_histogram.comp sorts the frame's pixels into bins of log2 luminance; bin 0 holds
+// the ones too dark to have a log worth binning. The histogram is copied into one of a ring
+// of buffers behind a fence and read a few frames later, once the GPU is done with it, the
+// way GpuInstanceCuller reads its counts back, so the CPU never waits. The exposure is then
+// what brings the average of the brighter part of the histogram to middle gray; dark
+// corners do not blow the frame out and a few bright pixels do not darken it.
+class AutoExposure {
+public:
+    // needs rg::glCaps().compute
+    void Create() {
+        glGenBuffers(1, &histogramBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, histogramBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(histogram), nullptr, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        for (Readback &readback : readbacks) {
+            glGenBuffers(1, &readback.buffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, readback.buffer);
+            glBufferData(GL_COPY_WRITE_BUFFER, sizeof(histogram), nullptr, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    // Bins the lower-left width x height of colorTexture, once per frame after the scene is
+    // drawn. One thread per 2x2 pixels, read with one bilinear tap in their middle.
+    void Measure(const ComputeShader &histogramShader, unsigned int colorTexture, int width, int height) {
+        pollReadbacks();
+
+        static const GLuint zeros[LUMINANCE_HISTOGRAM_BINS] = {0};
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, histogramBuffer);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zeros), zeros);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        histogramShader.use();
+        histogramShader.setInt("hdrBuffer", 0);
+        glUniform2i(glGetUniformLocation(histogramShader.ID, "sourceSize"), width, height);
+        histogramShader.setFloat("minLogLuminance", MIN_LOG_LUMINANCE);
+        histogramShader.setFloat("inverseLogLuminanceRange", 1.0f / (MAX_LOG_LUMINANCE - MIN_LOG_LUMINANCE));
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, colorTexture);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, histogramBuffer);
+        histogramShader.Dispatch((width + 1) / 2, GROUP_SIZE, (height + 1) / 2, GROUP_SIZE);
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        // picked up by a later pollReadbacks
+        Readback &readback = readbacks[frame % READBACK_FRAMES];
+        if (readback.fence != nullptr)
+            glDeleteSync(readback.fence);
+        glBindBuffer(GL_COPY_READ_BUFFER, histogramBuffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, readback.buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(histogram));
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        readback.frame = frame++;
+    }
+
+    // Moves the adapted luminance toward the latest histogram's average: quickly when the
+    // frame got brighter, slower when it got darker, as eyes do. compensation is in stops.
+    void Adapt(float deltaSeconds, float compensation) {
+        if (!measured)
+            return;
+        if (!adapted) {
+            adaptedLuminance = averageLuminance;
+            adapted = true;
+        }
+        float speed = averageLuminance > adaptedLuminance ? EXPOSURE_ADAPT_SPEED_UP : EXPOSURE_ADAPT_SPEED_DOWN;
+        adaptedLuminance += (averageLuminance - adaptedLuminance) * (1.0f - std::exp(-deltaSeconds * speed));
+        exposure = EXPOSURE_MIDDLE_GRAY / adaptedLuminance * std::exp2(compensation);
+    }
+
+    // false until the first histogram is back; the caller keeps its own exposure until then
+    bool Ready() const { return adapted; }
+    float Exposure() const { return exposure; }
+    // of the histogram a few frames back, before adaptation
+    float AverageLuminance() const { return averageLuminance; }
+
+    void Delete() {
+        glDeleteBuffers(1, &histogramBuffer);
+        histogramBuffer = 0;
+        for (Readback &readback : readbacks) {
+            glDeleteBuffers(1, &readback.buffer);
+            if (readback.fence != nullptr)
+                glDeleteSync(readback.fence);
+            readback.fence = nullptr;
+        }
+    }
+
+private:
+    static const unsigned int GROUP_SIZE = 16;
+    static const unsigned int READBACK_FRAMES = 3;
+
+    struct Readback {
+        GLuint buffer = 0;
+        GLsync fence = nullptr;
+        unsigned long long frame = 0;
+    };
+
+    GLuint histogram[LUMINANCE_HISTOGRAM_BINS] = {0};
+    unsigned int histogramBuffer = 0;
+    Readback readbacks[READBACK_FRAMES];
+    unsigned long long frame = 0;
+    unsigned long long histogramFrame = 0;
+    bool measured = false, adapted = false;
+    float averageLuminance = 1.0f;
+    float adaptedLuminance = 1.0f;
+    float exposure = 1.0f;
+
+    // takes whichever copies have landed without waiting on the ones that have not
+    void pollReadbacks() {
+        for (Readback &readback : readbacks) {
+            if (readback.fence == nullptr)
+                continue;
+            GLenum status = glClientWaitSync(readback.fence, 0, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+                continue;
+            glDeleteSync(readback.fence);
+            readback.fence = nullptr;
+            if (measured && readback.frame < histogramFrame)
+                continue;
+            glBindBuffer(GL_COPY_WRITE_BUFFER, readback.buffer);
+            glGetBufferSubData(GL_COPY_WRITE_BUFFER, 0, sizeof(histogram), histogram);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            histogramFrame = readback.frame;
+            averageHistogram();
+        }
+    }
+
+    // mean log2 luminance over the kept part of the histogram, bin centers weighted by count
+    void averageHistogram() {
+        unsigned long long total = 0;
+        for (unsigned int bin = 0; bin < LUMINANCE_HISTOGRAM_BINS; bin++)
+            total += histogram[bin];
+        if (total == 0)
+            return;
+        double low = total * EXPOSURE_LOW_PERCENTILE, high = total * EXPOSURE_HIGH_PERCENTILE;
+        double below = 0.0, weight = 0.0, sum = 0.0;
+        for (unsigned int bin = 0; bin < LUMINANCE_HISTOGRAM_BINS; bin++) {
+            // the part of this bin between the two percentiles
+            double count = histogram[bin];
+            double kept = std::min(below + count, high) - std::max(below, low);
+            below += count;
+            if (kept <= 0.0)
+                continue;
+            double logLuminance = bin == 0
+                    ? MIN_LOG_LUMINANCE
+                    : MIN_LOG_LUMINANCE + (bin - 0.5) / (LUMINANCE_HISTOGRAM_BINS - 2) * (MAX_LOG_LUMINANCE - MIN_LOG_LUMINANCE);
+            sum += kept * logLuminance;
+            weight += kept;
+        }
+        if (weight > 0.0) {
+            averageLuminance = (float) std::exp2(sum / weight);
+            measured = true;
+        }
+    }
+};
+
+#endif //PROJECT_BASE_AUTOEXPOSURE_H
@@ -0,0 +1,392 @@
+//
+// Bounding volume hierarchy over boxes, for culling, ray casts and overlap queries.
+//
+
+#ifndef PROJECT_BASE_BVH_H
+#define PROJECT_BASE_BVH_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/mesh.h>
+#include <rg/Bounds.h>
+#include <rg/Frustum.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <utility>
+#include <vector>
+
+struct Ray {
+    glm::vec3 origin;
+    // normalized, so hit distances are in world units
+    glm::vec3 direction;
+};
+
+// slab test; distance to the entry point (0 when the origin is inside), or FLT_MAX on a miss
+float intersectRay(const Ray &ray, const AABB &box, float maxDistance) {
+    float tmin = 0.0f, tmax = maxDistance;
+    for (int axis = 0; axis < 3; axis++) {
+        float inverse = 1.0f / ray.direction[axis];
+        float t0 = (box.min[axis] - ray.origin[axis]) * inverse;
+        float t1 = (box.max[axis] - ray.origin[axis]) * inverse;
+        if (inverse < 0.0f)
+            std::swap(t0, t1);
+        tmin = t0 > tmin ? t0 : tmin;
+        tmax = t1 < tmax ? t1 : tmax;
+        if (tmax < tmin)
+            return FLT_MAX;
+    }
+    return tmin;
+}
+
+// Moller-Trumbore; distance along the ray, or FLT_MAX on a miss
+float intersectRay(const Ray &ray, const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c) {
+    glm::vec3 edge1 = b - a, edge2 = c - a;
+    glm::vec3 p = glm::cross(ray.direction, edge2);
+    float determinant = glm::dot(edge1, p);
+    if (glm::abs(determinant) < 1e-8f)
+        return FLT_MAX;
+    float inverse = 1.0f / determinant;
+    glm::vec3 s = ray.origin - a;
+    float u = glm::dot(s, p) * inverse;
+    if (u < 0.0f || u > 1.0f)
+        return FLT_MAX;
+    glm::vec3 q = glm::cross(s, edge1);
+    float v = glm::dot(ray.direction, q) * inverse;
+    if (v < 0.0f || u + v > 1.0f)
+        return FLT_MAX;
+    float t = glm::dot(edge2, q) * inverse;
+    return t > 0.0f ? t : FLT_MAX;
+}
+
+bool overlaps(const BoundingSphere &sphere, const AABB &box) {
+    glm::vec3 closest = glm::clamp(sphere.center, box.min, box.max);
+    glm::vec3 offset = closest - sphere.center;
+    return glm::dot(offset, offset) <= sphere.radius * sphere.radius;
+}
+
+const unsigned int BVH_NO_NODE = ~0u;
+
+class BVH {
+public:
+    struct Node {
+        AABB bounds;
+        // first item for leaves, left child for inner nodes (right child follows it)
+        unsigned int leftOrFirst = 0;
+        // items in a leaf, 0 for inner nodes
+        unsigned int count = 0;
+
+        bool IsLeaf() const { return count > 0; }
+    };
+
+    // Binned SAH build, top down. Item i keeps index i in every query result.
+    void Build(const std::vector<AABB> &boxes) {
+        this->boxes = boxes;
+        unsigned int n = boxes.size();
+        items.resize(n);
+        centroids.resize(n);
+        leafOf.assign(n, 0);
+        for (unsigned int i = 0; i < n; i++) {
+            items[i] = i;
+            centroids[i] = boxes[i].Center();
+        }
+
+        nodes.clear();
+        parents.clear();
+        if (n == 0)
+            return;
+        nodes.reserve(2 * n);
+        parents.reserve(2 * n);
+        nodes.push_back(Node());
+        parents.push_back(BVH_NO_NODE);
+        nodes[0].leftOrFirst = 0;
+        nodes[0].count = n;
+
+        // (node, depth) pairs
+        std::vector<std::pair<unsigned int, unsigned int>> stack(1, std::make_pair(0u, 0u));
+        while (!stack.empty()) {
+            unsigned int node = stack.back().first;
+            unsigned int depth = stack.back().second;
+            stack.pop_back();
+            updateBounds(node);
+            if (depth < MAX_DEPTH && split(node)) {
+                stack.push_back(std::make_pair(nodes[node].leftOrFirst, depth + 1));
+                stack.push_back(std::make_pair(nodes[node].leftOrFirst + 1, depth + 1));
+            } else {
+                for (unsigned int i = 0; i < nodes[node].count; i++)
+                    leafOf[items[nodes[node].leftOrFirst + i]] = node;
+            }
+        }
+    }
+
+    // Refit after an item moved: recomputes the bounds from its leaf up to the root. The
+    // topology stays, so quality degrades if things move far; rebuild then.
+    void Update(unsigned int item, const AABB &box) {
+        boxes[item] = box;
+        centroids[item] = box.Center();
+        for (unsigned int node = leafOf[item]; node != BVH_NO_NODE; node = parents[node])
+            updateBounds(node);
+    }
+
+    // Hierarchical frustum test: subtrees fully inside are taken without testing their items.
+    void Cull(const Frustum &frustum, std::vector<unsigned int> &visible) const {
+        if (nodes.empty())
+            return;
+        unsigned int stack[64];
+        unsigned int depth = 0;
+        stack[depth++] = 0;
+        while (depth > 0) {
+            const Node &node = nodes[stack[--depth]];
+            FrustumTest test = classify(frustum, node.bounds);
+            if (test == FRUSTUM_OUTSIDE)
+                continue;
+            if (test == FRUSTUM_INSIDE) {
+                appendAll(node, visible);
+                continue;
+            }
+            if (node.IsLeaf()) {
+                for (unsigned int i = 0; i < node.count; i++) {
+                    unsigned int item = items[node.leftOrFirst + i];
+                    if (intersects(frustum, boxes[item]))
+                        visible.push_back(item);
+                }
+            } else {
+                stack[depth++] = node.leftOrFirst;
+                stack[depth++] = node.leftOrFirst + 1;
+            }
+        }
+    }
+
+    // Closest hit. hitTest(item, ray, maxDistance) returns the distance to the item or FLT_MAX,
+    // so callers can refine box hits with triangles; nearer children are visited first.
+    template <class HitTest>
+    bool Raycast(const Ray &ray, HitTest hitTest, unsigned int &hitItem, float &hitDistance) const {
+        hitDistance = FLT_MAX;
+        if (nodes.empty())
+            return false;
+        unsigned int stack[64];
+        unsigned int depth = 0;
+        stack[depth++] = 0;
+        while (depth > 0) {
+            const Node &node = nodes[stack[--depth]];
+            if (intersectRay(ray, node.bounds, hitDistance) == FLT_MAX)
+                continue;
+            if (node.IsLeaf()) {
+                for (unsigned int i = 0; i < node.count; i++) {
+                    unsigned int item = items[node.leftOrFirst + i];
+                    if (intersectRay(ray, boxes[item], hitDistance) == FLT_MAX)
+                        continue;
+                    float distance = hitTest(item, ray, hitDistance);
+                    if (distance < hitDistance) {
+                        hitDistance = distance;
+                        hitItem = item;
+                    }
+                }
+            } else {
+                unsigned int left = node.leftOrFirst, right = left + 1;
+                float leftDistance = intersectRay(ray, nodes[left].bounds, hitDistance);
+                float rightDistance = intersectRay(ray, nodes[right].bounds, hitDistance);
+                // push the farther child first so the nearer one is popped next
+                if (leftDistance < rightDistance)
+                    std::swap(left, right);
+                stack[depth++] = left;
+                stack[depth++] = right;
+            }
+        }
+        return hitDistance != FLT_MAX;
+    }
+
+    // closest item box along the ray
+    bool Raycast(const Ray &ray, unsigned int &hitItem, float &hitDistance) const {
+        const std::vector<AABB> &boxes = this->boxes;
+        return Raycast(ray, [&boxes](unsigned int item, const Ray &r, float maxDistance) {
+            return intersectRay(r, boxes[item], maxDistance);
+        }, hitItem, hitDistance);
+    }
+
+    // items whose box overlaps the sphere
+    void Overlap(const BoundingSphere &sphere, std::vector<unsigned int> &result) const {
+        if (nodes.empty())
+            return;
+        unsigned int stack[64];
+        unsigned int depth = 0;
+        stack[depth++] = 0;
+        while (depth > 0) {
+            const Node &node = nodes[stack[--depth]];
+            if (!overlaps(sphere, node.bounds))
+                continue;
+            if (node.IsLeaf()) {
+                for (unsigned int i = 0; i < node.count; i++) {
+                    unsigned int item = items[node.leftOrFirst + i];
+                    if (overlaps(sphere, boxes[item]))
+                        result.push_back(item);
+                }
+            } else {
+                stack[depth++] = node.leftOrFirst;
+                stack[depth++] = node.leftOrFirst + 1;
+            }
+        }
+    }
+
+    const AABB &ItemBounds(unsigned int item) const { return boxes[item]; }
+    unsigned int ItemCount() const { return boxes.size(); }
+    unsigned int NodeCount() const { return nodes.size(); }
+
+private:
+    static const unsigned int BINS = 12;
+    static const unsigned int MAX_LEAF_ITEMS = 8;
+    // keeps the fixed traversal stacks (one slot per level plus one) from overflowing
+    static const unsigned int MAX_DEPTH = 62;
+
+    std::vector<Node> nodes;
+    std::vector<unsigned int> parents;
+    // item indices, permuted so every leaf covers a contiguous range
+    std::vector<unsigned int> items;
+    std::vector<AABB> boxes;
+    std::vector<glm::vec3> centroids;
+    std::vector<unsigned int> leafOf;
+
+    static float surfaceArea(const AABB &box) {
+        if (box.Empty())
+            return 0.0f;
+        glm::vec3 size = box.max - box.min;
+        return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+    }
+
+    void updateBounds(unsigned int index) {
+        Node &node = nodes[index];
+        node.bounds = AABB();
+        if (node.IsLeaf()) {
+            for (unsigned int i = 0; i < node.count; i++)
+                node.bounds.Expand(boxes[items[node.leftOrFirst + i]]);
+        } else {
+            node.bounds.Expand(nodes[node.leftOrFirst].bounds);
+            node.bounds.Expand(nodes[node.leftOrFirst + 1].bounds);
+        }
+    }
+
+    void appendAll(const Node &node, std::vector<unsigned int> &result) const {
+        if (node.IsLeaf()) {
+            for (unsigned int i = 0; i < node.count; i++)
+                result.push_back(items[node.leftOrFirst + i]);
+        } else {
+            appendAll(nodes[node.leftOrFirst], result);
+            appendAll(nodes[node.leftOrFirst + 1], result);
+        }
+    }
+
+    // Picks the cheapest of BINS - 1 planes per axis by surface area heuristic. Returns false
+    // and leaves the node a leaf when splitting does not pay off.
+    bool split(unsigned int index) {
+        Node node = nodes[index];
+        if (node.count <= 2)
+            return false;
+
+        AABB centroidBounds;
+        for (unsigned int i = 0; i < node.count; i++)
+            centroidBounds.Expand(centroids[items[node.leftOrFirst + i]]);
+
+        float bestCost = FLT_MAX;
+        int bestAxis = -1;
+        unsigned int bestBin = 0;
+        for (int axis = 0; axis < 3; axis++) {
+            float lo = centroidBounds.min[axis], hi = centroidBounds.max[axis];
+            if (hi <= lo)
+                continue;
+            AABB binBounds[BINS];
+            unsigned int binCounts[BINS] = {0};
+            float scale = BINS / (hi - lo);
+            for (unsigned int i = 0; i < node.count; i++) {
+                unsigned int item = items[node.leftOrFirst + i];
+                unsigned int bin = std::min(BINS - 1, (unsigned int) ((centroids[item][axis] - lo) * scale));
+                binCounts[bin]++;
+                binBounds[bin].Expand(boxes[item]);
+            }
+            // sweep from the right to get the cost of every plane in one pass each way
+            float rightArea[BINS];
+            unsigned int rightCount[BINS];
+            AABB accumulated;
+            unsigned int count = 0;
+            for (unsigned int bin = BINS - 1; bin > 0; bin--) {
+                accumulated.Expand(binBounds[bin]);
+                count += binCounts[bin];
+                rightArea[bin] = surfaceArea(accumulated);
+                rightCount[bin] = count;
+            }
+            accumulated = AABB();
+            count = 0;
+            for (unsigned int bin = 0; bin < BINS - 1; bin++) {
+                accumulated.Expand(binBounds[bin]);
+                count += binCounts[bin];
+                float cost = count * surfaceArea(accumulated) + rightCount[bin + 1] * rightArea[bin + 1];
+                if (count > 0 && rightCount[bin + 1] > 0 && cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestBin = bin;
+                }
+            }
+        }
+
+        float leafCost = node.count * surfaceArea(node.bounds);
+        if (bestAxis < 0 || (bestCost >= leafCost && node.count <= MAX_LEAF_ITEMS))
+            return false;
+
+        float lo = centroidBounds.min[bestAxis];
+        float scale = BINS / (centroidBounds.max[bestAxis] - lo);
+        unsigned int *first = &items[node.leftOrFirst];
+        unsigned int *middle = std::partition(first, first + node.count, [&](unsigned int item) {
+            return std::min(BINS - 1, (unsigned int) ((centroids[item][bestAxis] - lo) * scale)) <= bestBin;
+        });
+        unsigned int leftCount = middle - first;
+
+        unsigned int left = nodes.size();
+        nodes.push_back(Node());
+        nodes.push_back(Node());
+        parents.push_back(index);
+        parents.push_back(index);
+        nodes[left].leftOrFirst = node.leftOrFirst;
+        nodes[left].count = leftCount;
+        nodes[left + 1].leftOrFirst = node.leftOrFirst + leftCount;
+        nodes[left + 1].count = node.count - leftCount;
+        nodes[index].leftOrFirst = left;
+        nodes[index].count = 0;
+        return true;
+    }
+};
+
+// Triangle BVH over one mesh in its object space, for exact picking.
+class TriangleBVH {
+public:
+    explicit TriangleBVH(const Mesh &mesh) {
+        positions.reserve(mesh.vertices.size());
+        for (const Vertex &vertex : mesh.vertices)
+            positions.push_back(vertex.Position);
+        indices = mesh.indices;
+
+        std::vector<AABB> boxes(indices.size() / 3);
+        for (unsigned int i = 0; i < boxes.size(); i++)
+            for (unsigned int corner = 0; corner < 3; corner++)
+                boxes[i].Expand(positions[indices[i * 3 + corner]]);
+        bvh.Build(boxes);
+    }
+
+    // ray in the mesh's object space
+    float Raycast(const Ray &ray, float maxDistance) const {
+        const std::vector<glm::vec3> &positions = this->positions;
+        const std::vector<unsigned int> &indices = this->indices;
+        unsigned int triangle;
+        float distance;
+        bool hit = bvh.Raycast(ray, [&](unsigned int item, const Ray &r, float) {
+            return intersectRay(r, positions[indices[item * 3]], positions[indices[item * 3 + 1]],
+                                positions[indices[item * 3 + 2]]);
+        }, triangle, distance);
+        return hit && distance < maxDistance ? distance : FLT_MAX;
+    }
+
+private:
+    std::vector<glm::vec3> positions;
+    std::vector<unsigned int> indices;
+    BVH bvh;
+};
+
+#endif //PROJECT_BASE_BVH_H
@@ -0,0 +1,171 @@
+//
+// Bloom from a chain of ever smaller copies of the HDR frame, blurred back up into the first.
+//
+
+#ifndef PROJECT_BASE_BLOOM_H
+#define PROJECT_BASE_BLOOM_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader.h>
+
+#include <algorithm>
+#include <vector>
+
+// Level 0 is half the frame, every level after it half the one before, down to a few
+// pixels. bloom_downsample.fs fills them top down with a 13-tap filter, the first pass
+// weighting its taps against fireflies; bloom_upsample.fs then walks back up with a 3x3
+// tent, each level becoming the average of itself and the blurred level below. The result
+// in level 0 is a weighted mean of blurs of every width, the weights adding up to one, so
+// the bloom has the frame's energy and the resolve only mixes a little of it in.
+// Like SceneTargets, the levels are sized from the window and only their lower-left part,
+// from the render size, is drawn, so dynamic resolution does not reallocate them.
+class Bloom {
+public:
+    static const unsigned int MAX_LEVELS = 6;
+    // no level smaller than this on its short side
+    static const int MIN_LEVEL_SIZE = 8;
+
+    void Create(int width, int height) {
+        glGenVertexArrays(1, &VAO);
+        allocate(width, height);
+    }
+
+    // for the window's new size; a minimized window keeps the old levels
+    void Resize(int width, int height) {
+        if (width <= 0 || height <= 0 || (width == this->width && height == this->height))
+            return;
+        release();
+        allocate(width, height);
+    }
+
+    // Blooms the lower-left renderWidth x renderHeight of colorTexture, which is the size
+    // the levels were made for. Leaves the framebuffer binding and viewport as they were.
+    void Render(Shader &downsampleShader, Shader &upsampleShader, unsigned int colorTexture,
+                int renderWidth, int renderHeight) {
+        GLint previousFBO;
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFBO);
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+        glDisable(GL_DEPTH_TEST);
+        glBindVertexArray(VAO);
+        glActiveTexture(GL_TEXTURE0);
+
+        // the drawn part of every level follows the render size down the chain
+        std::vector<glm::ivec2> drawn(levels.size());
+        glm::ivec2 size(renderWidth, renderHeight);
+        for (unsigned int i = 0; i < levels.size(); i++) {
+            size = glm::max(size / 2, glm::ivec2(1));
+            drawn[i] = size;
+        }
+
+        downsampleShader.use();
+        downsampleShader.setInt("source", 0);
+        for (unsigned int i = 0; i < levels.size(); i++) {
+            glm::ivec2 sourceSize = i == 0 ? glm::ivec2(width, height) : levels[i - 1].size;
+            glm::ivec2 sourceDrawn = i == 0 ? glm::ivec2(renderWidth, renderHeight) : drawn[i - 1];
+            setSource(downsampleShader, sourceSize, sourceDrawn);
+            downsampleShader.setBool("karisAverage", i == 0);
+            glBindTexture(GL_TEXTURE_2D, i == 0 ? colorTexture : levels[i - 1].texture);
+            drawLevel(levels[i], drawn[i]);
+        }
+
+        // each level = (itself + the blurred level below) / 2
+        upsampleShader.use();
+        upsampleShader.setInt("source", 0);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA);
+        glBlendColor(0.0f, 0.0f, 0.0f, 0.5f);
+        for (int i = (int) levels.size() - 2; i >= 0; i--) {
+            setSource(upsampleShader, levels[i + 1].size, drawn[i + 1]);
+            glBindTexture(GL_TEXTURE_2D, levels[i + 1].texture);
+            drawLevel(levels[i], drawn[i]);
+        }
+        glDisable(GL_BLEND);
+        // the function everything else that blends was set up with
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindVertexArray(0);
+        if (depthTest)
+            glEnable(GL_DEPTH_TEST);
+        glBindFramebuffer(GL_FRAMEBUFFER, previousFBO);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        firstDrawn = drawn.empty() ? glm::ivec2(0) : drawn[0];
+    }
+
+    // the bloom, in the lower-left Extent() of it in texture coordinates
+    unsigned int Texture() const { return levels.empty() ? 0 : levels[0].texture; }
+    glm::vec2 Extent() const {
+        return levels.empty() ? glm::vec2(0.0f) : glm::vec2(firstDrawn) / glm::vec2(levels[0].size);
+    }
+    unsigned int LevelCount() const { return levels.size(); }
+
+    void Delete() {
+        release();
+        glDeleteVertexArrays(1, &VAO);
+        VAO = 0;
+    }
+
+private:
+    struct Level {
+        unsigned int texture = 0;
+        unsigned int FBO = 0;
+        glm::ivec2 size;
+    };
+
+    // empty, the passes draw one triangle from gl_VertexID
+    unsigned int VAO = 0;
+    std::vector<Level> levels;
+    int width = 0, height = 0;
+    glm::ivec2 firstDrawn = glm::ivec2(0);
+
+    void allocate(int width, int height) {
+        this->width = width;
+        this->height = height;
+        glm::ivec2 size(width, height);
+        while (levels.size() < MAX_LEVELS && std::min(size.x, size.y) / 2 >= MIN_LEVEL_SIZE) {
+            size /= 2;
+            Level level;
+            level.size = size;
+            glGenTextures(1, &level.texture);
+            glBindTexture(GL_TEXTURE_2D, level.texture);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, size.x, size.y, 0, GL_RGB, GL_FLOAT, NULL);
+            // every filter tap is a bilinear one between texels
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glGenFramebuffers(1, &level.FBO);
+            glBindFramebuffer(GL_FRAMEBUFFER, level.FBO);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, level.texture, 0);
+            levels.push_back(level);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    void release() {
+        for (Level &level : levels) {
+            glDeleteTextures(1, &level.texture);
+            glDeleteFramebuffers(1, &level.FBO);
+        }
+        levels.clear();
+    }
+
+    // the filters read the drawn part of a texture only, clamped half a texel inside it
+    static void setSource(Shader &shader, glm::ivec2 size, glm::ivec2 drawn) {
+        shader.setVec2("sourceTexel", glm::vec2(1.0f) / glm::vec2(size));
+        shader.setVec2("sourceExtent", glm::vec2(drawn) / glm::vec2(size));
+    }
+
+    static void drawLevel(const Level &level, glm::ivec2 drawn) {
+        glBindFramebuffer(GL_FRAMEBUFFER, level.FBO);
+        glViewport(0, 0, drawn.x, drawn.y);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+};
+
+#endif //PROJECT_BASE_BLOOM_H
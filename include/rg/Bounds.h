@@ -0,0 +1,72 @@
+//
+// Axis-aligned bounding boxes and bounding spheres.
+//
+
+#ifndef PROJECT_BASE_BOUNDS_H
+#define PROJECT_BASE_BOUNDS_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cfloat>
+
+struct AABB {
+    // starts inverted so the first Expand sets both corners
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+
+    bool Empty() const { return min.x > max.x; }
+
+    void Expand(const glm::vec3 &point) {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    void Expand(const AABB &box) {
+        if (box.Empty())
+            return;
+        Expand(box.min);
+        Expand(box.max);
+    }
+
+    glm::vec3 Center() const { return (min + max) * 0.5f; }
+    glm::vec3 Extents() const { return (max - min) * 0.5f; }
+};
+
+struct BoundingSphere {
+    glm::vec3 center = glm::vec3(0.0f);
+    // negative while empty
+    float radius = -1.0f;
+
+    bool Empty() const { return radius < 0.0f; }
+};
+
+// box around the transformed box, from the center and the absolute linear part (Arvo)
+AABB transformAABB(const AABB &box, const glm::mat4 &transform) {
+    if (box.Empty())
+        return box;
+    glm::vec3 center = glm::vec3(transform * glm::vec4(box.Center(), 1.0f));
+    glm::vec3 extents = box.Extents();
+    glm::vec3 worldExtents(0.0f);
+    for (int row = 0; row < 3; row++)
+        for (int column = 0; column < 3; column++)
+            worldExtents[row] += glm::abs(transform[column][row]) * extents[column];
+    AABB result;
+    result.min = center - worldExtents;
+    result.max = center + worldExtents;
+    return result;
+}
+
+// scales the radius by the longest axis, so non-uniform scale still gives an enclosing sphere
+BoundingSphere transformSphere(const BoundingSphere &sphere, const glm::mat4 &transform) {
+    if (sphere.Empty())
+        return sphere;
+    float scale = glm::max(glm::length(glm::vec3(transform[0])),
+                           glm::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+    BoundingSphere result;
+    result.center = glm::vec3(transform * glm::vec4(sphere.center, 1.0f));
+    result.radius = sphere.radius * scale;
+    return result;
+}
+
+#endif //PROJECT_BASE_BOUNDS_H
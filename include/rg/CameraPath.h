@@ -0,0 +1,133 @@
+//
+// Records the camera frame by frame and plays it back, for timing renderer paths on the same views.
+//
+
+#ifndef PROJECT_BASE_CAMERAPATH_H
+#define PROJECT_BASE_CAMERAPATH_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/camera.h>
+
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+// One key per rendered frame, not per second: a replay shows exactly the recorded views
+// however fast or slow the frames come, so two runs of it draw the same images.
+class CameraPath {
+public:
+    struct Key {
+        glm::vec3 position;
+        glm::vec3 front;
+        glm::vec3 up;
+        glm::vec3 right;
+        float yaw, pitch, zoom;
+    };
+
+    // frame times collected over one replay
+    struct Timing {
+        unsigned int frames = 0;
+        float cpuMs = 0.0f;
+        unsigned int gpuSamples = 0;
+        float gpuMs = 0.0f;
+
+        float AverageCpuMs() const { return frames > 0 ? cpuMs / frames : 0.0f; }
+        float AverageGpuMs() const { return gpuSamples > 0 ? gpuMs / gpuSamples : 0.0f; }
+    };
+
+    void StartRecording() {
+        keys.clear();
+        recording = true;
+        playing = false;
+    }
+
+    void StopRecording() {
+        recording = false;
+    }
+
+    // adds the camera as it is this frame; does nothing unless recording
+    void Record(const Camera &camera) {
+        if (recording)
+            keys.push_back(Key{camera.Position, camera.Front, camera.Up, camera.Right,
+                               camera.Yaw, camera.Pitch, camera.Zoom});
+    }
+
+    void StartReplay() {
+        recording = false;
+        playing = !keys.empty();
+        frame = 0;
+        timing = Timing();
+    }
+
+    // Moves the camera to the next recorded view and counts this frame's times; cpuMs
+    // is the last frame's, gpuMs only counted when the timer has a new result. Returns
+    // false, leaving the camera alone, once the path has run out.
+    bool Replay(Camera &camera, float cpuMs, bool gpuResult, float gpuMs) {
+        if (!playing)
+            return false;
+        if (frame == keys.size()) {
+            playing = false;
+            return false;
+        }
+        const Key &key = keys[frame++];
+        camera.Position = key.position;
+        camera.Front = key.front;
+        camera.Up = key.up;
+        camera.Right = key.right;
+        camera.Yaw = key.yaw;
+        camera.Pitch = key.pitch;
+        camera.Zoom = key.zoom;
+        // the first frame's times belong to whatever ran before the replay
+        if (frame > 1) {
+            timing.frames++;
+            timing.cpuMs += cpuMs;
+            if (gpuResult) {
+                timing.gpuSamples++;
+                timing.gpuMs += gpuMs;
+            }
+        }
+        return true;
+    }
+
+    bool Recording() const { return recording; }
+    bool Playing() const { return playing; }
+    unsigned int FrameCount() const { return keys.size(); }
+    // the key the last Replay moved the camera to, 0 before the first
+    unsigned int Frame() const { return frame > 0 ? frame - 1 : 0; }
+    const Timing &LastTiming() const { return timing; }
+
+    void Save(const std::string &filename) const {
+        std::ofstream out(filename);
+        // enough digits for every float to read back as itself, so a loaded path replays the same views
+        out << std::setprecision(9);
+        for (const Key &key : keys)
+            out << key.position.x << ' ' << key.position.y << ' ' << key.position.z << ' '
+                << key.front.x << ' ' << key.front.y << ' ' << key.front.z << ' '
+                << key.up.x << ' ' << key.up.y << ' ' << key.up.z << ' '
+                << key.right.x << ' ' << key.right.y << ' ' << key.right.z << ' '
+                << key.yaw << ' ' << key.pitch << ' ' << key.zoom << '\n';
+    }
+
+    void Load(const std::string &filename) {
+        std::ifstream in(filename);
+        keys.clear();
+        Key key;
+        while (in >> key.position.x >> key.position.y >> key.position.z
+                  >> key.front.x >> key.front.y >> key.front.z
+                  >> key.up.x >> key.up.y >> key.up.z
+                  >> key.right.x >> key.right.y >> key.right.z
+                  >> key.yaw >> key.pitch >> key.zoom)
+            keys.push_back(key);
+    }
+
+private:
+    std::vector<Key> keys;
+    bool recording = false;
+    bool playing = false;
+    unsigned int frame = 0;
+    Timing timing;
+};
+
+#endif //PROJECT_BASE_CAMERAPATH_H
@@ -0,0 +1,319 @@
+//
+// Point and spot lights binned into a view-space froxel grid for clustered forward shading.
+//
+
+#ifndef PROJECT_BASE_CLUSTEREDLIGHTS_H
+#define PROJECT_BASE_CLUSTEREDLIGHTS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader.h>
+#include <rg/Bounds.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+// froxel grid: screen tiles by exponential depth slices between the near and far plane
+const unsigned int CLUSTER_TILES_X = 16;
+const unsigned int CLUSTER_TILES_Y = 9;
+const unsigned int CLUSTER_SLICES = 24;
+const unsigned int CLUSTER_COUNT = CLUSTER_TILES_X * CLUSTER_TILES_Y * CLUSTER_SLICES;
+
+// texture units of the light buffers; Material keeps its samplers below these
+const unsigned int LIGHT_DATA_UNIT = 12;
+const unsigned int CLUSTER_DATA_UNIT = 13;
+const unsigned int CLUSTER_INDEX_UNIT = 14;
+
+// RGBA32F texels per light in the light buffer, laid out as clustered_lights.glsl reads them
+const unsigned int LIGHT_TEXELS = 6;
+
+// a light stops where its attenuated diffuse falls below this; that distance is its range
+const float LIGHT_CUTOFF = 0.01f;
+
+// which shadow map a light is tested against; the maps themselves are in rg/ShadowMaps.h
+enum LightShadow {
+    SHADOW_NONE = 0,
+    SHADOW_SPOT = 1,
+    SHADOW_POINT = 2
+};
+
+// A point or spot light with the attenuation terms room.fs always used. cutOff and
+// outerCutOff are cosines; a point light is a spot whose cone never cuts anything off.
+struct Light {
+    glm::vec3 position;
+    glm::vec3 direction = glm::vec3(0.0f, -1.0f, 0.0f);
+    float cutOff = -1.0f;
+    float outerCutOff = -2.0f;
+
+    float constant;
+    float linear;
+    float quadratic;
+
+    glm::vec3 ambient;
+    glm::vec3 diffuse;
+    glm::vec3 specular;
+
+    LightShadow shadow = SHADOW_NONE;
+};
+
+// distance at which constant + linear d + quadratic d^2 reaches brightest / LIGHT_CUTOFF
+float lightRange(const Light &light) {
+    float brightest = std::max(std::max(light.diffuse.r, light.diffuse.g), light.diffuse.b);
+    brightest = std::max(brightest, std::max(std::max(light.ambient.r, light.ambient.g), light.ambient.b));
+    float target = brightest / LIGHT_CUTOFF - light.constant;
+    if (target <= 0.0f)
+        return 0.0f;
+    if (light.quadratic > 0.0f)
+        return (-light.linear + std::sqrt(light.linear * light.linear + 4.0f * light.quadratic * target))
+               / (2.0f * light.quadratic);
+    if (light.linear > 0.0f)
+        return target / light.linear;
+    return FLT_MAX;
+}
+
+// Lights are collected on the CPU every frame and each one is tested against the view-space
+// boxes of the froxels its range sphere can reach. The result goes to the GPU as three
+// texture buffers: the lights, an (offset, count) pair per cluster, and the light indices
+// those pairs point into. A fragment finds its cluster from gl_FragCoord and its view depth
+// and only loops over that cluster's lights.
+class ClusteredLights {
+public:
+    void Create() {
+        glGenBuffers(1, &lightBuffer);
+        glGenBuffers(1, &clusterBuffer);
+        glGenBuffers(1, &indexBuffer);
+        glGenTextures(1, &lightTexture);
+        glGenTextures(1, &clusterTexture);
+        glGenTextures(1, &indexTexture);
+        attach(lightTexture, lightBuffer, GL_RGBA32F);
+        attach(clusterTexture, clusterBuffer, GL_RG32UI);
+        attach(indexTexture, indexBuffer, GL_R32UI);
+    }
+
+    void Begin() {
+        lights.clear();
+    }
+
+    void Add(const Light &light) {
+        lights.push_back(light);
+    }
+
+    // Bins this frame's lights for a camera with the given view, projection and depth range
+    // rendering to a viewport of viewportSize pixels, then uploads the buffers and binds them
+    // to their units.
+    void Update(const glm::mat4 &view, const glm::mat4 &projection, float nearPlane, float farPlane,
+                const glm::vec2 &viewportSize) {
+        if (projection != clusterProjection || nearPlane != clusterNear || farPlane != clusterFar)
+            buildClusters(projection, nearPlane, farPlane);
+        this->viewportSize = viewportSize;
+
+        std::vector<glm::vec4> lightTexels;
+        lightTexels.reserve(lights.size() * LIGHT_TEXELS);
+        pairs.clear();
+        for (unsigned int i = 0; i < lights.size(); i++) {
+            const Light &light = lights[i];
+            float range = lightRange(light);
+            lightTexels.push_back(glm::vec4(light.position, range));
+            lightTexels.push_back(glm::vec4(glm::normalize(light.direction), light.cutOff));
+            lightTexels.push_back(glm::vec4(light.ambient, light.outerCutOff));
+            lightTexels.push_back(glm::vec4(light.diffuse, light.constant));
+            lightTexels.push_back(glm::vec4(light.specular, light.linear));
+            lightTexels.push_back(glm::vec4(light.quadratic, (float) light.shadow, 0.0f, 0.0f));
+            if (range > 0.0f)
+                assign(i, glm::vec3(view * glm::vec4(light.position, 1.0f)), range, projection);
+        }
+
+        // counting sort of the (cluster, light) pairs into per-cluster runs
+        std::vector<glm::uvec2> clusters(CLUSTER_COUNT, glm::uvec2(0));
+        for (const Pair &pair : pairs)
+            clusters[pair.cluster].y++;
+        unsigned int offset = 0;
+        maxPerCluster = 0;
+        for (glm::uvec2 &cluster : clusters) {
+            cluster.x = offset;
+            offset += cluster.y;
+            maxPerCluster = std::max(maxPerCluster, cluster.y);
+            cluster.y = 0;
+        }
+        std::vector<unsigned int> indices(pairs.size());
+        for (const Pair &pair : pairs) {
+            glm::uvec2 &cluster = clusters[pair.cluster];
+            indices[cluster.x + cluster.y++] = pair.light;
+        }
+
+        upload(lightBuffer, lightTexels.data(), lightTexels.size() * sizeof(glm::vec4));
+        upload(clusterBuffer, clusters.data(), clusters.size() * sizeof(glm::uvec2));
+        upload(indexBuffer, indices.data(), indices.size() * sizeof(unsigned int));
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+        glActiveTexture(GL_TEXTURE0 + LIGHT_DATA_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, lightTexture);
+        glActiveTexture(GL_TEXTURE0 + CLUSTER_DATA_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, clusterTexture);
+        glActiveTexture(GL_TEXTURE0 + CLUSTER_INDEX_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, indexTexture);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // the uniforms clustered_lights.glsl needs; shader has to be the current program
+    void SetUniforms(Shader &shader) const {
+        shader.setInt("lightData", LIGHT_DATA_UNIT);
+        shader.setInt("clusterData", CLUSTER_DATA_UNIT);
+        shader.setInt("clusterLightIndices", CLUSTER_INDEX_UNIT);
+        glUniform3i(glGetUniformLocation(shader.ID, "clusterGridSize"), CLUSTER_TILES_X, CLUSTER_TILES_Y, CLUSTER_SLICES);
+        shader.setVec2("clusterTileSize", viewportSize / glm::vec2(CLUSTER_TILES_X, CLUSTER_TILES_Y));
+        // slice = log(depth) * scale + bias
+        float scale = CLUSTER_SLICES / std::log(clusterFar / clusterNear);
+        shader.setVec2("clusterDepthScaleBias", scale, -std::log(clusterNear) * scale);
+    }
+
+    unsigned int LightCount() const { return lights.size(); }
+    // light references over all clusters, and the most any single cluster holds
+    unsigned int IndexCount() const { return pairs.size(); }
+    unsigned int MaxPerCluster() const { return maxPerCluster; }
+
+    void Delete() {
+        glDeleteTextures(1, &lightTexture);
+        glDeleteTextures(1, &clusterTexture);
+        glDeleteTextures(1, &indexTexture);
+        glDeleteBuffers(1, &lightBuffer);
+        glDeleteBuffers(1, &clusterBuffer);
+        glDeleteBuffers(1, &indexBuffer);
+    }
+
+private:
+    struct Pair {
+        unsigned int cluster;
+        unsigned int light;
+    };
+
+    GLuint lightBuffer = 0, clusterBuffer = 0, indexBuffer = 0;
+    GLuint lightTexture = 0, clusterTexture = 0, indexTexture = 0;
+    std::vector<Light> lights;
+    std::vector<Pair> pairs;
+    unsigned int maxPerCluster = 0;
+
+    // view-space boxes of every cluster, only rebuilt when the projection changes
+    std::vector<AABB> clusterBounds;
+    // projection and depth range the boxes were built for
+    glm::mat4 clusterProjection = glm::mat4(0.0f);
+    float clusterNear = 0.1f, clusterFar = 100.0f;
+    glm::vec2 viewportSize = glm::vec2(1.0f);
+
+    static void attach(GLuint texture, GLuint buffer, GLenum format) {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_DYNAMIC_DRAW);
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    // orphans the old storage; an empty buffer still gets a few bytes so the texture stays valid
+    static void upload(GLuint buffer, const void *data, size_t size) {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(size, 16), nullptr, GL_DYNAMIC_DRAW);
+        if (size > 0)
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+    }
+
+    static float sliceDepth(unsigned int slice, float nearPlane, float farPlane) {
+        return nearPlane * std::pow(farPlane / nearPlane, (float) slice / CLUSTER_SLICES);
+    }
+
+    // Each tile's corners are unprojected to view-space rays with z = -1; a cluster's box
+    // holds those rays between its two slice depths.
+    void buildClusters(const glm::mat4 &projection, float nearPlane, float farPlane) {
+        clusterProjection = projection;
+        clusterNear = nearPlane;
+        clusterFar = farPlane;
+        glm::mat4 inverseProjection = glm::inverse(projection);
+        auto ray = [&](float ndcX, float ndcY) {
+            glm::vec4 p = inverseProjection * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+            glm::vec3 point = glm::vec3(p) / p.w;
+            return point / -point.z;
+        };
+
+        clusterBounds.assign(CLUSTER_COUNT, AABB());
+        for (unsigned int y = 0; y < CLUSTER_TILES_Y; y++) {
+            for (unsigned int x = 0; x < CLUSTER_TILES_X; x++) {
+                float x0 = 2.0f * x / CLUSTER_TILES_X - 1.0f, x1 = 2.0f * (x + 1) / CLUSTER_TILES_X - 1.0f;
+                float y0 = 2.0f * y / CLUSTER_TILES_Y - 1.0f, y1 = 2.0f * (y + 1) / CLUSTER_TILES_Y - 1.0f;
+                glm::vec3 corners[4] = {ray(x0, y0), ray(x1, y0), ray(x0, y1), ray(x1, y1)};
+                for (unsigned int z = 0; z < CLUSTER_SLICES; z++) {
+                    float nearDepth = sliceDepth(z, nearPlane, farPlane);
+                    float farDepth = sliceDepth(z + 1, nearPlane, farPlane);
+                    AABB &box = clusterBounds[clusterIndex(x, y, z)];
+                    for (const glm::vec3 &corner : corners) {
+                        box.Expand(corner * nearDepth);
+                        box.Expand(corner * farDepth);
+                    }
+                }
+            }
+        }
+    }
+
+    static unsigned int clusterIndex(unsigned int x, unsigned int y, unsigned int z) {
+        return (z * CLUSTER_TILES_Y + y) * CLUSTER_TILES_X + x;
+    }
+
+    // Narrows the search to the slices the sphere's depth range covers and the tiles its
+    // view-space box projects to, then keeps the clusters whose box the sphere touches.
+    void assign(unsigned int light, const glm::vec3 &center, float range, const glm::mat4 &projection) {
+        float minDepth = -center.z - range, maxDepth = -center.z + range;
+        if (maxDepth < clusterNear || minDepth > clusterFar)
+            return;
+        float scale = CLUSTER_SLICES / std::log(clusterFar / clusterNear);
+        auto slice = [&](float depth) {
+            if (depth <= clusterNear)
+                return 0u;
+            if (depth >= clusterFar)
+                return CLUSTER_SLICES - 1;
+            return std::min((unsigned int) (std::log(depth / clusterNear) * scale), CLUSTER_SLICES - 1);
+        };
+        unsigned int z0 = slice(minDepth), z1 = slice(maxDepth);
+
+        unsigned int x0 = 0, y0 = 0, x1 = CLUSTER_TILES_X - 1, y1 = CLUSTER_TILES_Y - 1;
+        // a sphere reaching behind the near plane can cover any tile
+        if (minDepth > clusterNear) {
+            glm::vec2 ndcMin(FLT_MAX), ndcMax(-FLT_MAX);
+            for (unsigned int i = 0; i < 8; i++) {
+                glm::vec3 corner = center + glm::vec3(i & 1 ? range : -range, i & 2 ? range : -range,
+                                                      i & 4 ? range : -range);
+                glm::vec4 clip = projection * glm::vec4(corner, 1.0f);
+                glm::vec2 ndc = glm::vec2(clip) / clip.w;
+                ndcMin = glm::min(ndcMin, ndc);
+                ndcMax = glm::max(ndcMax, ndc);
+            }
+            if (ndcMax.x < -1.0f || ndcMax.y < -1.0f || ndcMin.x > 1.0f || ndcMin.y > 1.0f)
+                return;
+            auto tile = [](float ndc, unsigned int tiles) {
+                float t = glm::clamp((ndc * 0.5f + 0.5f) * tiles, 0.0f, tiles - 1.0f);
+                return (unsigned int) t;
+            };
+            x0 = tile(ndcMin.x, CLUSTER_TILES_X);
+            x1 = tile(ndcMax.x, CLUSTER_TILES_X);
+            y0 = tile(ndcMin.y, CLUSTER_TILES_Y);
+            y1 = tile(ndcMax.y, CLUSTER_TILES_Y);
+        }
+
+        float rangeSquared = range * range;
+        for (unsigned int z = z0; z <= z1; z++) {
+            for (unsigned int y = y0; y <= y1; y++) {
+                for (unsigned int x = x0; x <= x1; x++) {
+                    unsigned int cluster = clusterIndex(x, y, z);
+                    const AABB &box = clusterBounds[cluster];
+                    glm::vec3 closest = glm::clamp(center, box.min, box.max);
+                    glm::vec3 d = closest - center;
+                    if (glm::dot(d, d) <= rangeSquared)
+                        pairs.push_back(Pair{cluster, light});
+                }
+            }
+        }
+    }
+};
+
+#endif //PROJECT_BASE_CLUSTEREDLIGHTS_H
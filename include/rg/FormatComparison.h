@@ -0,0 +1,134 @@
+//
+// Replays the camera path with two scene color formats and compares what reaches the window.
+//
+
+#ifndef PROJECT_BASE_FORMATCOMPARISON_H
+#define PROJECT_BASE_FORMATCOMPARISON_H
+
+#include <glad/glad.h>
+
+#include <rg/SceneTargets.h>
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+// The path is played once with the reference format, capturing a few frames spread along
+// it, then once more with the candidate, comparing the same frames as they come. Frames are
+// read from the window after the post pass and before the overlay, so the numbers are about
+// the 8-bit image that is shown: exposure, bloom, grade and dither included. The caller
+// holds everything that drifts from run to run (exposure adaptation, render scale) fixed
+// and drives animation from the replay frame rather than the clock while Running().
+// glReadPixels waits for the GPU, so no timings are taken on these replays.
+class FormatComparison {
+public:
+    static const unsigned int SAMPLE_FRAMES = 8;
+
+    struct Result {
+        SceneColorFormat reference = SCENE_COLOR_RGBA16F;
+        SceneColorFormat candidate = SCENE_COLOR_RGBA16F;
+        unsigned int frames = 0;
+        // over every compared pixel together, and the frame that came out worst; infinite
+        // when the images are identical
+        double psnr = 0.0;
+        double worstFramePsnr = 0.0;
+        // largest difference of any channel, in 8-bit steps
+        int maxError = 0;
+    };
+
+    void Start(unsigned int pathFrames, SceneColorFormat reference, SceneColorFormat candidate) {
+        result = Result();
+        result.reference = reference;
+        result.candidate = candidate;
+        stride = std::max(1u, pathFrames / SAMPLE_FRAMES);
+        captures.clear();
+        squaredError = 0.0;
+        comparedValues = 0;
+        finished = false;
+        phase = CAPTURE_REFERENCE;
+    }
+
+    bool Running() const { return phase != IDLE; }
+    // the format this frame of the replay is drawn with
+    SceneColorFormat Format() const { return phase == CAPTURE_REFERENCE ? result.reference : result.candidate; }
+
+    // after the post pass of replayed frame `frame`, with the window width x height
+    void Capture(unsigned int frame, int width, int height) {
+        if (phase == IDLE || frame % stride != stride / 2 || frame / stride >= SAMPLE_FRAMES)
+            return;
+        std::vector<unsigned char> pixels((size_t) width * height * 3);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadBuffer(GL_BACK);
+        glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+        if (phase == CAPTURE_REFERENCE) {
+            captures.push_back(CapturedFrame{frame, width, height, std::move(pixels)});
+            return;
+        }
+        auto reference = std::find_if(captures.begin(), captures.end(),
+                                      [frame](const CapturedFrame &capture) { return capture.frame == frame; });
+        // a window resized between the runs leaves nothing to compare this frame with
+        if (reference == captures.end() || reference->width != width || reference->height != height)
+            return;
+        double frameError = 0.0;
+        for (size_t i = 0; i < pixels.size(); i++) {
+            int difference = std::abs((int) pixels[i] - (int) reference->pixels[i]);
+            frameError += (double) difference * difference;
+            result.maxError = std::max(result.maxError, difference);
+        }
+        double framePsnr = psnr(frameError, pixels.size());
+        result.worstFramePsnr = result.frames == 0 ? framePsnr : std::min(result.worstFramePsnr, framePsnr);
+        result.frames++;
+        squaredError += frameError;
+        comparedValues += pixels.size();
+    }
+
+    // Call when a replay ran out. Returns true when the path should be played again, for
+    // the candidate; after that run the result is ready.
+    bool ReplayFinished() {
+        if (phase == CAPTURE_REFERENCE) {
+            phase = COMPARE_CANDIDATE;
+            return true;
+        }
+        if (phase == COMPARE_CANDIDATE) {
+            result.psnr = psnr(squaredError, comparedValues);
+            captures.clear();
+            captures.shrink_to_fit();
+            finished = true;
+        }
+        phase = IDLE;
+        return false;
+    }
+
+    // false until a comparison has run to the end
+    bool HasResult() const { return finished; }
+    const Result &LastResult() const { return result; }
+
+private:
+    enum Phase { IDLE, CAPTURE_REFERENCE, COMPARE_CANDIDATE };
+
+    struct CapturedFrame {
+        unsigned int frame;
+        int width, height;
+        std::vector<unsigned char> pixels;
+    };
+
+    Phase phase = IDLE;
+    unsigned int stride = 1;
+    std::vector<CapturedFrame> captures;
+    double squaredError = 0.0;
+    size_t comparedValues = 0;
+    bool finished = false;
+    Result result;
+
+    // peak signal to noise ratio of 8-bit values, in dB
+    static double psnr(double squaredError, size_t values) {
+        if (values == 0 || squaredError == 0.0)
+            return INFINITY;
+        return 10.0 * std::log10(255.0 * 255.0 / (squaredError / values));
+    }
+};
+
+#endif //PROJECT_BASE_FORMATCOMPARISON_H
@@ -0,0 +1,127 @@
+//
+// View frustum planes and per-object visibility tests against them.
+//
+
+#ifndef PROJECT_BASE_FRUSTUM_H
+#define PROJECT_BASE_FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+#include <rg/Bounds.h>
+#include <rg/RenderStats.h>
+
+struct Frustum {
+    // left, right, bottom, top, near, far; xyz points inside, w is the distance term
+    glm::vec4 planes[6];
+};
+
+// Gribb/Hartmann: each plane is the last row of the matrix plus or minus one of the others.
+// With view * projection passed in, the planes come out in world space. ndcRect (min x, min y,
+// max x, max y) narrows the side planes to part of the screen, e.g. what a portal covers.
+Frustum extractFrustum(const glm::mat4 &viewProjection, const glm::vec4 &ndcRect = glm::vec4(-1.0f, -1.0f, 1.0f, 1.0f)) {
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; i++)
+        rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+    Frustum frustum;
+    frustum.planes[0] = rows[0] - ndcRect.x * rows[3];
+    frustum.planes[1] = ndcRect.z * rows[3] - rows[0];
+    frustum.planes[2] = rows[1] - ndcRect.y * rows[3];
+    frustum.planes[3] = ndcRect.w * rows[3] - rows[1];
+    frustum.planes[4] = rows[3] + rows[2];
+    frustum.planes[5] = rows[3] - rows[2];
+    for (glm::vec4 &plane : frustum.planes)
+        plane /= glm::length(glm::vec3(plane));
+    return frustum;
+}
+
+bool intersects(const Frustum &frustum, const BoundingSphere &sphere) {
+    for (const glm::vec4 &plane : frustum.planes)
+        if (glm::dot(glm::vec3(plane), sphere.center) + plane.w < -sphere.radius)
+            return false;
+    return true;
+}
+
+// tests the corner farthest along each plane normal; conservative near frustum corners
+bool intersects(const Frustum &frustum, const AABB &box) {
+    for (const glm::vec4 &plane : frustum.planes) {
+        glm::vec3 corner(plane.x >= 0.0f ? box.max.x : box.min.x,
+                         plane.y >= 0.0f ? box.max.y : box.min.y,
+                         plane.z >= 0.0f ? box.max.z : box.min.z);
+        if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f)
+            return false;
+    }
+    return true;
+}
+
+enum FrustumTest {
+    FRUSTUM_OUTSIDE,
+    FRUSTUM_INTERSECTS,
+    FRUSTUM_INSIDE
+};
+
+// like intersects(), but also reports boxes entirely inside so hierarchies can stop testing
+FrustumTest classify(const Frustum &frustum, const AABB &box) {
+    FrustumTest result = FRUSTUM_INSIDE;
+    for (const glm::vec4 &plane : frustum.planes) {
+        glm::vec3 normal(plane);
+        glm::vec3 farthest(plane.x >= 0.0f ? box.max.x : box.min.x,
+                           plane.y >= 0.0f ? box.max.y : box.min.y,
+                           plane.z >= 0.0f ? box.max.z : box.min.z);
+        if (glm::dot(normal, farthest) + plane.w < 0.0f)
+            return FRUSTUM_OUTSIDE;
+        glm::vec3 nearest(plane.x >= 0.0f ? box.min.x : box.max.x,
+                          plane.y >= 0.0f ? box.min.y : box.max.y,
+                          plane.z >= 0.0f ? box.min.z : box.max.z);
+        if (glm::dot(normal, nearest) + plane.w < 0.0f)
+            result = FRUSTUM_INTERSECTS;
+    }
+    return result;
+}
+
+// Culls whole objects by their world-space bounds: outside the frustum, or smaller on screen
+// than minPixelSize. Counts what it rejects into renderStats().
+class FrustumCuller {
+public:
+    void Begin(const glm::mat4 &view, const glm::mat4 &projection, const glm::vec3 &cameraPosition,
+               float viewportHeight, float minPixelSize) {
+        frustum = extractFrustum(projection * view);
+        this->cameraPosition = cameraPosition;
+        // projected diameter in pixels of a sphere at distance d is radius * pixelScale / d
+        pixelScale = projection[1][1] * viewportHeight;
+        this->minPixelSize = minPixelSize;
+    }
+
+    // sphere first since it is the cheaper reject, then the tighter box
+    bool Visible(const AABB &box, const BoundingSphere &sphere, unsigned int triangles) {
+        bool visible = LargeEnough(sphere)
+                       && (sphere.Empty() || intersects(frustum, sphere))
+                       && (box.Empty() || intersects(frustum, box));
+        if (!visible)
+            Reject(triangles);
+        return visible;
+    }
+
+    // the screen-size part of Visible, for objects already frustum tested elsewhere (BVH)
+    bool LargeEnough(const BoundingSphere &sphere) const {
+        if (sphere.Empty())
+            return true;
+        float distance = glm::length(sphere.center - cameraPosition);
+        return distance <= sphere.radius || sphere.radius * pixelScale / distance >= minPixelSize;
+    }
+
+    void Reject(unsigned int triangles) {
+        renderStats().culledObjects++;
+        renderStats().culledTriangles += triangles;
+    }
+
+    const Frustum &Planes() const { return frustum; }
+
+private:
+    Frustum frustum;
+    glm::vec3 cameraPosition = glm::vec3(0.0f);
+    float pixelScale = 1.0f;
+    float minPixelSize = 0.0f;
+};
+
+#endif //PROJECT_BASE_FRUSTUM_H
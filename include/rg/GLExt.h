@@ -0,0 +1,164 @@
+//
+// Optional OpenGL 4.x entry points.
+//
+
+#ifndef PROJECT_BASE_GLEXT_H
+#define PROJECT_BASE_GLEXT_H
+
+#include <glad/glad.h>
+#include <iostream>
+#include <string>
+
+// libs/glad is generated for the 3.3 core profile. Everything past 3.3 is declared here
+// in the same shape glad uses and loaded at runtime, so each renderer path can check
+// rg::glCaps() and fall back to plain 3.3 calls when the driver does not provide it.
+// Each pointer is the static of an inline function, one per program however many
+// translation units include this (C++14 has no inline variables).
+
+#ifndef GL_VERSION_4_2
+#define GL_VERSION_4_2 1
+#define GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT 0x00000001
+#define GL_TEXTURE_FETCH_BARRIER_BIT 0x00000008
+#define GL_SHADER_IMAGE_ACCESS_BARRIER_BIT 0x00000020
+#define GL_COMMAND_BARRIER_BIT 0x00000040
+#define GL_BUFFER_UPDATE_BARRIER_BIT 0x00000200
+#define GL_FRAMEBUFFER_BARRIER_BIT 0x00000400
+typedef void (APIENTRYP PFNGLMEMORYBARRIERPROC)(GLbitfield barriers);
+inline PFNGLMEMORYBARRIERPROC &rg_glMemoryBarrier() {
+    static PFNGLMEMORYBARRIERPROC proc = nullptr;
+    return proc;
+}
+#define glad_glMemoryBarrier rg_glMemoryBarrier()
+#define glMemoryBarrier glad_glMemoryBarrier
+typedef void (APIENTRYP PFNGLBINDIMAGETEXTUREPROC)(GLuint unit, GLuint texture, GLint level, GLboolean layered, GLint layer, GLenum access, GLenum format);
+inline PFNGLBINDIMAGETEXTUREPROC &rg_glBindImageTexture() {
+    static PFNGLBINDIMAGETEXTUREPROC proc = nullptr;
+    return proc;
+}
+#define glad_glBindImageTexture rg_glBindImageTexture()
+#define glBindImageTexture glad_glBindImageTexture
+typedef void (APIENTRYP PFNGLTEXSTORAGE2DPROC)(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height);
+inline PFNGLTEXSTORAGE2DPROC &rg_glTexStorage2D() {
+    static PFNGLTEXSTORAGE2DPROC proc = nullptr;
+    return proc;
+}
+#define glad_glTexStorage2D rg_glTexStorage2D()
+#define glTexStorage2D glad_glTexStorage2D
+#endif
+
+#ifndef GL_VERSION_4_3
+#define GL_VERSION_4_3 1
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#define GL_SHADER_STORAGE_BARRIER_BIT 0x00002000
+#define GL_COMPUTE_SHADER 0x91B9
+typedef void (APIENTRYP PFNGLMULTIDRAWELEMENTSINDIRECTPROC)(GLenum mode, GLenum type, const void *indirect, GLsizei drawcount, GLsizei stride);
+inline PFNGLMULTIDRAWELEMENTSINDIRECTPROC &rg_glMultiDrawElementsIndirect() {
+    static PFNGLMULTIDRAWELEMENTSINDIRECTPROC proc = nullptr;
+    return proc;
+}
+#define glad_glMultiDrawElementsIndirect rg_glMultiDrawElementsIndirect()
+#define glMultiDrawElementsIndirect glad_glMultiDrawElementsIndirect
+typedef void (APIENTRYP PFNGLDISPATCHCOMPUTEPROC)(GLuint num_groups_x, GLuint num_groups_y, GLuint num_groups_z);
+inline PFNGLDISPATCHCOMPUTEPROC &rg_glDispatchCompute() {
+    static PFNGLDISPATCHCOMPUTEPROC proc = nullptr;
+    return proc;
+}
+#define glad_glDispatchCompute rg_glDispatchCompute()
+#define glDispatchCompute glad_glDispatchCompute
+#endif
+
+#ifndef GL_VERSION_4_4
+#define GL_VERSION_4_4 1
+typedef void (APIENTRYP PFNGLBINDTEXTURESPROC)(GLuint first, GLsizei count, const GLuint *textures);
+inline PFNGLBINDTEXTURESPROC &rg_glBindTextures() {
+    static PFNGLBINDTEXTURESPROC proc = nullptr;
+    return proc;
+}
+#define glad_glBindTextures rg_glBindTextures()
+#define glBindTextures glad_glBindTextures
+#endif
+
+// GL_KHR_parallel_shader_compile, or the ARB extension with the same enums: the driver
+// compiles and links on its own threads and GL_COMPLETION_STATUS_KHR polls without waiting
+#ifndef GL_KHR_parallel_shader_compile
+#define GL_KHR_parallel_shader_compile 1
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+inline PFNGLMAXSHADERCOMPILERTHREADSKHRPROC &rg_glMaxShaderCompilerThreadsKHR() {
+    static PFNGLMAXSHADERCOMPILERTHREADSKHRPROC proc = nullptr;
+    return proc;
+}
+#define glad_glMaxShaderCompilerThreadsKHR rg_glMaxShaderCompilerThreadsKHR()
+#define glMaxShaderCompilerThreadsKHR glad_glMaxShaderCompilerThreadsKHR
+#endif
+
+namespace rg {
+
+    struct GLCaps {
+        int major = 3;
+        int minor = 3;
+        // glMultiDrawElementsIndirect + shader storage buffers (4.3)
+        bool multiDrawIndirect = false;
+        // compute shaders with image load/store and immutable textures (4.3)
+        bool compute = false;
+        // glBindTextures (4.4)
+        bool multiBind = false;
+        // background shader compiles (KHR or ARB_parallel_shader_compile)
+        bool parallelShaderCompile = false;
+
+        bool atLeast(int maj, int min) const {
+            return major > maj || (major == maj && minor >= min);
+        }
+    };
+
+    inline GLCaps& glCaps() {
+        static GLCaps caps;
+        return caps;
+    }
+
+    inline void loadGLExtensions(GLADloadproc load) {
+        GLCaps& caps = glCaps();
+        glGetIntegerv(GL_MAJOR_VERSION, &caps.major);
+        glGetIntegerv(GL_MINOR_VERSION, &caps.minor);
+
+        if (caps.atLeast(4, 3)) {
+            glad_glMultiDrawElementsIndirect = (PFNGLMULTIDRAWELEMENTSINDIRECTPROC) load("glMultiDrawElementsIndirect");
+            caps.multiDrawIndirect = glad_glMultiDrawElementsIndirect != nullptr;
+
+            glad_glDispatchCompute = (PFNGLDISPATCHCOMPUTEPROC) load("glDispatchCompute");
+            glad_glMemoryBarrier = (PFNGLMEMORYBARRIERPROC) load("glMemoryBarrier");
+            glad_glBindImageTexture = (PFNGLBINDIMAGETEXTUREPROC) load("glBindImageTexture");
+            glad_glTexStorage2D = (PFNGLTEXSTORAGE2DPROC) load("glTexStorage2D");
+            caps.compute = glad_glDispatchCompute != nullptr && glad_glMemoryBarrier != nullptr
+                           && glad_glBindImageTexture != nullptr && glad_glTexStorage2D != nullptr;
+        }
+        if (caps.atLeast(4, 4)) {
+            glad_glBindTextures = (PFNGLBINDTEXTURESPROC) load("glBindTextures");
+            caps.multiBind = glad_glBindTextures != nullptr;
+        }
+
+        GLint extensionCount = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+        for (GLint i = 0; i < extensionCount && glad_glMaxShaderCompilerThreadsKHR == nullptr; i++) {
+            std::string extension = (const char *) glGetStringi(GL_EXTENSIONS, i);
+            if (extension == "GL_KHR_parallel_shader_compile")
+                glad_glMaxShaderCompilerThreadsKHR = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC) load("glMaxShaderCompilerThreadsKHR");
+            else if (extension == "GL_ARB_parallel_shader_compile")
+                glad_glMaxShaderCompilerThreadsKHR = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC) load("glMaxShaderCompilerThreadsARB");
+        }
+        caps.parallelShaderCompile = glad_glMaxShaderCompilerThreadsKHR != nullptr;
+        // as many threads as the driver likes
+        if (caps.parallelShaderCompile)
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFFu);
+
+        std::cout << "OpenGL " << caps.major << "." << caps.minor
+                  << (caps.multiDrawIndirect ? ", multi-draw indirect" : "")
+                  << (caps.compute ? ", compute" : "")
+                  << (caps.multiBind ? ", multi-bind" : "")
+                  << (caps.parallelShaderCompile ? ", parallel shader compile" : "") << std::endl;
+    }
+}  // namespace rg
+
+#endif //PROJECT_BASE_GLEXT_H
@@ -0,0 +1,233 @@
+//
+// Frustum and Hi-Z culling of instanced copies of a model in a compute shader.
+//
+
+#ifndef PROJECT_BASE_GPUINSTANCECULLER_H
+#define PROJECT_BASE_GPUINSTANCECULLER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/model.h>
+#include <learnopengl/shader.h>
+#include <rg/Bounds.h>
+#include <rg/ComputeShader.h>
+#include <rg/Frustum.h>
+#include <rg/GLExt.h>
+#include <rg/HiZBuffer.h>
+#include <rg/InstanceBuffer.h>
+#include <rg/MultiDrawBatch.h>
+#include <rg/RenderStats.h>
+#include <rg/ShaderVariants.h>
+
+#include <cstddef>
+#include <vector>
+
+// std430 element of the bounds buffer read by cull_instances.comp
+struct InstanceBounds {
+    glm::vec4 min;
+    glm::vec4 max;
+};
+
+// cull_instances.comp tests every instance's world box against the frustum and the Hi-Z
+// pyramid, and appends the transforms and normal matrices of the survivors to a second pair
+// of buffers with an atomic counter in the first indirect command; the other commands (one
+// per mesh) count along.
+// Meshes are then drawn with glMultiDrawElementsIndirect straight from that buffer, so the
+// CPU issues the same calls whatever the GPU decided. The visible count comes back a few
+// frames later through fenced copies, only for the overlay.
+class GpuInstanceCuller {
+public:
+    // needs rg::glCaps().compute; model has to outlive the culler
+    void Create(const Model &model) {
+        this->model = &model;
+        commands.clear();
+        for (const Mesh &mesh : model.meshes)
+            commands.push_back(DrawElementsIndirectCommand{(GLuint) mesh.indices.size(), 0, 0, 0, 0});
+
+        glGenBuffers(1, &transformBuffer);
+        glGenBuffers(1, &boundsBuffer);
+        glGenBuffers(1, &visibleBuffer);
+        glGenBuffers(1, &normalBuffer);
+        glGenBuffers(1, &visibleNormalBuffer);
+        glGenBuffers(1, &commandBuffer);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+        for (Readback &readback : readbacks) {
+            glGenBuffers(1, &readback.buffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, readback.buffer);
+            glBufferData(GL_COPY_WRITE_BUFFER, sizeof(GLuint), nullptr, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    // world boxes and normal matrices are computed here, once per change, not per frame
+    void SetInstances(const std::vector<glm::mat4> &transforms, const AABB &localBounds) {
+        instanceCount = transforms.size();
+        std::vector<InstanceBounds> bounds(instanceCount);
+        for (unsigned int i = 0; i < instanceCount; i++) {
+            AABB box = transformAABB(localBounds, transforms[i]);
+            bounds[i] = InstanceBounds{glm::vec4(box.min, 1.0f), glm::vec4(box.max, 1.0f)};
+        }
+        std::vector<NormalMatrix> normals(instanceCount);
+        computeNormalMatrices(transforms.data(), normals.data(), instanceCount);
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, transformBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, transforms.size() * sizeof(glm::mat4), transforms.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, boundsBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, bounds.size() * sizeof(InstanceBounds), bounds.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, visibleBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, transforms.size() * sizeof(glm::mat4), nullptr, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, normalBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, normals.size() * sizeof(NormalMatrix), normals.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, visibleNormalBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, normals.size() * sizeof(NormalMatrix), nullptr, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    // hizViewProjection is the matrix the pyramid's depth was rendered with (last frame's)
+    void Cull(const ComputeShader &cullShader, const Frustum &frustum, const HiZBuffer &hiz,
+              const glm::mat4 &hizViewProjection) {
+        pollReadbacks();
+        if (instanceCount == 0)
+            return;
+
+        // instance counts back to zero for the atomics
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data());
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+        cullShader.use();
+        cullShader.setUint("instanceCount", instanceCount);
+        cullShader.setUint("commandCount", commands.size());
+        cullShader.setVec4Array("planes", frustum.planes, 6);
+        cullShader.setInt("hizEnabled", hiz.Built());
+        cullShader.setMat4("hizViewProjection", hizViewProjection);
+        cullShader.setVec2("hizSize", hiz.Size());
+        cullShader.setInt("hizLevels", hiz.Levels());
+        cullShader.setInt("hiz", 0);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, hiz.Texture());
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, transformBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, boundsBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, visibleBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, commandBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, normalBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, visibleNormalBuffer);
+        cullShader.Dispatch(instanceCount, GROUP_SIZE);
+        glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        // the survivor count of this frame, picked up by a later pollReadbacks
+        Readback &readback = readbacks[frame % READBACK_FRAMES];
+        if (readback.fence != nullptr)
+            glDeleteSync(readback.fence);
+        glBindBuffer(GL_COPY_READ_BUFFER, commandBuffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, readback.buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                            offsetof(DrawElementsIndirectCommand, instanceCount), 0, sizeof(GLuint));
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        readback.frame = frame++;
+    }
+
+    // One indirect draw per mesh, instance transforms read from the survivor buffer. Program
+    // is a Shader or a ShaderVariants.
+    template <typename Program>
+    void Draw(Program &program) {
+        if (instanceCount == 0)
+            return;
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        const Material *previous = nullptr;
+        const Shader *current = nullptr;
+        for (unsigned int i = 0; i < model->meshes.size(); i++) {
+            const Mesh &mesh = model->meshes[i];
+            Shader &shader = shaderFor(program, mesh.material);
+            if (&shader != current) {
+                shader.use();
+                current = &shader;
+            }
+            if (mesh.material != nullptr) {
+                mesh.material->ApplyState(previous);
+                mesh.material->Bind(shader);
+                previous = mesh.material;
+            }
+            glBindVertexArray(mesh.VAO);
+            attachInstanceTransforms(visibleBuffer, visibleNormalBuffer);
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                        (void*)(i * sizeof(DrawElementsIndirectCommand)), 1, 0);
+            InstanceBuffer::Detach();
+            // triangles from the last count that made it back; the draw itself never waits for it
+            renderStats().AddDraw(mesh.indices.size(), visibleCount);
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        glDisable(GL_BLEND);
+        glEnable(GL_CULL_FACE);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    unsigned int InstanceCount() const { return instanceCount; }
+    // survivors of a frame a few frames back
+    unsigned int VisibleCount() const { return visibleCount; }
+
+    void Delete() {
+        glDeleteBuffers(1, &transformBuffer);
+        glDeleteBuffers(1, &boundsBuffer);
+        glDeleteBuffers(1, &visibleBuffer);
+        glDeleteBuffers(1, &normalBuffer);
+        glDeleteBuffers(1, &visibleNormalBuffer);
+        glDeleteBuffers(1, &commandBuffer);
+        for (Readback &readback : readbacks) {
+            glDeleteBuffers(1, &readback.buffer);
+            if (readback.fence != nullptr)
+                glDeleteSync(readback.fence);
+            readback.fence = nullptr;
+        }
+    }
+
+private:
+    static const unsigned int GROUP_SIZE = 64;
+    static const unsigned int READBACK_FRAMES = 3;
+
+    struct Readback {
+        GLuint buffer = 0;
+        GLsync fence = nullptr;
+        unsigned long long frame = 0;
+    };
+
+    const Model *model = nullptr;
+    // instanceCount zero in all of them; uploaded before every dispatch
+    std::vector<DrawElementsIndirectCommand> commands;
+    unsigned int instanceCount = 0;
+    unsigned int transformBuffer = 0, boundsBuffer = 0, visibleBuffer = 0, commandBuffer = 0;
+    unsigned int normalBuffer = 0, visibleNormalBuffer = 0;
+    Readback readbacks[READBACK_FRAMES];
+    unsigned long long frame = 0;
+    unsigned long long visibleFrame = 0;
+    unsigned int visibleCount = 0;
+
+    // takes whichever copies have landed without waiting on the ones that have not
+    void pollReadbacks() {
+        for (Readback &readback : readbacks) {
+            if (readback.fence == nullptr)
+                continue;
+            GLenum status = glClientWaitSync(readback.fence, 0, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+                continue;
+            glDeleteSync(readback.fence);
+            readback.fence = nullptr;
+            if (readback.frame < visibleFrame)
+                continue;
+            glBindBuffer(GL_COPY_WRITE_BUFFER, readback.buffer);
+            glGetBufferSubData(GL_COPY_WRITE_BUFFER, 0, sizeof(GLuint), &visibleCount);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            visibleFrame = readback.frame;
+        }
+    }
+};
+
+#endif //PROJECT_BASE_GPUINSTANCECULLER_H
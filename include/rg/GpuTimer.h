@@ -0,0 +1,72 @@
+//
+// GPU time of a stretch of commands, read back a few frames late so it never stalls.
+//
+
+#ifndef PROJECT_BASE_GPUTIMER_H
+#define PROJECT_BASE_GPUTIMER_H
+
+#include <glad/glad.h>
+
+// GL_TIME_ELAPSED queries in a small ring; End's result is picked up once the GPU has
+// written it, which is usually two or three frames later. Only one timer can run at a
+// time, time elapsed queries do not nest.
+class GpuTimer {
+public:
+    static const unsigned int QUERY_COUNT = 4;
+
+    void Create() {
+        glGenQueries(QUERY_COUNT, queries);
+    }
+
+    void Begin() {
+        // collect what has landed first, or a timer that fell behind would never catch up
+        poll();
+        // every query in flight: drop this measurement rather than wait for the oldest
+        skipped = pending == QUERY_COUNT;
+        if (!skipped)
+            glBeginQuery(GL_TIME_ELAPSED, queries[next]);
+    }
+
+    void End() {
+        if (skipped)
+            return;
+        glEndQuery(GL_TIME_ELAPSED);
+        next = (next + 1) % QUERY_COUNT;
+        pending++;
+        poll();
+    }
+
+    // the most recent result the GPU has delivered
+    float Milliseconds() const { return milliseconds; }
+    // ends that have produced a result so far; lets callers tell new results from old
+    unsigned int ResultCount() const { return resultCount; }
+
+    void Delete() {
+        glDeleteQueries(QUERY_COUNT, queries);
+    }
+
+private:
+    GLuint queries[QUERY_COUNT] = {0};
+    unsigned int next = 0;
+    unsigned int pending = 0;
+    unsigned int resultCount = 0;
+    bool skipped = false;
+    float milliseconds = 0.0f;
+
+    void poll() {
+        while (pending > 0) {
+            GLuint oldest = queries[(next + QUERY_COUNT - pending) % QUERY_COUNT];
+            GLint available = 0;
+            glGetQueryObjectiv(oldest, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                return;
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(oldest, GL_QUERY_RESULT, &nanoseconds);
+            milliseconds = nanoseconds / 1.0e6f;
+            resultCount++;
+            pending--;
+        }
+    }
+};
+
+#endif //PROJECT_BASE_GPUTIMER_H
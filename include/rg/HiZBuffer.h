@@ -0,0 +1,92 @@
+//
+// Max-depth mip pyramid of a depth texture, built with a compute shader.
+//
+
+#ifndef PROJECT_BASE_HIZBUFFER_H
+#define PROJECT_BASE_HIZBUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <rg/ComputeShader.h>
+#include <rg/GLExt.h>
+
+#include <algorithm>
+
+// Level 0 is a copy of the depth buffer, every level above holds the farthest depth of the
+// texels it covers, so a box whose nearest depth is behind a texel's value is behind
+// everything drawn there. Odd sizes fold the extra row/column into the last texel.
+class HiZBuffer {
+public:
+    void Create(int width, int height) {
+        this->width = width;
+        this->height = height;
+        levels = 1;
+        while ((std::max(width, height) >> levels) > 0)
+            levels++;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexStorage2D(GL_TEXTURE_2D, levels, GL_R32F, width, height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // for a scene drawn at a new render size; the pyramid counts as not built until the next Build
+    void Resize(int width, int height) {
+        if (width == this->width && height == this->height)
+            return;
+        Delete();
+        Create(width, height);
+    }
+
+    // reads the lower-left width x height of depthTexture; reduceShader is hiz_reduce.comp
+    void Build(const ComputeShader &reduceShader, unsigned int depthTexture) {
+        reduceShader.use();
+        reduceShader.setInt("source", 0);
+        glActiveTexture(GL_TEXTURE0);
+        for (int level = 0; level < levels; level++) {
+            int sourceWidth = level == 0 ? width : levelSize(width, level - 1);
+            int sourceHeight = level == 0 ? height : levelSize(height, level - 1);
+            int targetWidth = levelSize(width, level), targetHeight = levelSize(height, level);
+
+            glBindTexture(GL_TEXTURE_2D, level == 0 ? depthTexture : texture);
+            reduceShader.setInt("sourceLevel", level == 0 ? 0 : level - 1);
+            reduceShader.setInt("copyLevel", level == 0);
+            glUniform2i(glGetUniformLocation(reduceShader.ID, "sourceSize"), sourceWidth, sourceHeight);
+            glUniform2i(glGetUniformLocation(reduceShader.ID, "targetSize"), targetWidth, targetHeight);
+            glBindImageTexture(0, texture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+            reduceShader.Dispatch(targetWidth, 8, targetHeight, 8);
+            // the next level reads what this one wrote
+            glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        built = true;
+    }
+
+    void Delete() {
+        glDeleteTextures(1, &texture);
+        texture = 0;
+        built = false;
+    }
+
+    unsigned int Texture() const { return texture; }
+    glm::vec2 Size() const { return glm::vec2(width, height); }
+    int Levels() const { return levels; }
+    // false until the first Build, when there is nothing to test against yet
+    bool Built() const { return built; }
+
+private:
+    unsigned int texture = 0;
+    int width = 0, height = 0;
+    int levels = 0;
+    bool built = false;
+
+    static int levelSize(int size, int level) {
+        return std::max(1, size >> level);
+    }
+};
+
+#endif //PROJECT_BASE_HIZBUFFER_H
@@ -0,0 +1,273 @@
+//
+// Octahedral impostors: a model pre-rendered from many directions, drawn as a billboard.
+//
+
+#ifndef PROJECT_BASE_IMPOSTOR_H
+#define PROJECT_BASE_IMPOSTOR_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <learnopengl/model.h>
+#include <learnopengl/shader.h>
+#include <rg/InstanceBuffer.h>
+#include <rg/RenderStats.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <vector>
+
+// impostor.vs reads the per-instance opacity here, after the draw id at 9 and layer at 10
+const unsigned int IMPOSTOR_OPACITY_LOCATION = 11;
+
+// Octahedral map of the sphere of directions to [-1, 1]^2, y up. The atlas frame for grid
+// cell (i, j) looks at the model from octahedralDirection of the cell center; impostor.vs
+// inverts this to find the frames nearest the camera.
+glm::vec3 octahedralDirection(const glm::vec2 &p) {
+    glm::vec3 n(p.x, 1.0f - std::fabs(p.x) - std::fabs(p.y), p.y);
+    if (n.y < 0.0f) {
+        float x = n.x;
+        n.x = (1.0f - std::fabs(n.z)) * (x >= 0.0f ? 1.0f : -1.0f);
+        n.z = (1.0f - std::fabs(x)) * (n.z >= 0.0f ? 1.0f : -1.0f);
+    }
+    return glm::normalize(n);
+}
+
+// Opacity of the impostor at this distance from the camera: 0 before start, rising to 1
+// over range. The mesh is drawn while it is below 1, the impostor while it is above 0;
+// in between the impostor dithers over the mesh.
+float impostorOpacity(float distance, float start, float range) {
+    if (range <= 0.0f)
+        return distance >= start ? 1.0f : 0.0f;
+    return glm::clamp((distance - start) / range, 0.0f, 1.0f);
+}
+
+// Albedo (alpha is coverage) and object-space normal + depth of one model, gridSize x gridSize
+// orthographic views of frameSize pixels each, baked once at load.
+class ImpostorAtlas {
+public:
+    // bakeShader is impostor_bake.vs/fs; leaves framebuffer 0 bound and the viewport unset
+    void Bake(const Model &model, Shader &bakeShader, unsigned int gridSize = 8, unsigned int frameSize = 128) {
+        this->gridSize = gridSize;
+        center = model.sphere.center;
+        radius = model.sphere.radius;
+        if (model.sphere.Empty())
+            return;
+        unsigned int size = gridSize * frameSize;
+
+        albedo = createTexture(GL_SRGB8_ALPHA8, size);
+        // depth needs more than 8 bits across the sphere
+        normalDepth = createTexture(GL_RGBA16F, size);
+        unsigned int fbo, depth;
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedo, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normalDepth, 0);
+        glGenRenderbuffers(1, &depth);
+        glBindRenderbuffer(GL_RENDERBUFFER, depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size, size);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+        const GLenum attachments[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+        glDrawBuffers(2, attachments);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "Impostor framebuffer not complete!" << std::endl;
+
+        glViewport(0, 0, size, size);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        // albedo is stored sRGB like the source textures
+        glEnable(GL_FRAMEBUFFER_SRGB);
+        glDisable(GL_CULL_FACE);
+        glDisable(GL_BLEND);
+
+        bakeShader.use();
+        // eye on the bounding sphere's far side of a 2r margin; depth 0..1 spans the sphere
+        glm::mat4 projection = glm::ortho(-radius, radius, -radius, radius, radius, 3.0f * radius);
+        bakeShader.setMat4("projection", projection);
+        for (unsigned int j = 0; j < gridSize; j++) {
+            for (unsigned int i = 0; i < gridSize; i++) {
+                glm::vec2 cell((i + 0.5f) / gridSize * 2.0f - 1.0f, (j + 0.5f) / gridSize * 2.0f - 1.0f);
+                glm::vec3 direction = octahedralDirection(cell);
+                // the same up impostor.vs picks for the billboard
+                glm::vec3 up = std::fabs(direction.y) > 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+                bakeShader.setMat4("view", glm::lookAt(center + direction * 2.0f * radius, center, up));
+                glViewport(i * frameSize, j * frameSize, frameSize, frameSize);
+                for (const Mesh &mesh : model.meshes) {
+                    if (mesh.material != nullptr)
+                        mesh.material->Bind(bakeShader);
+                    glBindVertexArray(mesh.VAO);
+                    glDrawElements(GL_TRIANGLES, mesh.indices.size(), GL_UNSIGNED_INT, 0);
+                }
+            }
+        }
+        glBindVertexArray(0);
+        glDisable(GL_FRAMEBUFFER_SRGB);
+        glEnable(GL_CULL_FACE);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteRenderbuffers(1, &depth);
+
+        // a few levels only: frames are powers of two, so those stay inside their cell
+        for (unsigned int texture : {albedo, normalDepth}) {
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 3);
+            glGenerateMipmap(GL_TEXTURE_2D);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // sets the per-atlas uniforms and binds the two textures to units 0 and 1
+    void Bind(Shader &shader) const {
+        shader.setVec3("sphereCenter", center);
+        shader.setFloat("sphereRadius", radius);
+        shader.setFloat("gridSize", (float) gridSize);
+        shader.setInt("impostorAlbedo", 0);
+        shader.setInt("impostorNormalDepth", 1);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, albedo);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, normalDepth);
+    }
+
+    bool Baked() const { return albedo != 0; }
+
+    void Delete() {
+        glDeleteTextures(1, &albedo);
+        glDeleteTextures(1, &normalDepth);
+        albedo = normalDepth = 0;
+    }
+
+private:
+    unsigned int albedo = 0, normalDepth = 0;
+    unsigned int gridSize = 0;
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 0.0f;
+
+    static unsigned int createTexture(GLenum internalFormat, unsigned int size) {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, size, size, 0, GL_RGBA, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        return texture;
+    }
+};
+
+// Collects the impostors of a frame and draws them, one instanced quad draw per atlas.
+class ImpostorRenderer {
+public:
+    void Begin() {
+        instances.clear();
+    }
+
+    void Add(const ImpostorAtlas &atlas, const glm::mat4 &transform, float opacity) {
+        if (atlas.Baked())
+            instances.push_back(Instance{&atlas, transform, opacity});
+    }
+
+    // shader is impostor.vs/fs with its frame uniforms (lights, view, projection) set
+    void Draw(Shader &shader) {
+        renderStats().impostors += instances.size();
+        if (instances.empty())
+            return;
+        if (VAO == 0)
+            create();
+
+        std::stable_sort(instances.begin(), instances.end(), [](const Instance &a, const Instance &b) {
+            return a.atlas < b.atlas;
+        });
+        gpuInstances.resize(instances.size());
+        for (unsigned int i = 0; i < instances.size(); i++)
+            gpuInstances[i] = GpuInstance{instances[i].transform, glm::vec4(instances[i].opacity, 0.0f, 0.0f, 0.0f)};
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        if (gpuInstances.size() > capacity) {
+            capacity = gpuInstances.size();
+            glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(GpuInstance), gpuInstances.data(), GL_DYNAMIC_DRAW);
+        } else {
+            glBufferSubData(GL_ARRAY_BUFFER, 0, gpuInstances.size() * sizeof(GpuInstance), gpuInstances.data());
+        }
+
+        shader.use();
+        glBindVertexArray(VAO);
+        // billboards face the camera, but the octahedral frames are not symmetric
+        glDisable(GL_CULL_FACE);
+        for (unsigned int first = 0; first < instances.size();) {
+            unsigned int last = first;
+            while (last < instances.size() && instances[last].atlas == instances[first].atlas)
+                last++;
+            instances[first].atlas->Bind(shader);
+            // no base instance before 4.2, so the attributes are pointed at the group instead
+            pointAttributes(first);
+            glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, last - first);
+            renderStats().AddDraw(6, last - first);
+            first = last;
+        }
+        glBindVertexArray(0);
+        glEnable(GL_CULL_FACE);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    void Delete() {
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &quadBuffer);
+        glDeleteBuffers(1, &instanceBuffer);
+        VAO = quadBuffer = instanceBuffer = 0;
+        capacity = 0;
+    }
+
+private:
+    struct Instance {
+        const ImpostorAtlas *atlas;
+        glm::mat4 transform;
+        float opacity;
+    };
+
+    struct GpuInstance {
+        glm::mat4 transform;
+        // x is the opacity
+        glm::vec4 params;
+    };
+
+    std::vector<Instance> instances;
+    std::vector<GpuInstance> gpuInstances;
+    unsigned int VAO = 0, quadBuffer = 0, instanceBuffer = 0;
+    unsigned int capacity = 0;
+
+    void create() {
+        const float corners[8] = {-1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f};
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &quadBuffer);
+        glGenBuffers(1, &instanceBuffer);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, quadBuffer);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+        for (unsigned int i = 0; i < 4; i++) {
+            glEnableVertexAttribArray(INSTANCE_TRANSFORM_LOCATION + i);
+            glVertexAttribDivisor(INSTANCE_TRANSFORM_LOCATION + i, 1);
+        }
+        glEnableVertexAttribArray(IMPOSTOR_OPACITY_LOCATION);
+        glVertexAttribDivisor(IMPOSTOR_OPACITY_LOCATION, 1);
+        glBindVertexArray(0);
+    }
+
+    // expects the VAO bound
+    void pointAttributes(unsigned int firstInstance) {
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        size_t base = firstInstance * sizeof(GpuInstance);
+        for (unsigned int i = 0; i < 4; i++)
+            glVertexAttribPointer(INSTANCE_TRANSFORM_LOCATION + i, 4, GL_FLOAT, GL_FALSE, sizeof(GpuInstance),
+                                  (void*)(base + i * sizeof(glm::vec4)));
+        glVertexAttribPointer(IMPOSTOR_OPACITY_LOCATION, 1, GL_FLOAT, GL_FALSE, sizeof(GpuInstance),
+                              (void*)(base + offsetof(GpuInstance, params)));
+    }
+};
+
+#endif //PROJECT_BASE_IMPOSTOR_H
@@ -0,0 +1,183 @@
+//
+// Per-instance model and normal matrices for instanced drawing.
+//
+
+#ifndef PROJECT_BASE_INSTANCEBUFFER_H
+#define PROJECT_BASE_INSTANCEBUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#include <immintrin.h>
+#define RG_NORMAL_MATRIX_SSE 1
+#endif
+
+// room.vs reads its model matrix from four vec4 attributes starting here
+const unsigned int INSTANCE_TRANSFORM_LOCATION = 5;
+// and the matching normal matrix from three vec3 attributes starting here
+const unsigned int INSTANCE_NORMAL_LOCATION = 13;
+
+// transpose(inverse(mat3(model))), as the vertex shaders used to compute per vertex. Columns
+// are padded to vec4 so the same layout serves as vertex attributes and as a std430 mat3.
+struct NormalMatrix {
+    glm::vec4 columns[3];
+};
+
+// Through the cofactor matrix, like StaticBatcher bakes its normals: a singular model (the
+// flattened floor and glass) keeps its cofactors instead of dividing by a zero determinant.
+NormalMatrix normalMatrix(const glm::mat4 &model) {
+    glm::vec3 a0(model[0]), a1(model[1]), a2(model[2]);
+    glm::vec3 cofactors[3] = {glm::cross(a1, a2), glm::cross(a2, a0), glm::cross(a0, a1)};
+    float determinant = glm::dot(a0, cofactors[0]);
+    float scale = determinant != 0.0f ? 1.0f / determinant : 1.0f;
+    NormalMatrix normals;
+    for (unsigned int c = 0; c < 3; c++)
+        normals.columns[c] = glm::vec4(cofactors[c] * scale, 0.0f);
+    return normals;
+}
+
+// normalMatrix for count models at once; four per step with SSE, same operations per lane
+void computeNormalMatrices(const glm::mat4 *models, NormalMatrix *normals, std::size_t count) {
+    std::size_t i = 0;
+#ifdef RG_NORMAL_MATRIX_SSE
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    for (; i + 4 <= count; i += 4) {
+        // a[c][r]: element (c, r) of the four upper 3x3s, one model per lane
+        __m128 a[3][3];
+        for (unsigned int c = 0; c < 3; c++)
+            for (unsigned int r = 0; r < 3; r++)
+                a[c][r] = _mm_setr_ps(models[i][c][r], models[i + 1][c][r], models[i + 2][c][r], models[i + 3][c][r]);
+        __m128 cofactors[3][3];
+        for (unsigned int c = 0; c < 3; c++) {
+            const __m128 *x = a[(c + 1) % 3], *y = a[(c + 2) % 3];
+            cofactors[c][0] = _mm_sub_ps(_mm_mul_ps(x[1], y[2]), _mm_mul_ps(y[1], x[2]));
+            cofactors[c][1] = _mm_sub_ps(_mm_mul_ps(x[2], y[0]), _mm_mul_ps(y[2], x[0]));
+            cofactors[c][2] = _mm_sub_ps(_mm_mul_ps(x[0], y[1]), _mm_mul_ps(y[0], x[1]));
+        }
+        __m128 determinant = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0][0], cofactors[0][0]),
+                                                   _mm_mul_ps(a[0][1], cofactors[0][1])),
+                                        _mm_mul_ps(a[0][2], cofactors[0][2]));
+        __m128 invertible = _mm_cmpneq_ps(determinant, zero);
+        __m128 scale = _mm_or_ps(_mm_and_ps(invertible, _mm_div_ps(one, determinant)), _mm_andnot_ps(invertible, one));
+        for (unsigned int c = 0; c < 3; c++)
+            for (unsigned int r = 0; r < 3; r++) {
+                float lanes[4];
+                _mm_storeu_ps(lanes, _mm_mul_ps(cofactors[c][r], scale));
+                for (unsigned int k = 0; k < 4; k++)
+                    normals[i + k].columns[c][r] = lanes[k];
+            }
+        for (unsigned int k = 0; k < 4; k++)
+            for (unsigned int c = 0; c < 3; c++)
+                normals[i + k].columns[c][3] = 0.0f;
+    }
+#endif
+    for (; i < count; i++)
+        normals[i] = normalMatrix(models[i]);
+}
+
+// Non-instanced draws leave the instance attribute arrays disabled, so the vertex shader
+// sees the current generic attribute values instead. This sets them; they are context
+// state and stay in effect across VAO and program changes.
+void setInstanceTransform(const glm::mat4 &model, const NormalMatrix &normals) {
+    for (unsigned int i = 0; i < 4; i++)
+        glVertexAttrib4fv(INSTANCE_TRANSFORM_LOCATION + i, &model[i][0]);
+    for (unsigned int i = 0; i < 3; i++)
+        glVertexAttrib4fv(INSTANCE_NORMAL_LOCATION + i, &normals.columns[i][0]);
+}
+
+void setInstanceTransform(const glm::mat4 &model) {
+    setInstanceTransform(model, normalMatrix(model));
+}
+
+// Points the instance attributes of the currently bound VAO at a buffer of tightly packed
+// mat4s and one of NormalMatrix, one each per instance. Also used for buffers the GPU fills itself.
+void attachInstanceTransforms(GLuint buffer, GLuint normalBuffer) {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    for (unsigned int i = 0; i < 4; i++) {
+        unsigned int location = INSTANCE_TRANSFORM_LOCATION + i;
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(i * sizeof(glm::vec4)));
+        glVertexAttribDivisor(location, 1);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
+    for (unsigned int i = 0; i < 3; i++) {
+        unsigned int location = INSTANCE_NORMAL_LOCATION + i;
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, sizeof(NormalMatrix), (void*)(i * sizeof(glm::vec4)));
+        glVertexAttribDivisor(location, 1);
+    }
+}
+
+class InstanceBuffer {
+public:
+    void SetTransforms(const std::vector<glm::mat4> &transforms) {
+        this->transforms = transforms;
+        dirty = true;
+    }
+
+    void SetTransform(unsigned int instance, const glm::mat4 &transform) {
+        transforms[instance] = transform;
+        dirty = true;
+    }
+
+    const std::vector<glm::mat4> &Transforms() const { return transforms; }
+    unsigned int Count() const { return transforms.size(); }
+
+    // Binds the buffers as instance attributes of the currently bound VAO. Data, normal
+    // matrices included, is only recomputed and re-uploaded when the transforms changed
+    // since the last draw.
+    void Attach() {
+        if (buffer == 0) {
+            glGenBuffers(1, &buffer);
+            glGenBuffers(1, &normalBuffer);
+        }
+        if (dirty) {
+            normals.resize(transforms.size());
+            computeNormalMatrices(transforms.data(), normals.data(), transforms.size());
+            glBindBuffer(GL_ARRAY_BUFFER, buffer);
+            if (transforms.size() > capacity) {
+                capacity = transforms.size();
+                glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(glm::mat4), transforms.data(), GL_DYNAMIC_DRAW);
+                glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
+                glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(NormalMatrix), normals.data(), GL_DYNAMIC_DRAW);
+            } else {
+                glBufferSubData(GL_ARRAY_BUFFER, 0, transforms.size() * sizeof(glm::mat4), transforms.data());
+                glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
+                glBufferSubData(GL_ARRAY_BUFFER, 0, normals.size() * sizeof(NormalMatrix), normals.data());
+            }
+            dirty = false;
+        }
+        attachInstanceTransforms(buffer, normalBuffer);
+    }
+
+    // disables the instance arrays again so plain draws of the same VAO use setInstanceTransform
+    static void Detach() {
+        for (unsigned int i = 0; i < 4; i++)
+            glDisableVertexAttribArray(INSTANCE_TRANSFORM_LOCATION + i);
+        for (unsigned int i = 0; i < 3; i++)
+            glDisableVertexAttribArray(INSTANCE_NORMAL_LOCATION + i);
+    }
+
+    void Delete() {
+        glDeleteBuffers(1, &buffer);
+        glDeleteBuffers(1, &normalBuffer);
+        buffer = 0;
+        normalBuffer = 0;
+        capacity = 0;
+        dirty = true;
+    }
+
+private:
+    std::vector<glm::mat4> transforms;
+    std::vector<NormalMatrix> normals;
+    unsigned int buffer = 0, normalBuffer = 0;
+    unsigned int capacity = 0;
+    bool dirty = true;
+};
+
+#endif //PROJECT_BASE_INSTANCEBUFFER_H
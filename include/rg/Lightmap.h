@@ -0,0 +1,633 @@
+//
+// CPU path-traced lightmaps for the static room surfaces, baked once and cached on disk.
+//
+
+#ifndef PROJECT_BASE_LIGHTMAP_H
+#define PROJECT_BASE_LIGHTMAP_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/mesh.h>
+#include <rg/BVH.h>
+#include <rg/Bounds.h>
+#include <rg/ClusteredLights.h>
+#include <rg/WorkerPool.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// room_lightmap.vs reads the second UV channel here, after the texture layer
+const unsigned int LIGHTMAP_COORDS_LOCATION = 12;
+// after the shadow maps
+const unsigned int LIGHTMAP_UNIT = 17;
+// one layer per light; room_lightmap.fs weighs at most this many
+const unsigned int LIGHTMAP_MAX_LAYERS = 4;
+// empty texels around every chart, filled by dilation so bilinear taps never reach a neighbour
+const unsigned int LIGHTMAP_PADDING = 2;
+// ray origins are pushed off the surface by this much, in world units
+const float LIGHTMAP_RAY_OFFSET = 1e-3f;
+
+struct LightmapSettings {
+    // width and height of the atlas in texels
+    unsigned int size = 512;
+    // hemisphere paths per texel, and how many surfaces each may bounce off
+    unsigned int samples = 32;
+    unsigned int bounces = 2;
+};
+
+// Receivers get a second UV channel, one chart per connected planar patch shelf-packed into
+// one atlas, and a texel per chart texel whose center lies on the surface. Every texel traces
+// its own paths with a generator seeded from its index, so the result does not depend on the
+// thread count or the chunking and the work splits across the pool without any locking.
+//
+// Each light is baked into its own layer so lights can still be switched at runtime. Direct
+// light uses the flipped normal room.fs shades with, so both variants agree, plus shadow
+// rays; bounces leave and arrive on the side the vertex normal points to, the room's inside,
+// and carry what the forward shader would show at the hit minus ambient. The result is
+// irradiance: room_lightmap.fs multiplies it by the surface texture.
+class LightmapBaker {
+public:
+    explicit LightmapBaker(const LightmapSettings &settings = LightmapSettings()) : settings(settings) {}
+
+    // A surface that gets lightmap texels: mesh at transform, bouncing light with albedo.
+    // The mesh has to outlive Bake. Returns the index for Coords.
+    unsigned int AddReceiver(const Mesh &mesh, const glm::mat4 &transform, const glm::vec3 &albedo) {
+        Receiver receiver;
+        receiver.mesh = &mesh;
+        receiver.firstTriangle = triangles.size();
+        appendTriangles(mesh, transform, albedo);
+        receiver.triangleCount = triangles.size() - receiver.firstTriangle;
+        receivers.push_back(receiver);
+        return receivers.size() - 1;
+    }
+
+    // casts shadows and bounces light, but gets no texels
+    void AddOccluder(const Mesh &mesh, const glm::mat4 &transform, const glm::vec3 &albedo) {
+        appendTriangles(mesh, transform, albedo);
+    }
+
+    // the light's layer index; a directional light has no position, attenuation or cone
+    unsigned int AddDirectionalLight(const glm::vec3 &direction, const glm::vec3 &ambient, const glm::vec3 &diffuse) {
+        BakeLight light;
+        light.directional = true;
+        light.light.direction = glm::normalize(direction);
+        light.light.ambient = ambient;
+        light.light.diffuse = diffuse;
+        lights.push_back(light);
+        return lights.size() - 1;
+    }
+
+    unsigned int AddLight(const Light &light) {
+        BakeLight bakeLight;
+        bakeLight.light = light;
+        bakeLight.light.direction = glm::normalize(light.direction);
+        bakeLight.range = lightRange(light);
+        lights.push_back(bakeLight);
+        return lights.size() - 1;
+    }
+
+    // Unwraps the receivers, then loads the texels from cachePath when it was written for the
+    // same geometry, lights and settings, or bakes them and writes it. Returns true if it baked.
+    bool Bake(WorkerPool &pool, const std::string &cachePath) {
+        unwrap();
+        uint64_t key = cacheKey();
+        if (load(cachePath, key))
+            return false;
+
+        auto start = std::chrono::high_resolution_clock::now();
+        buildBVH();
+        std::vector<TexelSample> samples = texelSamples();
+        unsigned int layerTexels = settings.size * settings.size;
+        texels.assign(lights.size() * layerTexels, glm::vec3(0.0f));
+        std::vector<char> covered(layerTexels, 0);
+
+        const unsigned int chunk = 64;
+        pool.ParallelFor((samples.size() + chunk - 1) / chunk, [&](unsigned int job) {
+            std::vector<glm::vec3> values(lights.size());
+            unsigned int end = std::min<unsigned int>(samples.size(), (job + 1) * chunk);
+            for (unsigned int i = job * chunk; i < end; i++) {
+                std::mt19937 rng(samples[i].texel * 9781u + 1u);
+                bakeTexel(samples[i], rng, values);
+                for (unsigned int layer = 0; layer < lights.size(); layer++)
+                    texels[layer * layerTexels + samples[i].texel] = values[layer];
+                covered[samples[i].texel] = 1;
+            }
+        });
+        dilate(covered);
+
+        bakeMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        std::cout << "Lightmap: " << samples.size() << " texels, " << lights.size() << " lights baked in "
+                  << bakeMs << " ms on " << pool.ThreadCount() << " threads" << std::endl;
+        save(cachePath, key);
+        return true;
+    }
+
+    // Whether layer was baked with light as it is now, in everything the bake depends on. The
+    // specular term never is; past that, a light edited at runtime has to be shaded live.
+    bool Matches(unsigned int layer, const Light &light) const {
+        BakeLight current;
+        current.light = light;
+        current.light.direction = glm::normalize(light.direction);
+        return sameLight(lights[layer], current);
+    }
+
+    bool MatchesDirectional(unsigned int layer, const glm::vec3 &direction, const glm::vec3 &ambient,
+                            const glm::vec3 &diffuse) const {
+        const BakeLight &baked = lights[layer];
+        return baked.directional && baked.light.direction == glm::normalize(direction)
+               && baked.light.ambient == ambient && baked.light.diffuse == diffuse;
+    }
+
+    // lightmap coordinates of the receiver's vertices, in mesh vertex order
+    const std::vector<glm::vec2> &Coords(unsigned int receiver) const { return receivers[receiver].coords; }
+
+    unsigned int LayerCount() const { return lights.size(); }
+    float BakeMs() const { return bakeMs; }
+
+    // one RGB16F layer per light; frees the CPU copy
+    void Upload() {
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGB16F, settings.size, settings.size, lights.size(), 0,
+                     GL_RGB, GL_FLOAT, texels.data());
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        // no mipmaps: the padding would not survive more than a level or two
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        std::vector<glm::vec3>().swap(texels);
+    }
+
+    void Bind(unsigned int unit) const {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    void Delete() {
+        glDeleteTextures(1, &texture);
+    }
+
+private:
+    struct Triangle {
+        glm::vec3 a, b, c;
+        // transformed vertex normal: the side the surface is seen and bounces from
+        glm::vec3 normal;
+        glm::vec3 albedo;
+    };
+
+    struct Receiver {
+        const Mesh *mesh;
+        unsigned int firstTriangle, triangleCount;
+        std::vector<glm::vec2> coords;
+    };
+
+    // a planar patch of one receiver, laid out in the plane spanned by u and v
+    struct Chart {
+        std::vector<unsigned int> triangles;
+        glm::vec3 normal, u, v;
+        float offset;
+        glm::vec2 min, max;
+        unsigned int x, y, width, height;
+    };
+
+    struct BakeLight {
+        bool directional = false;
+        Light light = Light();
+        float range = 0.0f;
+    };
+
+    // the fields cacheKey hashes for a light
+    static bool sameLight(const BakeLight &a, const BakeLight &b) {
+        return a.directional == b.directional && a.light.position == b.light.position
+               && a.light.direction == b.light.direction && a.light.cutOff == b.light.cutOff
+               && a.light.outerCutOff == b.light.outerCutOff && a.light.constant == b.light.constant
+               && a.light.linear == b.light.linear && a.light.quadratic == b.light.quadratic
+               && a.light.ambient == b.light.ambient && a.light.diffuse == b.light.diffuse;
+    }
+
+    struct TexelSample {
+        unsigned int texel;
+        glm::vec3 position;
+        glm::vec3 normal;
+    };
+
+    LightmapSettings settings;
+    std::vector<Triangle> triangles;
+    std::vector<Receiver> receivers;
+    std::vector<BakeLight> lights;
+    std::vector<Chart> charts;
+    // chart of every receiver triangle, -1 for occluders and degenerate triangles
+    std::vector<int> triangleCharts;
+    float density = 1.0f;
+    BVH bvh;
+    // layer after layer, size * size each
+    std::vector<glm::vec3> texels;
+    GLuint texture = 0;
+    float bakeMs = 0.0f;
+
+    void appendTriangles(const Mesh &mesh, const glm::mat4 &transform, const glm::vec3 &albedo) {
+        glm::mat3 linear = glm::mat3(transform);
+        // cofactor matrix, as StaticBatcher uses, so the flattened floor keeps its normal
+        glm::mat3 normalMatrix(glm::cross(linear[1], linear[2]),
+                               glm::cross(linear[2], linear[0]),
+                               glm::cross(linear[0], linear[1]));
+        for (unsigned int i = 0; i + 2 < mesh.indices.size(); i += 3) {
+            const Vertex &a = mesh.vertices[mesh.indices[i]];
+            const Vertex &b = mesh.vertices[mesh.indices[i + 1]];
+            const Vertex &c = mesh.vertices[mesh.indices[i + 2]];
+            Triangle triangle;
+            triangle.a = glm::vec3(transform * glm::vec4(a.Position, 1.0f));
+            triangle.b = glm::vec3(transform * glm::vec4(b.Position, 1.0f));
+            triangle.c = glm::vec3(transform * glm::vec4(c.Position, 1.0f));
+            glm::vec3 normal = normalMatrix * (a.Normal + b.Normal + c.Normal);
+            float length = glm::length(normal);
+            triangle.normal = length > 0.0f ? normal / length : glm::vec3(0.0f, 1.0f, 0.0f);
+            triangle.albedo = albedo;
+            triangles.push_back(triangle);
+        }
+    }
+
+    // Charts are grown over shared edges between triangles facing the same way, then sized at
+    // one texel density for the whole atlas, lowered until the shelf packing fits.
+    void unwrap() {
+        charts.clear();
+        triangleCharts.assign(triangles.size(), -1);
+        for (const Receiver &receiver : receivers)
+            buildCharts(receiver);
+        std::vector<unsigned int> order(charts.size());
+        for (unsigned int i = 0; i < order.size(); i++)
+            order[i] = i;
+
+        float area = 0.0f;
+        for (const Chart &chart : charts)
+            area += (chart.max.x - chart.min.x) * (chart.max.y - chart.min.y);
+        density = area > 0.0f ? std::sqrt(0.8f * settings.size * settings.size / area) : 1.0f;
+        for (;;) {
+            for (Chart &chart : charts) {
+                chart.width = (unsigned int) std::ceil((chart.max.x - chart.min.x) * density) + 2 * LIGHTMAP_PADDING;
+                chart.height = (unsigned int) std::ceil((chart.max.y - chart.min.y) * density) + 2 * LIGHTMAP_PADDING;
+            }
+            std::sort(order.begin(), order.end(), [this](unsigned int a, unsigned int b) {
+                return charts[a].height > charts[b].height;
+            });
+            if (pack(order))
+                break;
+            density *= 0.95f;
+        }
+
+        for (Receiver &receiver : receivers) {
+            receiver.coords.assign(receiver.mesh->vertices.size(), glm::vec2(0.0f));
+            for (unsigned int i = 0; i < receiver.triangleCount; i++) {
+                unsigned int t = receiver.firstTriangle + i;
+                if (triangleCharts[t] < 0)
+                    continue;
+                const Chart &chart = charts[triangleCharts[t]];
+                const glm::vec3 corners[3] = {triangles[t].a, triangles[t].b, triangles[t].c};
+                // a vertex shared by two charts keeps the last one; the room primitives share none
+                for (unsigned int corner = 0; corner < 3; corner++)
+                    receiver.coords[receiver.mesh->indices[i * 3 + corner]] = atlasCoords(chart, corners[corner]);
+            }
+        }
+    }
+
+    void buildCharts(const Receiver &receiver) {
+        unsigned int first = receiver.firstTriangle, count = receiver.triangleCount;
+        std::vector<unsigned int> parent(count);
+        std::vector<glm::vec3> faceNormals(count);
+        for (unsigned int i = 0; i < count; i++) {
+            parent[i] = i;
+            const Triangle &triangle = triangles[first + i];
+            glm::vec3 normal = glm::cross(triangle.b - triangle.a, triangle.c - triangle.a);
+            float length = glm::length(normal);
+            faceNormals[i] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+            if (glm::dot(faceNormals[i], triangle.normal) < 0.0f)
+                faceNormals[i] = -faceNormals[i];
+        }
+        auto find = [&parent](unsigned int i) {
+            while (parent[i] != i)
+                i = parent[i] = parent[parent[i]];
+            return i;
+        };
+        // quadratic, but receivers are a handful of quads each
+        for (unsigned int i = 0; i < count; i++)
+            for (unsigned int j = i + 1; j < count; j++)
+                if (glm::dot(faceNormals[i], faceNormals[j]) > 0.999f
+                    && sharedCorners(triangles[first + i], triangles[first + j]) >= 2)
+                    parent[find(i)] = find(j);
+
+        std::vector<int> chartOf(count, -1);
+        for (unsigned int i = 0; i < count; i++) {
+            // degenerate triangles get no texels and keep (0, 0)
+            if (faceNormals[i] == glm::vec3(0.0f))
+                continue;
+            unsigned int root = find(i);
+            if (chartOf[root] < 0) {
+                chartOf[root] = charts.size();
+                Chart chart;
+                chart.normal = faceNormals[i];
+                glm::vec3 helper = std::fabs(chart.normal.y) < 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+                chart.u = glm::normalize(glm::cross(helper, chart.normal));
+                chart.v = glm::cross(chart.normal, chart.u);
+                chart.offset = glm::dot(chart.normal, triangles[first + i].a);
+                chart.min = glm::vec2(FLT_MAX);
+                chart.max = glm::vec2(-FLT_MAX);
+                charts.push_back(chart);
+            }
+            Chart &chart = charts[chartOf[root]];
+            chart.triangles.push_back(first + i);
+            triangleCharts[first + i] = chartOf[root];
+            for (const glm::vec3 &corner : {triangles[first + i].a, triangles[first + i].b, triangles[first + i].c}) {
+                glm::vec2 p = project(chart, corner);
+                chart.min = glm::min(chart.min, p);
+                chart.max = glm::max(chart.max, p);
+            }
+        }
+    }
+
+    static unsigned int sharedCorners(const Triangle &a, const Triangle &b) {
+        unsigned int shared = 0;
+        for (const glm::vec3 &p : {a.a, a.b, a.c})
+            for (const glm::vec3 &q : {b.a, b.b, b.c})
+                if (glm::length(p - q) < 1e-4f)
+                    shared++;
+        return shared;
+    }
+
+    static glm::vec2 project(const Chart &chart, const glm::vec3 &position) {
+        return glm::vec2(glm::dot(chart.u, position), glm::dot(chart.v, position));
+    }
+
+    // texel space position of a point of the chart
+    glm::vec2 texelPosition(const Chart &chart, const glm::vec2 &p) const {
+        return (p - chart.min) * density + glm::vec2(chart.x + LIGHTMAP_PADDING, chart.y + LIGHTMAP_PADDING);
+    }
+
+    glm::vec2 atlasCoords(const Chart &chart, const glm::vec3 &position) const {
+        return texelPosition(chart, project(chart, position)) / (float) settings.size;
+    }
+
+    // shelves of charts in falling height order; false when the atlas is too small
+    bool pack(const std::vector<unsigned int> &order) {
+        unsigned int x = 0, y = 0, shelfHeight = 0;
+        for (unsigned int index : order) {
+            Chart &chart = charts[index];
+            if (chart.width > settings.size)
+                return false;
+            if (x + chart.width > settings.size) {
+                x = 0;
+                y += shelfHeight;
+                shelfHeight = 0;
+            }
+            if (y + chart.height > settings.size)
+                return false;
+            chart.x = x;
+            chart.y = y;
+            x += chart.width;
+            shelfHeight = std::max(shelfHeight, chart.height);
+        }
+        return true;
+    }
+
+    // every chart texel whose center is on one of the chart's triangles
+    std::vector<TexelSample> texelSamples() const {
+        std::vector<TexelSample> samples;
+        for (const Chart &chart : charts) {
+            for (unsigned int ty = chart.y; ty < chart.y + chart.height; ty++) {
+                for (unsigned int tx = chart.x; tx < chart.x + chart.width; tx++) {
+                    glm::vec2 p = (glm::vec2(tx + 0.5f, ty + 0.5f) - glm::vec2(chart.x + LIGHTMAP_PADDING, chart.y + LIGHTMAP_PADDING))
+                                  / density + chart.min;
+                    for (unsigned int t : chart.triangles) {
+                        const Triangle &triangle = triangles[t];
+                        if (!inside(p, project(chart, triangle.a), project(chart, triangle.b), project(chart, triangle.c)))
+                            continue;
+                        glm::vec3 position = chart.u * p.x + chart.v * p.y + chart.normal * chart.offset;
+                        samples.push_back(TexelSample{ty * settings.size + tx, position, triangle.normal});
+                        break;
+                    }
+                }
+            }
+        }
+        return samples;
+    }
+
+    static bool inside(const glm::vec2 &p, const glm::vec2 &a, const glm::vec2 &b, const glm::vec2 &c) {
+        auto edge = [](const glm::vec2 &from, const glm::vec2 &to, const glm::vec2 &point) {
+            return (to.x - from.x) * (point.y - from.y) - (to.y - from.y) * (point.x - from.x);
+        };
+        float w0 = edge(a, b, p), w1 = edge(b, c, p), w2 = edge(c, a, p);
+        return (w0 >= 0.0f && w1 >= 0.0f && w2 >= 0.0f) || (w0 <= 0.0f && w1 <= 0.0f && w2 <= 0.0f);
+    }
+
+    void buildBVH() {
+        std::vector<AABB> boxes(triangles.size());
+        for (unsigned int i = 0; i < triangles.size(); i++) {
+            boxes[i].Expand(triangles[i].a);
+            boxes[i].Expand(triangles[i].b);
+            boxes[i].Expand(triangles[i].c);
+        }
+        bvh.Build(boxes);
+    }
+
+    bool closestHit(const Ray &ray, unsigned int &triangle, float &distance) const {
+        const std::vector<Triangle> &triangles = this->triangles;
+        return bvh.Raycast(ray, [&triangles](unsigned int item, const Ray &r, float) {
+            return intersectRay(r, triangles[item].a, triangles[item].b, triangles[item].c);
+        }, triangle, distance);
+    }
+
+    bool occluded(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance) const {
+        unsigned int triangle;
+        float distance;
+        return closestHit(Ray{origin, direction}, triangle, distance) && distance < maxDistance;
+    }
+
+    // What clustered_lights.glsl computes for one light at a surface with vertex normal
+    // normal, without the albedo; shadowed, and with its ambient term only when asked.
+    glm::vec3 lightAt(const BakeLight &bakeLight, const glm::vec3 &position, const glm::vec3 &normal, bool ambient) const {
+        const Light &light = bakeLight.light;
+        // shaded with the flipped normal, like room.fs; the shadow ray leaves on that side too
+        glm::vec3 shadingNormal = -normal;
+        glm::vec3 origin = position + shadingNormal * LIGHTMAP_RAY_OFFSET;
+        glm::vec3 ambientTerm = ambient ? light.ambient : glm::vec3(0.0f);
+        if (bakeLight.directional) {
+            glm::vec3 lightDir = -light.direction;
+            float diff = std::max(glm::dot(shadingNormal, lightDir), 0.0f);
+            if (diff > 0.0f && occluded(origin, lightDir, FLT_MAX))
+                diff = 0.0f;
+            return ambientTerm + light.diffuse * diff;
+        }
+        glm::vec3 toLight = light.position - position;
+        float distance = glm::length(toLight);
+        if (distance >= bakeLight.range || distance == 0.0f)
+            return glm::vec3(0.0f);
+        glm::vec3 lightDir = toLight / distance;
+        float attenuation = 1.0f / (light.constant + light.linear * distance + light.quadratic * distance * distance);
+        float window = glm::clamp(1.0f - std::pow(distance / bakeLight.range, 4.0f), 0.0f, 1.0f);
+        attenuation *= window * window;
+        float theta = glm::dot(lightDir, -light.direction);
+        float intensity = glm::clamp((theta - light.outerCutOff) / (light.cutOff - light.outerCutOff), 0.0f, 1.0f);
+        if (attenuation * intensity <= 0.0f)
+            return glm::vec3(0.0f);
+        float diff = std::max(glm::dot(shadingNormal, lightDir), 0.0f);
+        if (diff > 0.0f && occluded(origin, lightDir, distance))
+            diff = 0.0f;
+        return attenuation * intensity * (ambientTerm + light.diffuse * diff);
+    }
+
+    // cosine-weighted direction around normal
+    static glm::vec3 sampleHemisphere(const glm::vec3 &normal, float r1, float r2) {
+        glm::vec3 helper = std::fabs(normal.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        glm::vec3 tangent = glm::normalize(glm::cross(helper, normal));
+        glm::vec3 bitangent = glm::cross(normal, tangent);
+        float phi = 6.28318530718f * r1;
+        float radius = std::sqrt(r2);
+        return tangent * (radius * std::cos(phi)) + bitangent * (radius * std::sin(phi)) + normal * std::sqrt(1.0f - r2);
+    }
+
+    // direct light per layer plus the mean of settings.samples bounced paths
+    void bakeTexel(const TexelSample &sample, std::mt19937 &rng, std::vector<glm::vec3> &values) const {
+        std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+        for (unsigned int layer = 0; layer < lights.size(); layer++)
+            values[layer] = lightAt(lights[layer], sample.position, sample.normal, true);
+
+        std::vector<glm::vec3> indirect(lights.size(), glm::vec3(0.0f));
+        for (unsigned int s = 0; s < settings.samples; s++) {
+            glm::vec3 position = sample.position, normal = sample.normal;
+            glm::vec3 throughput(1.0f);
+            for (unsigned int bounce = 0; bounce < settings.bounces; bounce++) {
+                Ray ray{position + normal * LIGHTMAP_RAY_OFFSET, sampleHemisphere(normal, uniform(rng), uniform(rng))};
+                unsigned int hit;
+                float distance;
+                // out through the open ceiling, or onto the back of something
+                if (!closestHit(ray, hit, distance) || glm::dot(ray.direction, triangles[hit].normal) >= 0.0f)
+                    break;
+                position = ray.origin + ray.direction * distance;
+                normal = triangles[hit].normal;
+                throughput *= triangles[hit].albedo;
+                for (unsigned int layer = 0; layer < lights.size(); layer++)
+                    indirect[layer] += throughput * lightAt(lights[layer], position, normal, false);
+            }
+        }
+        for (unsigned int layer = 0; layer < lights.size(); layer++)
+            values[layer] += indirect[layer] / (float) settings.samples;
+    }
+
+    // grows the charts into their padding, one texel ring per pass
+    void dilate(std::vector<char> &covered) {
+        unsigned int size = settings.size, layerTexels = size * size;
+        for (unsigned int pass = 0; pass <= LIGHTMAP_PADDING; pass++) {
+            std::vector<char> next = covered;
+            for (unsigned int y = 0; y < size; y++) {
+                for (unsigned int x = 0; x < size; x++) {
+                    if (covered[y * size + x])
+                        continue;
+                    unsigned int count = 0;
+                    for (int dy = -1; dy <= 1; dy++) {
+                        for (int dx = -1; dx <= 1; dx++) {
+                            int nx = (int) x + dx, ny = (int) y + dy;
+                            if (nx < 0 || ny < 0 || nx >= (int) size || ny >= (int) size || !covered[ny * size + nx])
+                                continue;
+                            for (unsigned int layer = 0; layer < lights.size(); layer++)
+                                texels[layer * layerTexels + y * size + x] += texels[layer * layerTexels + ny * size + nx];
+                            count++;
+                        }
+                    }
+                    if (count == 0)
+                        continue;
+                    for (unsigned int layer = 0; layer < lights.size(); layer++)
+                        texels[layer * layerTexels + y * size + x] /= (float) count;
+                    next[y * size + x] = 1;
+                }
+            }
+            covered.swap(next);
+        }
+    }
+
+    // FNV-1a over everything the texels depend on
+    uint64_t cacheKey() const {
+        uint64_t hash = 14695981039346656037ull;
+        auto add = [&hash](const void *data, size_t size) {
+            const unsigned char *bytes = (const unsigned char *) data;
+            for (size_t i = 0; i < size; i++)
+                hash = (hash ^ bytes[i]) * 1099511628211ull;
+        };
+        auto addVec3 = [&add](const glm::vec3 &v) { add(&v[0], sizeof(float) * 3); };
+        add(&settings.size, sizeof(settings.size));
+        add(&settings.samples, sizeof(settings.samples));
+        add(&settings.bounces, sizeof(settings.bounces));
+        for (const Triangle &triangle : triangles) {
+            addVec3(triangle.a);
+            addVec3(triangle.b);
+            addVec3(triangle.c);
+            addVec3(triangle.normal);
+            addVec3(triangle.albedo);
+        }
+        for (const BakeLight &bakeLight : lights) {
+            const Light &light = bakeLight.light;
+            float terms[5] = {light.cutOff, light.outerCutOff, light.constant, light.linear, light.quadratic};
+            add(&bakeLight.directional, sizeof(bakeLight.directional));
+            addVec3(light.position);
+            addVec3(light.direction);
+            add(terms, sizeof(terms));
+            addVec3(light.ambient);
+            addVec3(light.diffuse);
+        }
+        return hash;
+    }
+
+    struct CacheHeader {
+        char magic[4];
+        uint32_t version;
+        uint64_t key;
+        uint32_t size;
+        uint32_t layers;
+    };
+
+    CacheHeader header(uint64_t key) const {
+        CacheHeader result;
+        std::memcpy(result.magic, "RGLM", 4);
+        // 2: seeded per texel
+        result.version = 2;
+        result.key = key;
+        result.size = settings.size;
+        result.layers = lights.size();
+        return result;
+    }
+
+    bool load(const std::string &path, uint64_t key) {
+        std::ifstream in(path, std::ios::binary);
+        CacheHeader expected = header(key), found;
+        if (!in.read((char *) &found, sizeof(found)) || std::memcmp(&found, &expected, sizeof(found)) != 0)
+            return false;
+        texels.resize(lights.size() * settings.size * settings.size);
+        if (!in.read((char *) texels.data(), texels.size() * sizeof(glm::vec3))) {
+            texels.clear();
+            return false;
+        }
+        std::cout << "Lightmap: loaded from " << path << std::endl;
+        return true;
+    }
+
+    void save(const std::string &path, uint64_t key) const {
+        std::ofstream out(path, std::ios::binary);
+        CacheHeader cacheHeader = header(key);
+        out.write((const char *) &cacheHeader, sizeof(cacheHeader));
+        out.write((const char *) texels.data(), texels.size() * sizeof(glm::vec3));
+        if (!out)
+            std::cout << "Lightmap: could not write " << path << std::endl;
+    }
+};
+
+#endif //PROJECT_BASE_LIGHTMAP_H
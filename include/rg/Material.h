@@ -0,0 +1,245 @@
+//
+// Textures plus the fixed-function state a draw needs.
+//
+
+#ifndef PROJECT_BASE_MATERIAL_H
+#define PROJECT_BASE_MATERIAL_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/shader.h>
+#include <rg/GLExt.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+struct Texture {
+    unsigned int id;
+    std::string type;
+    std::string path;
+    // GL_TEXTURE_2D_ARRAY for the packed room textures
+    GLenum target = GL_TEXTURE_2D;
+};
+
+enum TextureRole {
+    TEXTURE_DIFFUSE = 0,
+    TEXTURE_SPECULAR,
+    TEXTURE_NORMAL,
+    TEXTURE_HEIGHT,
+    TEXTURE_ROLE_COUNT
+};
+
+// the N in texture_diffuseN goes up to this; keeps material units below 12, the units
+// from there on hold textures bound once per frame (the clustered light buffers)
+const unsigned int MAX_TEXTURES_PER_ROLE = 3;
+
+// maps the Texture::type names the loaders use; TEXTURE_ROLE_COUNT for anything else
+TextureRole textureRole(const std::string &type) {
+    if (type == "texture_diffuse")
+        return TEXTURE_DIFFUSE;
+    if (type == "texture_specular")
+        return TEXTURE_SPECULAR;
+    if (type == "texture_normal")
+        return TEXTURE_NORMAL;
+    if (type == "texture_height")
+        return TEXTURE_HEIGHT;
+    return TEXTURE_ROLE_COUNT;
+}
+
+const char *textureRoleName(TextureRole role) {
+    static const char *names[TEXTURE_ROLE_COUNT] = {
+            "texture_diffuse", "texture_specular", "texture_normal", "texture_height"
+    };
+    return names[role];
+}
+
+// Every texture_<role>N sampler gets the same unit in every program: diffuse1 is 0,
+// specular1 is 1, ..., diffuse2 is TEXTURE_ROLE_COUNT and so on. Sampler uniforms then
+// only have to be set once per program, whichever material binds first.
+unsigned int textureUnit(TextureRole role, unsigned int number) {
+    return (number - 1) * TEXTURE_ROLE_COUNT + role;
+}
+
+// Binds textures by looking up their sampler names on every call. Only used for meshes
+// without a Material; uses the same units as Material so the two never disagree.
+void bindTextures(Shader &shader, const std::vector<Texture> &textures, const std::string &glslIdentifierPrefix)
+{
+    unsigned int numbers[TEXTURE_ROLE_COUNT] = {0};
+    for (const Texture &texture : textures) {
+        TextureRole role = textureRole(texture.type);
+        if (role == TEXTURE_ROLE_COUNT || numbers[role] == MAX_TEXTURES_PER_ROLE)
+            continue;
+        unsigned int number = ++numbers[role];
+        unsigned int unit = textureUnit(role, number);
+
+        std::string name = glslIdentifierPrefix + textureRoleName(role) + std::to_string(number);
+        glUniform1i(glGetUniformLocation(shader.ID, name.c_str()), unit);
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(texture.target, texture.id);
+    }
+}
+
+class Material {
+public:
+    bool blend = false;
+    bool cullFace = true;
+    // small dense id for render queue sort keys
+    unsigned int sortId;
+
+    explicit Material(const std::vector<Texture> &textures, bool blend = false, bool cullFace = true)
+        : blend(blend), cullFace(cullFace), sortId(nextSortId()++) {
+        SetTextures(textures);
+    }
+
+    const std::vector<Texture> &Textures() const { return textures; }
+
+    bool HasRole(TextureRole role) const {
+        for (const Slot &slot : slots)
+            if (slot.role == role)
+                return true;
+        return false;
+    }
+
+    // resolves roles and units once here, so Bind does no string work
+    void SetTextures(const std::vector<Texture> &textures) {
+        this->textures = textures;
+        slots.clear();
+        unitTextures.clear();
+        programs.clear();
+
+        unsigned int numbers[TEXTURE_ROLE_COUNT] = {0};
+        for (const Texture &texture : textures) {
+            TextureRole role = textureRole(texture.type);
+            if (role == TEXTURE_ROLE_COUNT || numbers[role] == MAX_TEXTURES_PER_ROLE)
+                continue;
+            Slot slot;
+            slot.role = role;
+            slot.number = ++numbers[role];
+            slot.unit = textureUnit(role, slot.number);
+            slot.texture = texture.id;
+            slot.target = texture.target;
+            slots.push_back(slot);
+
+            if (unitTextures.size() <= slot.unit)
+                unitTextures.resize(slot.unit + 1, 0);
+            unitTextures[slot.unit] = slot.texture;
+        }
+    }
+
+    const std::string &GlslIdentifierPrefix() const { return glslIdentifierPrefix; }
+
+    void SetGlslIdentifierPrefix(const std::string &prefix) {
+        glslIdentifierPrefix = prefix;
+        programs.clear();
+    }
+
+    // same texture in every unit; such materials can share one bind
+    bool SameTextures(const Material &other) const {
+        return unitTextures == other.unitTextures;
+    }
+
+    // Every material remembers the programs it has set up by name. A program deleted while
+    // materials are still bound afterwards has to be forgotten first: glCreateProgram may hand
+    // the name out again, and the new program would be taken as already set up, its sampler
+    // uniforms never pointed at their units.
+    static void ForgetProgram(GLuint program) {
+        forgottenPrograms().push_back(program);
+    }
+
+    // Expects shader to be the current program. The first bind for a program looks up the
+    // sampler locations and points them at their units; after that it is just the texture binds:
+    // one glBindTextures on 4.4, glActiveTexture + glBindTexture pairs before it.
+    void Bind(Shader &shader) const {
+        resolveProgram(shader);
+
+        const rg::GLCaps &caps = rg::glCaps();
+        if (caps.multiBind) {
+            if (!unitTextures.empty())
+                glBindTextures(0, unitTextures.size(), unitTextures.data());
+        } else {
+            for (const Slot &slot : slots) {
+                glActiveTexture(GL_TEXTURE0 + slot.unit);
+                glBindTexture(slot.target, slot.texture);
+            }
+        }
+    }
+
+    // only touches GL when the state differs from what the previous material left
+    void ApplyState(const Material *previous) const {
+        if (previous == nullptr || previous->blend != blend) {
+            if (blend)
+                glEnable(GL_BLEND);
+            else
+                glDisable(GL_BLEND);
+        }
+        if (previous == nullptr || previous->cullFace != cullFace) {
+            if (cullFace)
+                glEnable(GL_CULL_FACE);
+            else
+                glDisable(GL_CULL_FACE);
+        }
+    }
+
+private:
+    struct Slot {
+        TextureRole role;
+        unsigned int number;
+        GLuint unit;
+        GLuint texture;
+        GLenum target;
+    };
+
+    struct ProgramBinding {
+        GLuint program;
+        // sampler location per slot, -1 when the program does not use it
+        std::vector<GLint> locations;
+    };
+
+    std::vector<Texture> textures;
+    std::string glslIdentifierPrefix = "material.";
+    std::vector<Slot> slots;
+    // texture per unit from 0 up to the highest unit used, 0 in the gaps
+    std::vector<GLuint> unitTextures;
+    // programs this material has been bound with; only a handful, so a linear search
+    mutable std::vector<ProgramBinding> programs;
+    // how much of forgottenPrograms() has been taken out of programs
+    mutable size_t forgottenSeen = 0;
+
+    void resolveProgram(Shader &shader) const {
+        const std::vector<GLuint> &forgotten = forgottenPrograms();
+        for (; forgottenSeen < forgotten.size(); forgottenSeen++) {
+            GLuint program = forgotten[forgottenSeen];
+            auto stale = [program](const ProgramBinding &binding) { return binding.program == program; };
+            programs.erase(std::remove_if(programs.begin(), programs.end(), stale), programs.end());
+        }
+        for (const ProgramBinding &binding : programs)
+            if (binding.program == shader.ID)
+                return;
+
+        ProgramBinding binding;
+        binding.program = shader.ID;
+        for (const Slot &slot : slots) {
+            std::string name = glslIdentifierPrefix + textureRoleName(slot.role) + std::to_string(slot.number);
+            GLint location = glGetUniformLocation(shader.ID, name.c_str());
+            // sampler uniforms are program state and the unit never changes, so set it now and leave it
+            if (location >= 0)
+                glUniform1i(location, slot.unit);
+            binding.locations.push_back(location);
+        }
+        programs.push_back(binding);
+    }
+
+    // every ForgetProgram so far, in order; shared by all materials
+    static std::vector<GLuint> &forgottenPrograms() {
+        static std::vector<GLuint> programs;
+        return programs;
+    }
+
+    static unsigned int &nextSortId() {
+        static unsigned int id = 0;
+        return id;
+    }
+};
+
+#endif //PROJECT_BASE_MATERIAL_H
@@ -0,0 +1,304 @@
+//
+// Submits the meshes of many models with one glMultiDrawElementsIndirect per material group.
+//
+
+#ifndef PROJECT_BASE_MULTIDRAWBATCH_H
+#define PROJECT_BASE_MULTIDRAWBATCH_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/model.h>
+#include <learnopengl/shader.h>
+#include <rg/GLExt.h>
+#include <rg/InstanceBuffer.h>
+#include <rg/Material.h>
+#include <rg/RenderStats.h>
+#include <rg/ShaderVariants.h>
+
+#include <algorithm>
+#include <vector>
+
+// room_mdi.vs reads the draw id here
+const unsigned int DRAW_ID_LOCATION = 9;
+
+// layout of one indirect command, fixed by the GL spec
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// std430 element of the per-draw SSBO read by room_mdi.vs
+struct DrawData {
+    glm::mat4 model;
+    NormalMatrix normalMatrix;
+    GLuint materialIndex;
+    GLuint padding[3];
+};
+
+class MultiDrawBatch {
+public:
+    // Adds every mesh of the model, grouped by the textures and cull state of its material
+    // (model meshes always have one). Returns a handle for SetTransform.
+    unsigned int Add(const Model &model, const glm::mat4 &transform)
+    {
+        unsigned int object = objects.size();
+        objects.push_back(Object{transform, {}});
+
+        for (const Mesh &mesh : model.meshes) {
+            Record record;
+            record.group = findOrAddGroup(*mesh.material);
+            record.object = object;
+            record.command.count = mesh.indices.size();
+            record.command.instanceCount = 1;
+            record.command.firstIndex = indices.size();
+            record.command.baseVertex = vertices.size();
+            record.command.baseInstance = 0;
+            records.push_back(record);
+
+            vertices.insert(vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+            indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+        }
+        return object;
+    }
+
+    // uploads the combined geometry; call once after all models are added
+    void Build()
+    {
+        // commands of one group have to be contiguous so the group is a single multi-draw
+        std::stable_sort(records.begin(), records.end(), [](const Record &a, const Record &b) {
+            return a.group < b.group;
+        });
+
+        commands.clear();
+        drawData.clear();
+        for (Group &group : groups) {
+            group.firstCommand = 0;
+            group.commandCount = 0;
+        }
+        for (unsigned int i = 0; i < records.size(); i++) {
+            Record &record = records[i];
+            Group &group = groups[record.group];
+            if (group.commandCount == 0)
+                group.firstCommand = i;
+            group.commandCount++;
+
+            // baseInstance doubles as the draw id: the shader reads drawIds[gl_InstanceID + baseInstance]
+            record.command.baseInstance = i;
+            commands.push_back(record.command);
+            drawData.push_back(DrawData{objects[record.object].transform, normalMatrix(objects[record.object].transform),
+                                        record.group, {0, 0, 0}});
+            objects[record.object].draws.push_back(i);
+        }
+
+        vector<GLuint> drawIds(records.size());
+        for (unsigned int i = 0; i < drawIds.size(); i++)
+            drawIds[i] = i;
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+        glGenBuffers(1, &drawIdBuffer);
+
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+        glEnableVertexAttribArray(4);
+        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+
+        glBindBuffer(GL_ARRAY_BUFFER, drawIdBuffer);
+        glBufferData(GL_ARRAY_BUFFER, drawIds.size() * sizeof(GLuint), drawIds.data(), GL_STATIC_DRAW);
+        // after the instance matrix at 5..8 that room.vs uses in the fallback path
+        glEnableVertexAttribArray(DRAW_ID_LOCATION);
+        glVertexAttribIPointer(DRAW_ID_LOCATION, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*)0);
+        glVertexAttribDivisor(DRAW_ID_LOCATION, 1);
+
+        glBindVertexArray(0);
+
+        if (rg::glCaps().multiDrawIndirect) {
+            glGenBuffers(1, &indirectBuffer);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+            glGenBuffers(1, &drawDataBuffer);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, drawDataBuffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, drawData.size() * sizeof(DrawData), drawData.data(), GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        }
+        drawDataDirty = false;
+        commandsDirty = false;
+    }
+
+    // hidden objects stay in the batch with an instance count of zero
+    void SetVisible(unsigned int object, bool visible)
+    {
+        for (unsigned int draw : objects[object].draws) {
+            if (commands[draw].instanceCount != (visible ? 1u : 0u)) {
+                commands[draw].instanceCount = visible ? 1 : 0;
+                commandsDirty = true;
+            }
+        }
+    }
+
+    void SetTransform(unsigned int object, const glm::mat4 &transform)
+    {
+        objects[object].transform = transform;
+        NormalMatrix normals = normalMatrix(transform);
+        for (unsigned int draw : objects[object].draws) {
+            drawData[draw].model = transform;
+            drawData[draw].normalMatrix = normals;
+        }
+        drawDataDirty = true;
+    }
+
+    // One glMultiDrawElementsIndirect per group through indirectShader (room_mdi.vs) when the
+    // context has GL 4.3, otherwise one glDrawElementsBaseVertex per mesh through fallbackShader.
+    // Both shaders must already be in use-ready state with their frame uniforms set.
+    void Draw(Shader *indirectShader, Shader &fallbackShader)
+    {
+        draw(indirectShader, fallbackShader);
+    }
+
+    // the same with the variant for each group's material
+    void Draw(ShaderVariants *indirectShader, ShaderVariants &fallbackShader)
+    {
+        draw(indirectShader, fallbackShader);
+    }
+
+    unsigned int MeshCount() const { return records.size(); }
+
+private:
+    template <typename Program>
+    void draw(Program *indirectProgram, Program &fallbackProgram)
+    {
+        bool indirect = indirectProgram != nullptr && rg::glCaps().multiDrawIndirect;
+        Program &program = indirect ? *indirectProgram : fallbackProgram;
+
+        glBindVertexArray(VAO);
+        if (indirect) {
+            if (drawDataDirty) {
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, drawDataBuffer);
+                glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, drawData.size() * sizeof(DrawData), drawData.data());
+                drawDataDirty = false;
+            }
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, drawDataBuffer);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+            if (commandsDirty) {
+                glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data());
+                commandsDirty = false;
+            }
+        }
+
+        RenderStats &stats = renderStats();
+        const Shader *current = nullptr;
+        for (const Group &group : groups) {
+            unsigned int visibleCommands = 0, visibleIndices = 0;
+            for (unsigned int i = group.firstCommand; i < group.firstCommand + group.commandCount; i++) {
+                visibleCommands += commands[i].instanceCount;
+                visibleIndices += commands[i].count * commands[i].instanceCount;
+            }
+            if (visibleCommands == 0)
+                continue;
+            if (group.material->cullFace)
+                glEnable(GL_CULL_FACE);
+            else
+                glDisable(GL_CULL_FACE);
+            Shader &shader = shaderFor(program, group.material);
+            if (&shader != current) {
+                shader.use();
+                current = &shader;
+            }
+            group.material->Bind(shader);
+
+            stats.modelMeshes += visibleCommands;
+            if (indirect) {
+                glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                            (void*)(group.firstCommand * sizeof(DrawElementsIndirectCommand)),
+                                            group.commandCount, 0);
+                stats.AddDraw(visibleIndices);
+                stats.modelDrawCalls++;
+            } else {
+                for (unsigned int i = group.firstCommand; i < group.firstCommand + group.commandCount; i++) {
+                    const DrawElementsIndirectCommand &command = commands[i];
+                    if (command.instanceCount == 0)
+                        continue;
+                    setInstanceTransform(drawData[i].model, drawData[i].normalMatrix);
+                    glDrawElementsBaseVertex(GL_TRIANGLES, command.count, GL_UNSIGNED_INT,
+                                             (void*)(command.firstIndex * sizeof(unsigned int)), command.baseVertex);
+                    stats.AddDraw(command.count);
+                    stats.modelDrawCalls++;
+                }
+            }
+        }
+
+        if (indirect)
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        glBindVertexArray(0);
+        glEnable(GL_CULL_FACE);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    struct Group {
+        // first material added to the group; binds for all of them
+        const Material *material;
+        GLuint firstCommand = 0;
+        GLuint commandCount = 0;
+    };
+
+    struct Record {
+        unsigned int group;
+        unsigned int object;
+        DrawElementsIndirectCommand command;
+    };
+
+    struct Object {
+        glm::mat4 transform;
+        vector<unsigned int> draws;
+    };
+
+    vector<Vertex> vertices;
+    vector<unsigned int> indices;
+    vector<Group> groups;
+    vector<Record> records;
+    vector<Object> objects;
+    vector<DrawElementsIndirectCommand> commands;
+    vector<DrawData> drawData;
+    bool drawDataDirty = true;
+    bool commandsDirty = true;
+
+    unsigned int VAO = 0, VBO = 0, EBO = 0;
+    unsigned int drawIdBuffer = 0, indirectBuffer = 0, drawDataBuffer = 0;
+
+    // meshes are compatible when they sample the same textures with the same cull state
+    unsigned int findOrAddGroup(const Material &material)
+    {
+        for (unsigned int i = 0; i < groups.size(); i++) {
+            const Material &other = *groups[i].material;
+            if (other.cullFace == material.cullFace && other.SameTextures(material)
+                && other.GlslIdentifierPrefix() == material.GlslIdentifierPrefix())
+                return i;
+        }
+        Group group;
+        group.material = &material;
+        groups.push_back(group);
+        return groups.size() - 1;
+    }
+};
+
+#endif //PROJECT_BASE_MULTIDRAWBATCH_H
@@ -0,0 +1,326 @@
+//
+// Low-resolution CPU depth buffer for occlusion culling.
+//
+
+#ifndef PROJECT_BASE_OCCLUSIONRASTERIZER_H
+#define PROJECT_BASE_OCCLUSIONRASTERIZER_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/mesh.h>
+#include <rg/Bounds.h>
+#include <rg/WorkerPool.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#include <immintrin.h>
+#define RG_OCCLUSION_SSE 1
+#if defined(__GNUC__)
+#define RG_OCCLUSION_AVX2 1
+#endif
+#endif
+
+// occluder geometry in object space; proxies should lie inside what they stand for
+struct OccluderMesh {
+    std::vector<glm::vec3> positions;
+    std::vector<unsigned int> indices;
+
+    // takes the mesh's triangles as they are, transformed into this occluder's space
+    void Append(const Mesh &mesh, const glm::mat4 &transform = glm::mat4(1.0f)) {
+        unsigned int base = positions.size();
+        for (const Vertex &vertex : mesh.vertices)
+            positions.push_back(glm::vec3(transform * glm::vec4(vertex.Position, 1.0f)));
+        for (unsigned int index : mesh.indices)
+            indices.push_back(base + index);
+    }
+};
+
+namespace occlusion {
+    // Screen-space triangle as three edge functions and a depth plane, all evaluated at
+    // pixel centers: E(x, y) = a * x + b * y + c, inside where all three are positive.
+    struct Triangle {
+        float edgeA[3], edgeB[3], edgeC[3];
+        float depthA, depthB, depthC;
+        int minX, maxX, minY, maxY;
+    };
+
+    void rasterizeScalar(const Triangle &t, float *depth, int width, int yBegin, int yEnd) {
+        int y0 = std::max(t.minY, yBegin), y1 = std::min(t.maxY, yEnd - 1);
+        for (int y = y0; y <= y1; y++) {
+            float fy = y + 0.5f;
+            // the y terms are constant along the row; same evaluation order as the SIMD paths
+            float r0 = t.edgeB[0] * fy + t.edgeC[0];
+            float r1 = t.edgeB[1] * fy + t.edgeC[1];
+            float r2 = t.edgeB[2] * fy + t.edgeC[2];
+            float rz = t.depthB * fy + t.depthC;
+            float *row = depth + y * width;
+            for (int x = t.minX; x <= t.maxX; x++) {
+                float fx = x + 0.5f;
+                if (t.edgeA[0] * fx + r0 > 0.0f && t.edgeA[1] * fx + r1 > 0.0f && t.edgeA[2] * fx + r2 > 0.0f)
+                    row[x] = std::min(row[x], t.depthA * fx + rz);
+            }
+        }
+    }
+
+#ifdef RG_OCCLUSION_SSE
+    // four pixels per step; rows are padded to a multiple of 8 so aligned-down spans stay in the row
+    void rasterizeSSE(const Triangle &t, float *depth, int width, int yBegin, int yEnd) {
+        int y0 = std::max(t.minY, yBegin), y1 = std::min(t.maxY, yEnd - 1);
+        int xStart = t.minX & ~3;
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+        __m128 a0 = _mm_set1_ps(t.edgeA[0]), a1 = _mm_set1_ps(t.edgeA[1]), a2 = _mm_set1_ps(t.edgeA[2]);
+        __m128 za = _mm_set1_ps(t.depthA);
+        for (int y = y0; y <= y1; y++) {
+            float fy = y + 0.5f;
+            __m128 r0 = _mm_set1_ps(t.edgeB[0] * fy + t.edgeC[0]);
+            __m128 r1 = _mm_set1_ps(t.edgeB[1] * fy + t.edgeC[1]);
+            __m128 r2 = _mm_set1_ps(t.edgeB[2] * fy + t.edgeC[2]);
+            __m128 rz = _mm_set1_ps(t.depthB * fy + t.depthC);
+            float *row = depth + y * width;
+            for (int x = xStart; x <= t.maxX; x += 4) {
+                __m128 fx = _mm_add_ps(_mm_set1_ps((float) x), laneOffsets);
+                __m128 e0 = _mm_add_ps(_mm_mul_ps(a0, fx), r0);
+                __m128 e1 = _mm_add_ps(_mm_mul_ps(a1, fx), r1);
+                __m128 e2 = _mm_add_ps(_mm_mul_ps(a2, fx), r2);
+                __m128 inside = _mm_and_ps(_mm_cmpgt_ps(e0, zero), _mm_and_ps(_mm_cmpgt_ps(e1, zero), _mm_cmpgt_ps(e2, zero)));
+                if (_mm_movemask_ps(inside) == 0)
+                    continue;
+                __m128 z = _mm_add_ps(_mm_mul_ps(za, fx), rz);
+                __m128 old = _mm_loadu_ps(row + x);
+                __m128 nearer = _mm_min_ps(old, z);
+                _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+            }
+        }
+    }
+#endif
+
+#ifdef RG_OCCLUSION_AVX2
+    // same as the SSE path, eight pixels per step; only called after a runtime CPU check
+    __attribute__((target("avx2")))
+    void rasterizeAVX2(const Triangle &t, float *depth, int width, int yBegin, int yEnd) {
+        int y0 = std::max(t.minY, yBegin), y1 = std::min(t.maxY, yEnd - 1);
+        int xStart = t.minX & ~7;
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 laneOffsets = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+        __m256 a0 = _mm256_set1_ps(t.edgeA[0]), a1 = _mm256_set1_ps(t.edgeA[1]), a2 = _mm256_set1_ps(t.edgeA[2]);
+        __m256 za = _mm256_set1_ps(t.depthA);
+        for (int y = y0; y <= y1; y++) {
+            float fy = y + 0.5f;
+            __m256 r0 = _mm256_set1_ps(t.edgeB[0] * fy + t.edgeC[0]);
+            __m256 r1 = _mm256_set1_ps(t.edgeB[1] * fy + t.edgeC[1]);
+            __m256 r2 = _mm256_set1_ps(t.edgeB[2] * fy + t.edgeC[2]);
+            __m256 rz = _mm256_set1_ps(t.depthB * fy + t.depthC);
+            float *row = depth + y * width;
+            for (int x = xStart; x <= t.maxX; x += 8) {
+                __m256 fx = _mm256_add_ps(_mm256_set1_ps((float) x), laneOffsets);
+                __m256 e0 = _mm256_add_ps(_mm256_mul_ps(a0, fx), r0);
+                __m256 e1 = _mm256_add_ps(_mm256_mul_ps(a1, fx), r1);
+                __m256 e2 = _mm256_add_ps(_mm256_mul_ps(a2, fx), r2);
+                __m256 inside = _mm256_and_ps(_mm256_cmp_ps(e0, zero, _CMP_GT_OQ),
+                                              _mm256_and_ps(_mm256_cmp_ps(e1, zero, _CMP_GT_OQ),
+                                                            _mm256_cmp_ps(e2, zero, _CMP_GT_OQ)));
+                if (_mm256_movemask_ps(inside) == 0)
+                    continue;
+                __m256 z = _mm256_add_ps(_mm256_mul_ps(za, fx), rz);
+                __m256 old = _mm256_loadu_ps(row + x);
+                _mm256_storeu_ps(row + x, _mm256_blendv_ps(old, _mm256_min_ps(old, z), inside));
+            }
+        }
+    }
+#endif
+}
+
+// Occluders are rasterized into a small depth buffer (NDC z, cleared to the far plane),
+// split into horizontal bands across a WorkerPool. A max-depth pyramid over it then answers
+// "is any part of this box possibly in front of everything drawn there".
+class OcclusionRasterizer {
+public:
+    // width is rounded up to a multiple of 8 for the SIMD spans
+    OcclusionRasterizer(int width = 256, int height = 192) : width((width + 7) & ~7), height(height) {
+        for (int w = this->width, h = height; ; w = std::max(1, (w + 1) / 2), h = std::max(1, (h + 1) / 2)) {
+            levels.push_back(Level{w, h, std::vector<float>(w * h, 1.0f)});
+            if (w == 1 && h == 1)
+                break;
+        }
+        rasterize = occlusion::rasterizeScalar;
+#ifdef RG_OCCLUSION_SSE
+        rasterize = occlusion::rasterizeSSE;
+#endif
+#ifdef RG_OCCLUSION_AVX2
+        if (__builtin_cpu_supports("avx2"))
+            rasterize = occlusion::rasterizeAVX2;
+#endif
+    }
+
+    void Begin(const glm::mat4 &viewProjection) {
+        this->viewProjection = viewProjection;
+        triangles.clear();
+    }
+
+    // transforms, clips against the near plane and sets up the triangles of one occluder
+    void AddOccluder(const OccluderMesh &mesh, const glm::mat4 &model) {
+        glm::mat4 transform = viewProjection * model;
+        clipPositions.resize(mesh.positions.size());
+        for (unsigned int i = 0; i < mesh.positions.size(); i++)
+            clipPositions[i] = transform * glm::vec4(mesh.positions[i], 1.0f);
+        for (unsigned int i = 0; i + 2 < mesh.indices.size(); i += 3)
+            addClipTriangle(clipPositions[mesh.indices[i]], clipPositions[mesh.indices[i + 1]],
+                            clipPositions[mesh.indices[i + 2]]);
+    }
+
+    // rasterizes everything added since Begin, then rebuilds the depth pyramid
+    void Rasterize(WorkerPool &pool) {
+        std::vector<float> &depth = levels[0].depth;
+        std::fill(depth.begin(), depth.end(), 1.0f);
+        unsigned int bands = (height + BAND_HEIGHT - 1) / BAND_HEIGHT;
+        pool.ParallelFor(bands, [&](unsigned int band) {
+            int yBegin = band * BAND_HEIGHT, yEnd = std::min(height, yBegin + BAND_HEIGHT);
+            for (const occlusion::Triangle &triangle : triangles)
+                if (triangle.maxY >= yBegin && triangle.minY < yEnd)
+                    rasterize(triangle, depth.data(), width, yBegin, yEnd);
+        });
+
+        for (unsigned int l = 1; l < levels.size(); l++) {
+            const Level &fine = levels[l - 1];
+            Level &coarse = levels[l];
+            for (int y = 0; y < coarse.height; y++) {
+                int y0 = std::min(2 * y, fine.height - 1), y1 = std::min(2 * y + 1, fine.height - 1);
+                for (int x = 0; x < coarse.width; x++) {
+                    int x0 = std::min(2 * x, fine.width - 1), x1 = std::min(2 * x + 1, fine.width - 1);
+                    coarse.depth[y * coarse.width + x] = std::max(
+                            std::max(fine.depth[y0 * fine.width + x0], fine.depth[y0 * fine.width + x1]),
+                            std::max(fine.depth[y1 * fine.width + x0], fine.depth[y1 * fine.width + x1]));
+                }
+            }
+        }
+    }
+
+    // False only when the whole box is behind the rasterized occluders. Boxes crossing the
+    // near plane or leaving the screen are reported visible; frustum culling handles those.
+    bool IsVisible(const AABB &box) const {
+        if (box.Empty())
+            return true;
+        float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX, minZ = FLT_MAX;
+        for (int corner = 0; corner < 8; corner++) {
+            glm::vec3 p((corner & 1) ? box.max.x : box.min.x,
+                        (corner & 2) ? box.max.y : box.min.y,
+                        (corner & 4) ? box.max.z : box.min.z);
+            glm::vec4 clip = viewProjection * glm::vec4(p, 1.0f);
+            if (clip.w <= NEAR_W || clip.z < -clip.w)
+                return true;
+            float sx = (clip.x / clip.w * 0.5f + 0.5f) * width;
+            float sy = (clip.y / clip.w * 0.5f + 0.5f) * height;
+            minX = std::min(minX, sx);
+            maxX = std::max(maxX, sx);
+            minY = std::min(minY, sy);
+            maxY = std::max(maxY, sy);
+            minZ = std::min(minZ, clip.z / clip.w);
+        }
+        if (maxX < 0.0f || maxY < 0.0f || minX >= width || minY >= height)
+            return true;
+
+        int x0 = std::max(0, (int) minX), x1 = std::min(width - 1, (int) maxX);
+        int y0 = std::max(0, (int) minY), y1 = std::min(height - 1, (int) maxY);
+        // coarsest level where the rectangle still spans at most 4x4 texels
+        unsigned int level = 0;
+        while (level + 1 < levels.size() && ((x1 >> level) - (x0 >> level) > 3 || (y1 >> level) - (y0 >> level) > 3))
+            level++;
+        const Level &hiz = levels[level];
+        for (int y = y0 >> level; y <= (y1 >> level); y++)
+            for (int x = x0 >> level; x <= (x1 >> level); x++)
+                if (minZ <= hiz.depth[y * hiz.width + x])
+                    return true;
+        return false;
+    }
+
+    unsigned int TriangleCount() const { return triangles.size(); }
+    int Width() const { return width; }
+    int Height() const { return height; }
+    // level 0 depth in NDC z, rows bottom to top
+    const std::vector<float> &Depth() const { return levels[0].depth; }
+
+private:
+    static const int BAND_HEIGHT = 16;
+    // clip-space w below which a point counts as on or behind the camera
+    static constexpr float NEAR_W = 1e-5f;
+
+    struct Level {
+        int width, height;
+        std::vector<float> depth;
+    };
+
+    int width, height;
+    std::vector<Level> levels;
+    glm::mat4 viewProjection = glm::mat4(1.0f);
+    std::vector<glm::vec4> clipPositions;
+    std::vector<occlusion::Triangle> triangles;
+    void (*rasterize)(const occlusion::Triangle &, float *, int, int, int);
+
+    // Sutherland-Hodgman against the near plane (z >= -w) only; the bounding box clamp
+    // takes care of the sides
+    void addClipTriangle(const glm::vec4 &a, const glm::vec4 &b, const glm::vec4 &c) {
+        const glm::vec4 input[3] = {a, b, c};
+        glm::vec4 polygon[4];
+        int count = 0;
+        for (int i = 0; i < 3; i++) {
+            const glm::vec4 &p = input[i], &q = input[(i + 1) % 3];
+            float dp = p.z + p.w, dq = q.z + q.w;
+            if (dp >= 0.0f)
+                polygon[count++] = p;
+            if ((dp >= 0.0f) != (dq >= 0.0f))
+                polygon[count++] = p + (q - p) * (dp / (dp - dq));
+        }
+        for (int i = 1; i + 1 < count; i++)
+            setupTriangle(polygon[0], polygon[i], polygon[i + 1]);
+    }
+
+    void setupTriangle(const glm::vec4 &a, const glm::vec4 &b, const glm::vec4 &c) {
+        if (a.w <= NEAR_W || b.w <= NEAR_W || c.w <= NEAR_W)
+            return;
+        glm::vec3 v[3];
+        const glm::vec4 *clip[3] = {&a, &b, &c};
+        for (int i = 0; i < 3; i++) {
+            float inverseW = 1.0f / clip[i]->w;
+            v[i] = glm::vec3((clip[i]->x * inverseW * 0.5f + 0.5f) * width,
+                             (clip[i]->y * inverseW * 0.5f + 0.5f) * height,
+                             clip[i]->z * inverseW);
+        }
+        float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[2].x - v[0].x) * (v[1].y - v[0].y);
+        if (std::fabs(area) < 1e-6f)
+            return;
+        // occluders are closed or two-sided, so both windings are rasterized
+        if (area < 0.0f) {
+            std::swap(v[1], v[2]);
+            area = -area;
+        }
+
+        occlusion::Triangle t;
+        t.minX = std::max(0, (int) std::floor(std::min(v[0].x, std::min(v[1].x, v[2].x))));
+        t.maxX = std::min(width - 1, (int) std::ceil(std::max(v[0].x, std::max(v[1].x, v[2].x))));
+        t.minY = std::max(0, (int) std::floor(std::min(v[0].y, std::min(v[1].y, v[2].y))));
+        t.maxY = std::min(height - 1, (int) std::ceil(std::max(v[0].y, std::max(v[1].y, v[2].y))));
+        if (t.minX > t.maxX || t.minY > t.maxY)
+            return;
+
+        // edge i is opposite vertex i, positive on the triangle's side
+        for (int i = 0; i < 3; i++) {
+            const glm::vec3 &p = v[(i + 1) % 3], &q = v[(i + 2) % 3];
+            t.edgeA[i] = p.y - q.y;
+            t.edgeB[i] = q.x - p.x;
+            t.edgeC[i] = p.x * q.y - p.y * q.x;
+        }
+        // z = z0 + (E1 * (z1 - z0) + E2 * (z2 - z0)) / area, with E_i the barycentric edge values
+        float dz1 = (v[1].z - v[0].z) / area, dz2 = (v[2].z - v[0].z) / area;
+        t.depthA = t.edgeA[1] * dz1 + t.edgeA[2] * dz2;
+        t.depthB = t.edgeB[1] * dz1 + t.edgeB[2] * dz2;
+        t.depthC = v[0].z + t.edgeC[1] * dz1 + t.edgeC[2] * dz2;
+        triangles.push_back(t);
+    }
+};
+
+#endif //PROJECT_BASE_OCCLUSIONRASTERIZER_H
@@ -0,0 +1,182 @@
+//
+// Cells connected by portals, and which of them the camera can see through which openings.
+//
+
+#ifndef PROJECT_BASE_PORTALS_H
+#define PROJECT_BASE_PORTALS_H
+
+#include <glm/glm.hpp>
+
+#include <rg/Bounds.h>
+#include <rg/Frustum.h>
+
+#include <algorithm>
+#include <vector>
+
+// cell 0 is everything not inside another cell; the sky is drawn when it is visible
+const unsigned int OUTSIDE_CELL = 0;
+
+// A cell is a box of space (a room); a portal is a convex opening polygon between two cells
+// (the open ceiling, a door, a window). Each frame the camera's cell is visible over the
+// whole screen, and every portal seen from a visible cell makes the cell behind it visible
+// over the part of the screen the portal covers, clipped to the rectangle it was seen
+// through. That rectangle also narrows the frustum used to cull the cell's contents.
+class CellGraph {
+public:
+    // how deep the traversal follows portals; bounds the work in cyclic layouts
+    static const unsigned int MAX_PORTAL_DEPTH = 8;
+
+    struct CellView {
+        bool visible;
+        // screen area the cell is seen through, NDC min x, min y, max x, max y
+        glm::vec4 rect;
+        // view frustum with the side planes pulled in to rect
+        Frustum frustum;
+    };
+
+    CellGraph() {
+        cells.push_back(Cell{AABB(), {}});
+    }
+
+    unsigned int AddCell(const AABB &bounds) {
+        cells.push_back(Cell{bounds, {}});
+        return cells.size() - 1;
+    }
+
+    // corners in order around the opening; usable from both sides
+    void AddPortal(unsigned int a, unsigned int b, const std::vector<glm::vec3> &polygon) {
+        portals.push_back(Portal{polygon, a, b});
+        cells[a].portals.push_back(portals.size() - 1);
+        cells[b].portals.push_back(portals.size() - 1);
+    }
+
+    // the smallest cell containing point, OUTSIDE_CELL when none does
+    unsigned int FindCell(const glm::vec3 &point) const {
+        unsigned int found = OUTSIDE_CELL;
+        float foundVolume = FLT_MAX;
+        for (unsigned int i = 1; i < cells.size(); i++) {
+            const AABB &box = cells[i].bounds;
+            if (point.x < box.min.x || point.y < box.min.y || point.z < box.min.z
+                || point.x > box.max.x || point.y > box.max.y || point.z > box.max.z)
+                continue;
+            glm::vec3 size = box.max - box.min;
+            float volume = size.x * size.y * size.z;
+            if (volume < foundVolume) {
+                found = i;
+                foundVolume = volume;
+            }
+        }
+        return found;
+    }
+
+    // recomputes every cell's view for this camera
+    void Update(const glm::mat4 &viewProjection, const glm::vec3 &cameraPosition) {
+        this->viewProjection = viewProjection;
+        views.assign(cells.size(), CellView{false, glm::vec4(1.0f, 1.0f, -1.0f, -1.0f), Frustum()});
+        cameraCell = FindCell(cameraPosition);
+        path.clear();
+        visit(cameraCell, glm::vec4(-1.0f, -1.0f, 1.0f, 1.0f), 0);
+
+        visibleCount = 0;
+        for (CellView &view : views) {
+            if (!view.visible)
+                continue;
+            view.frustum = extractFrustum(viewProjection, view.rect);
+            visibleCount++;
+        }
+    }
+
+    const CellView &View(unsigned int cell) const { return views[cell]; }
+    bool Visible(unsigned int cell) const { return views[cell].visible; }
+    unsigned int CameraCell() const { return cameraCell; }
+    unsigned int VisibleCount() const { return visibleCount; }
+    unsigned int CellCount() const { return cells.size(); }
+
+private:
+    struct Cell {
+        AABB bounds;
+        std::vector<unsigned int> portals;
+    };
+
+    struct Portal {
+        std::vector<glm::vec3> polygon;
+        unsigned int a, b;
+    };
+
+    std::vector<Cell> cells;
+    std::vector<Portal> portals;
+    std::vector<CellView> views;
+    // portals on the way to the cell being visited, so a portal is not walked back through
+    std::vector<unsigned int> path;
+    glm::mat4 viewProjection = glm::mat4(1.0f);
+    unsigned int cameraCell = OUTSIDE_CELL;
+    unsigned int visibleCount = 0;
+
+    void visit(unsigned int cell, const glm::vec4 &rect, unsigned int depth) {
+        CellView &view = views[cell];
+        // a cell seen through several portals is visible through the union of them
+        view.rect = view.visible ? glm::vec4(std::min(view.rect.x, rect.x), std::min(view.rect.y, rect.y),
+                                             std::max(view.rect.z, rect.z), std::max(view.rect.w, rect.w))
+                                 : rect;
+        view.visible = true;
+        if (depth == MAX_PORTAL_DEPTH)
+            return;
+
+        for (unsigned int portalIndex : cells[cell].portals) {
+            if (std::find(path.begin(), path.end(), portalIndex) != path.end())
+                continue;
+            const Portal &portal = portals[portalIndex];
+            glm::vec4 portalRect;
+            if (!screenRect(portal.polygon, portalRect))
+                continue;
+            glm::vec4 clipped(std::max(rect.x, portalRect.x), std::max(rect.y, portalRect.y),
+                              std::min(rect.z, portalRect.z), std::min(rect.w, portalRect.w));
+            if (clipped.x >= clipped.z || clipped.y >= clipped.w)
+                continue;
+            path.push_back(portalIndex);
+            visit(portal.a == cell ? portal.b : portal.a, clipped, depth + 1);
+            path.pop_back();
+        }
+    }
+
+    // NDC bounds of the polygon after clipping it against the near plane; false when
+    // nothing of it is in front of the camera or it is off screen
+    bool screenRect(const std::vector<glm::vec3> &polygon, glm::vec4 &rect) const {
+        std::vector<glm::vec4> clip;
+        for (const glm::vec3 &corner : polygon)
+            clip.push_back(viewProjection * glm::vec4(corner, 1.0f));
+
+        rect = glm::vec4(FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX);
+        bool any = false;
+        for (unsigned int i = 0; i < clip.size(); i++) {
+            const glm::vec4 &p = clip[i], &q = clip[(i + 1) % clip.size()];
+            float dp = p.z + p.w, dq = q.z + q.w;
+            if (dp >= 0.0f) {
+                expand(rect, p);
+                any = true;
+            }
+            if ((dp >= 0.0f) != (dq >= 0.0f)) {
+                expand(rect, p + (q - p) * (dp / (dp - dq)));
+                any = true;
+            }
+        }
+        if (!any)
+            return false;
+        rect = glm::vec4(std::max(rect.x, -1.0f), std::max(rect.y, -1.0f),
+                         std::min(rect.z, 1.0f), std::min(rect.w, 1.0f));
+        return rect.x < rect.z && rect.y < rect.w;
+    }
+
+    static void expand(glm::vec4 &rect, const glm::vec4 &clip) {
+        // a point on the near plane with w ~ 0 only happens for a camera in the portal
+        // plane; let it open up the whole screen rather than divide by nothing
+        if (clip.w <= 1e-5f) {
+            rect = glm::vec4(-1.0f, -1.0f, 1.0f, 1.0f);
+            return;
+        }
+        float x = clip.x / clip.w, y = clip.y / clip.w;
+        rect = glm::vec4(std::min(rect.x, x), std::min(rect.y, y), std::max(rect.z, x), std::max(rect.w, y));
+    }
+};
+
+#endif //PROJECT_BASE_PORTALS_H
@@ -0,0 +1,160 @@
+//
+// The single pass from the HDR scene to the window: upsampling, bloom, exposure, grading, dither.
+//
+
+#ifndef PROJECT_BASE_POSTPROCESS_H
+#define PROJECT_BASE_POSTPROCESS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader.h>
+#include <rg/ColorGrading.h>
+#include <rg/ComputeShader.h>
+#include <rg/GLExt.h>
+
+#include <cmath>
+
+// what post.glsl reads, besides the LUT
+struct PostInputs {
+    unsigned int sceneTexture = 0;
+    // pixels of sceneTexture the scene covered, from its lower-left corner
+    glm::vec2 sceneSize;
+    unsigned int bloomTexture = 0;
+    glm::vec2 bloomExtent;
+    // 0 leaves the bloom out
+    float bloomStrength = 0.0f;
+    float exposure = 1.0f;
+};
+
+// Everything after the scene is one pass over the window, in post.glsl: one lookup in the
+// ColorLut replaces the tone curve, the grade and the gamma, so a new look is new table
+// contents rather than another pass. Two ways to run it: Draw, one fragment per pixel over a
+// single triangle into whatever framebuffer is bound, and Dispatch, a compute shader in 8x8
+// tiles writing an RGBA8 image that is then blitted to the window (GL 4.3).
+class PostProcess {
+public:
+    // the output image for Dispatch only when compute shaders are there
+    void Create(int width, int height) {
+        glGenVertexArrays(1, &VAO);
+        lut.Create();
+        if (rg::glCaps().compute)
+            glGenFramebuffers(1, &outputFBO);
+        allocate(width, height);
+    }
+
+    // for the window's new size; a minimized window keeps the old image
+    void Resize(int width, int height) {
+        if (width <= 0 || height <= 0 || (width == this->width && height == this->height))
+            return;
+        allocate(width, height);
+    }
+
+    // the look for this frame; the table is rebaked only when it changed
+    void SetGrading(const ColorGrading &grading, bool tonemap) {
+        lut.Bake(grading, tonemap);
+    }
+
+    // into the bound framebuffer, over the current viewport; shader is fullscreen.vs + post.fs
+    void Draw(Shader &shader, const PostInputs &inputs) {
+        shader.use();
+        setInputs(shader, inputs);
+        GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+        glDisable(GL_DEPTH_TEST);
+        glBindVertexArray(VAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+        if (depthTest)
+            glEnable(GL_DEPTH_TEST);
+        unbindInputs();
+    }
+
+    // into the default framebuffer through the output image; shader is post.comp
+    void Dispatch(const ComputeShader &shader, const PostInputs &inputs) {
+        shader.use();
+        setInputs(shader, inputs);
+        glUniform2i(glGetUniformLocation(shader.ID, "targetSize"), width, height);
+        glBindImageTexture(0, outputTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+        shader.Dispatch(width, TILE_SIZE, height, TILE_SIZE);
+        glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT);
+        unbindInputs();
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, outputFBO);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    void Delete() {
+        lut.Delete();
+        glDeleteVertexArrays(1, &VAO);
+        if (outputFBO != 0) {
+            glDeleteTextures(1, &outputTexture);
+            glDeleteFramebuffers(1, &outputFBO);
+        }
+        VAO = outputTexture = outputFBO = 0;
+    }
+
+private:
+    static const unsigned int TILE_SIZE = 8;
+
+    // empty, the triangle comes from gl_VertexID
+    unsigned int VAO = 0;
+    ColorLut lut;
+    unsigned int outputTexture = 0, outputFBO = 0;
+    int width = 0, height = 0;
+
+    void allocate(int width, int height) {
+        this->width = width;
+        this->height = height;
+        if (outputFBO == 0)
+            return;
+        // immutable for image load/store, so a new size is a new texture
+        if (outputTexture != 0)
+            glDeleteTextures(1, &outputTexture);
+        glGenTextures(1, &outputTexture);
+        glBindTexture(GL_TEXTURE_2D, outputTexture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, outputFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, outputTexture, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // units 0..2: scene, bloom, LUT
+    template <typename Program>
+    void setInputs(const Program &program, const PostInputs &inputs) {
+        program.setInt("hdrBuffer", 0);
+        program.setInt("bloomBuffer", 1);
+        program.setInt("gradingLut", 2);
+        program.setVec2("sourceSize", inputs.sceneSize);
+        program.setVec2("bloomExtent", inputs.bloomExtent);
+        program.setFloat("bloomStrength", inputs.bloomTexture != 0 ? inputs.bloomStrength : 0.0f);
+        program.setFloat("exposure", inputs.exposure);
+        float logMin = std::log2(COLOR_LUT_EPSILON);
+        float logMax = std::log2(COLOR_LUT_MAX + COLOR_LUT_EPSILON);
+        program.setFloat("lutEpsilon", COLOR_LUT_EPSILON);
+        program.setFloat("lutLogMin", logMin);
+        program.setFloat("lutInverseLogRange", 1.0f / (logMax - logMin));
+        program.setFloat("lutSize", (float) COLOR_LUT_SIZE);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, inputs.sceneTexture);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, inputs.bloomTexture);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_3D, lut.Texture());
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    static void unbindInputs() {
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_3D, 0);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+};
+
+#endif //PROJECT_BASE_POSTPROCESS_H
@@ -0,0 +1,40 @@
+//
+// Indexed meshes for the hand-written room geometry.
+//
+
+#ifndef PROJECT_BASE_PRIMITIVES_H
+#define PROJECT_BASE_PRIMITIVES_H
+
+#include <learnopengl/mesh.h>
+
+#include <vector>
+
+// Builds a Mesh from interleaved position/normal/texcoord floats (8 per vertex, as in the
+// learnopengl cube arrays) so primitives go through the same Draw/DrawInstanced paths as
+// model meshes. Triangles are kept as listed, the index buffer is just 0..n-1.
+// The material has to outlive the mesh. textureLayer selects the layer when the material
+// samples texture arrays.
+Mesh createPrimitive(const float *data, unsigned int vertexCount, Material &material, int textureLayer = -1) {
+    vector<Vertex> vertices(vertexCount);
+    vector<unsigned int> indices(vertexCount);
+    AABB bounds;
+    for (unsigned int i = 0; i < vertexCount; i++) {
+        const float *v = data + i * 8;
+        vertices[i].Position = glm::vec3(v[0], v[1], v[2]);
+        bounds.Expand(vertices[i].Position);
+        vertices[i].Normal = glm::vec3(v[3], v[4], v[5]);
+        vertices[i].TexCoords = glm::vec2(v[6], v[7]);
+        vertices[i].Tangent = glm::vec3(0.0f);
+        vertices[i].Bitangent = glm::vec3(0.0f);
+        indices[i] = i;
+    }
+    Mesh mesh(vertices, indices, material.Textures());
+    mesh.glslIdentifierPrefix = material.GlslIdentifierPrefix();
+    mesh.material = &material;
+    mesh.textureLayer = textureLayer;
+    mesh.bounds = bounds;
+    mesh.sphere = Mesh::sphereAround(bounds, vertices);
+    return mesh;
+}
+
+#endif //PROJECT_BASE_PRIMITIVES_H
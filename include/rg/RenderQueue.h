@@ -0,0 +1,211 @@
+//
+// Per-frame list of draws, sorted by a packed 64-bit key before submission.
+//
+
+#ifndef PROJECT_BASE_RENDERQUEUE_H
+#define PROJECT_BASE_RENDERQUEUE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/mesh.h>
+#include <learnopengl/model.h>
+#include <learnopengl/shader.h>
+#include <rg/InstanceBuffer.h>
+#include <rg/Material.h>
+#include <rg/ShaderVariants.h>
+
+#include <cstdint>
+#include <vector>
+
+enum RenderPass {
+    PASS_OPAQUE = 0,
+    PASS_TRANSPARENT = 1
+};
+
+// Key layout, most significant bits first:
+//   opaque:      pass:2 | shader:8 | material:14 | vao:16 | depth:24   (front to back)
+//   transparent: pass:2 | ~depth:24 | shader:8 | material:14 | vao:16  (back to front)
+// Opaque draws group by state and only use depth to break ties; transparent ones need
+// correct order first and take whatever state changes that costs.
+namespace renderkey {
+    const unsigned int DEPTH_BITS = 24;
+    const uint64_t DEPTH_MAX = (1ull << DEPTH_BITS) - 1;
+
+    uint64_t opaque(unsigned int shader, unsigned int material, unsigned int vao, uint64_t depth) {
+        return (uint64_t) PASS_OPAQUE << 62
+               | (uint64_t) (shader & 0xFF) << 54
+               | (uint64_t) (material & 0x3FFF) << 40
+               | (uint64_t) (vao & 0xFFFF) << 24
+               | depth;
+    }
+
+    uint64_t transparent(unsigned int shader, unsigned int material, unsigned int vao, uint64_t depth) {
+        return (uint64_t) PASS_TRANSPARENT << 62
+               | (DEPTH_MAX - depth) << 38
+               | (uint64_t) (shader & 0xFF) << 30
+               | (uint64_t) (material & 0x3FFF) << 16
+               | (uint64_t) (vao & 0xFFFF);
+    }
+};
+
+struct RenderItem {
+    Shader *shader;
+    Mesh *mesh;
+    const Material *material;
+    glm::mat4 transform;
+    InstanceBuffer *instances;
+};
+
+class RenderQueue {
+public:
+    // view-space depth is quantized over [0, farPlane]
+    void Begin(const glm::mat4 &view, float farPlane) {
+        this->view = view;
+        this->farPlane = farPlane;
+        items.clear();
+        keys.clear();
+    }
+
+    void Submit(Shader &shader, Mesh &mesh, const glm::mat4 &transform, InstanceBuffer *instances = nullptr) {
+        if (instances != nullptr && instances->Count() == 0)
+            return;
+        const Material *material = mesh.material;
+        float distance = -(view * transform[3]).z;
+        uint64_t depth = (uint64_t) (glm::clamp(distance / farPlane, 0.0f, 1.0f) * renderkey::DEPTH_MAX);
+
+        bool transparent = material != nullptr && material->blend;
+        unsigned int materialId = material != nullptr ? material->sortId : 0;
+        SortEntry entry;
+        entry.key = transparent ? renderkey::transparent(shader.ID, materialId, mesh.VAO, depth)
+                                : renderkey::opaque(shader.ID, materialId, mesh.VAO, depth);
+        entry.index = items.size();
+        keys.push_back(entry);
+        items.push_back(RenderItem{&shader, &mesh, material, transform, instances});
+    }
+
+    // the variant for the mesh's material and the frame's lights
+    void Submit(ShaderVariants &variants, Mesh &mesh, const glm::mat4 &transform, InstanceBuffer *instances = nullptr) {
+        Submit(variants.Select(mesh.material), mesh, transform, instances);
+    }
+
+    // Program is a Shader or a ShaderVariants
+    template <typename Program>
+    void Submit(Program &shader, Model &model, const glm::mat4 &transform, InstanceBuffer *instances = nullptr) {
+        if (instances != nullptr && instances->Count() == 0)
+            return;
+        for (Mesh &mesh : model.meshes)
+            Submit(shader, mesh, transform, instances);
+        renderStats().modelMeshes += model.meshes.size();
+        renderStats().modelDrawCalls += model.meshes.size();
+    }
+
+    // LSD radix sort, 8 bits per pass; passes where every key has the same byte are skipped
+    void Sort() {
+        scratch.resize(keys.size());
+        for (unsigned int shift = 0; shift < 64; shift += 8) {
+            unsigned int counts[256] = {0};
+            for (const SortEntry &entry : keys)
+                counts[(entry.key >> shift) & 0xFF]++;
+            if (counts[(keys.empty() ? 0 : keys[0].key >> shift) & 0xFF] == keys.size())
+                continue;
+
+            unsigned int offset = 0;
+            for (unsigned int &count : counts) {
+                unsigned int c = count;
+                count = offset;
+                offset += c;
+            }
+            for (const SortEntry &entry : keys)
+                scratch[counts[(entry.key >> shift) & 0xFF]++] = entry;
+            keys.swap(scratch);
+        }
+    }
+
+    // Walks the sorted items and changes program, render state and textures only when the
+    // key says they differ from the previous item. Leaves blending off and culling on.
+    void Execute() {
+        execute(PASS_OPAQUE, PASS_TRANSPARENT);
+    }
+
+    // only the items of one pass; the deferred path lights the opaque ones before the rest
+    void Execute(RenderPass pass) {
+        execute(pass, pass);
+    }
+
+    // Depth prepass: the opaque items' geometry through depthShader, with their cull state
+    // but no textures. Color writes are the caller's to mask.
+    void ExecuteDepth(Shader &depthShader) {
+        depthShader.use();
+        const Material *currentState = nullptr;
+        for (const SortEntry &entry : keys) {
+            if ((entry.key >> 62) != PASS_OPAQUE)
+                continue;
+            RenderItem &item = items[entry.index];
+            if (item.material != nullptr && item.material != currentState) {
+                item.material->ApplyState(currentState);
+                currentState = item.material;
+            }
+            if (item.instances != nullptr) {
+                item.mesh->DrawGeometry(item.instances);
+            } else {
+                setInstanceTransform(item.transform);
+                item.mesh->DrawGeometry();
+            }
+        }
+        glDisable(GL_BLEND);
+        glEnable(GL_CULL_FACE);
+    }
+
+    unsigned int Size() const { return items.size(); }
+
+private:
+    struct SortEntry {
+        uint64_t key;
+        unsigned int index;
+    };
+
+    glm::mat4 view = glm::mat4(1.0f);
+    float farPlane = 100.0f;
+    std::vector<RenderItem> items;
+    std::vector<SortEntry> keys;
+    std::vector<SortEntry> scratch;
+
+    void execute(RenderPass firstPass, RenderPass lastPass) {
+        Shader *currentShader = nullptr;
+        const Material *currentMaterial = nullptr;
+        const Material *currentState = nullptr;
+        for (const SortEntry &entry : keys) {
+            unsigned int pass = entry.key >> 62;
+            if (pass < (unsigned int) firstPass || pass > (unsigned int) lastPass)
+                continue;
+            RenderItem &item = items[entry.index];
+            if (item.shader != currentShader) {
+                item.shader->use();
+                currentShader = item.shader;
+                // sampler uniforms are per program
+                currentMaterial = nullptr;
+            }
+            if (item.material != currentMaterial && item.material != nullptr) {
+                item.material->ApplyState(currentState);
+                item.material->Bind(*item.shader);
+                currentMaterial = item.material;
+                currentState = item.material;
+            }
+            if (item.material == nullptr)
+                bindTextures(*item.shader, item.mesh->textures, item.mesh->glslIdentifierPrefix);
+
+            if (item.instances != nullptr) {
+                item.mesh->DrawGeometry(item.instances);
+            } else {
+                setInstanceTransform(item.transform);
+                item.mesh->DrawGeometry();
+            }
+        }
+        glDisable(GL_BLEND);
+        glEnable(GL_CULL_FACE);
+        glActiveTexture(GL_TEXTURE0);
+    }
+};
+
+#endif //PROJECT_BASE_RENDERQUEUE_H
@@ -0,0 +1,82 @@
+//
+// Per-frame renderer counters shown in the stats overlay.
+//
+
+#ifndef PROJECT_BASE_RENDERSTATS_H
+#define PROJECT_BASE_RENDERSTATS_H
+
+struct RenderStats {
+    unsigned int drawCalls = 0;
+    unsigned int triangles = 0;
+    // model meshes submitted this frame; the per-mesh Model::Draw path costs one call each
+    unsigned int modelMeshes = 0;
+    unsigned int modelDrawCalls = 0;
+    // scene objects whose world matrix was recomputed
+    unsigned int transformsUpdated = 0;
+    // objects and their triangles rejected by frustum or screen-size culling
+    unsigned int culledObjects = 0;
+    unsigned int culledTriangles = 0;
+    // objects and stress instances hidden behind the CPU-rasterized occluders
+    unsigned int occludedObjects = 0;
+    // cells seen through the portal graph, the outside (sky) included
+    unsigned int visibleCells = 0;
+    // instances handed to the compute culler, and its survivor count as last read back
+    unsigned int gpuInstances = 0;
+    unsigned int gpuVisibleInstances = 0;
+    // models and instances drawn as billboards instead of meshes
+    unsigned int impostors = 0;
+    // point and spot lights binned into clusters, references to them, and the fullest cluster
+    unsigned int lights = 0;
+    unsigned int clusterLightIndices = 0;
+    unsigned int maxClusterLights = 0;
+    // shadow map passes rendered, static and dynamic casters counted apart; 0 when nothing moved
+    unsigned int shadowPasses = 0;
+    // shader variants linked, and those still compiling or queued, over every variant set
+    unsigned int shaderVariants = 0;
+    unsigned int shaderVariantsPending = 0;
+    // size the scene was drawn at before the resolve scaled it to the window
+    unsigned int renderWidth = 0;
+    unsigned int renderHeight = 0;
+
+    float cpuFrameMs = 0.0f;
+    // scene passes as timed on the GPU, a few frames old; kept until a newer result arrives
+    float gpuSceneMs = 0.0f;
+    // bloom downsample and upsample chain, timed the same way
+    float gpuBloomMs = 0.0f;
+    // occluder rasterization and depth pyramid build
+    float occlusionMs = 0.0f;
+
+    void BeginFrame() {
+        drawCalls = 0;
+        triangles = 0;
+        modelMeshes = 0;
+        modelDrawCalls = 0;
+        transformsUpdated = 0;
+        culledObjects = 0;
+        culledTriangles = 0;
+        occludedObjects = 0;
+        visibleCells = 0;
+        gpuInstances = 0;
+        gpuVisibleInstances = 0;
+        impostors = 0;
+        lights = 0;
+        clusterLightIndices = 0;
+        maxClusterLights = 0;
+        shadowPasses = 0;
+        shaderVariants = 0;
+        shaderVariantsPending = 0;
+        occlusionMs = 0.0f;
+    }
+
+    void AddDraw(unsigned int indexCount, unsigned int instances = 1) {
+        ++drawCalls;
+        triangles += indexCount / 3 * instances;
+    }
+};
+
+inline RenderStats& renderStats() {
+    static RenderStats stats;
+    return stats;
+}
+
+#endif //PROJECT_BASE_RENDERSTATS_H
@@ -0,0 +1,132 @@
+//
+// Transforms of the scene objects as parallel arrays, recomputed only when something changed.
+//
+
+#ifndef PROJECT_BASE_SCENE_H
+#define PROJECT_BASE_SCENE_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <rg/Bounds.h>
+
+#include <algorithm>
+#include <vector>
+
+const unsigned int SCENE_NO_PARENT = ~0u;
+
+class SceneStore {
+public:
+    // A parent has to exist before its children, so ascending index order is always a
+    // valid parent-first update order.
+    unsigned int Create(const glm::vec3 &position, const glm::quat &rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f),
+                        const glm::vec3 &scale = glm::vec3(1.0f), unsigned int parent = SCENE_NO_PARENT) {
+        unsigned int object = positions.size();
+        positions.push_back(position);
+        rotations.push_back(rotation);
+        scales.push_back(scale);
+        parents.push_back(parent);
+        firstChild.push_back(SCENE_NO_PARENT);
+        nextSibling.push_back(SCENE_NO_PARENT);
+        if (parent != SCENE_NO_PARENT) {
+            nextSibling[object] = firstChild[parent];
+            firstChild[parent] = object;
+        }
+        worlds.push_back(glm::mat4(1.0f));
+        localBounds.push_back(AABB());
+        worldBounds.push_back(AABB());
+        dirty.push_back(0);
+        markDirty(object);
+        return object;
+    }
+
+    void SetPosition(unsigned int object, const glm::vec3 &position) {
+        positions[object] = position;
+        markDirty(object);
+    }
+
+    void SetRotation(unsigned int object, const glm::quat &rotation) {
+        rotations[object] = rotation;
+        markDirty(object);
+    }
+
+    void SetScale(unsigned int object, const glm::vec3 &scale) {
+        scales[object] = scale;
+        markDirty(object);
+    }
+
+    // bounds in the object's own space; WorldBounds follows the transform
+    void SetLocalBounds(unsigned int object, const AABB &bounds) {
+        localBounds[object] = bounds;
+        markDirty(object);
+    }
+
+    const glm::vec3 &Position(unsigned int object) const { return positions[object]; }
+    const glm::quat &Rotation(unsigned int object) const { return rotations[object]; }
+    const glm::vec3 &Scale(unsigned int object) const { return scales[object]; }
+    unsigned int Parent(unsigned int object) const { return parents[object]; }
+    const glm::mat4 &World(unsigned int object) const { return worlds[object]; }
+    const AABB &LocalBounds(unsigned int object) const { return localBounds[object]; }
+    const AABB &WorldBounds(unsigned int object) const { return worldBounds[object]; }
+    unsigned int Size() const { return positions.size(); }
+
+    // Recomputes world matrices and bounds of the objects changed since the last call plus
+    // their descendants, parents first. Costs nothing when nothing moved.
+    void Update() {
+        changed.clear();
+        if (dirtyList.empty())
+            return;
+
+        // the list grows while it is walked, so grandchildren are reached too
+        for (unsigned int i = 0; i < dirtyList.size(); i++)
+            for (unsigned int child = firstChild[dirtyList[i]]; child != SCENE_NO_PARENT; child = nextSibling[child])
+                markDirty(child);
+        std::sort(dirtyList.begin(), dirtyList.end());
+
+        for (unsigned int object : dirtyList) {
+            glm::mat3 rotation = glm::mat3_cast(rotations[object]);
+            const glm::vec3 &scale = scales[object];
+            glm::mat4 local;
+            local[0] = glm::vec4(rotation[0] * scale.x, 0.0f);
+            local[1] = glm::vec4(rotation[1] * scale.y, 0.0f);
+            local[2] = glm::vec4(rotation[2] * scale.z, 0.0f);
+            local[3] = glm::vec4(positions[object], 1.0f);
+
+            unsigned int parent = parents[object];
+            worlds[object] = parent == SCENE_NO_PARENT ? local : worlds[parent] * local;
+            worldBounds[object] = transformAABB(localBounds[object], worlds[object]);
+            dirty[object] = 0;
+        }
+        changed.swap(dirtyList);
+        dirtyList.clear();
+    }
+
+    // objects whose world matrix was recomputed by the last Update, in index order
+    const std::vector<unsigned int> &Changed() const { return changed; }
+
+private:
+    std::vector<glm::vec3> positions;
+    std::vector<glm::quat> rotations;
+    std::vector<glm::vec3> scales;
+    std::vector<unsigned int> parents;
+    // children as intrusive singly linked lists, for propagating dirty flags down
+    std::vector<unsigned int> firstChild;
+    std::vector<unsigned int> nextSibling;
+
+    std::vector<glm::mat4> worlds;
+    std::vector<AABB> localBounds;
+    std::vector<AABB> worldBounds;
+
+    std::vector<unsigned char> dirty;
+    std::vector<unsigned int> dirtyList;
+    std::vector<unsigned int> changed;
+
+    void markDirty(unsigned int object) {
+        if (dirty[object])
+            return;
+        dirty[object] = 1;
+        dirtyList.push_back(object);
+    }
+};
+
+#endif //PROJECT_BASE_SCENE_H
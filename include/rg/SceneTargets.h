@@ -0,0 +1,199 @@
+//
+// Offscreen targets the scene is drawn into: the HDR color buffer, the G-buffer and their depth.
+//
+
+#ifndef PROJECT_BASE_SCENETARGETS_H
+#define PROJECT_BASE_SCENETARGETS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <iostream>
+
+// Storage of the HDR color buffer. Nothing reads its alpha, so the packed float formats lose
+// only precision: 6 and 5 bits of mantissa per channel for R11F_G11F_B10F, 9 bits with a
+// shared exponent for RGB9_E5, against 10 bits and an alpha for RGBA16F, at half the bytes
+// every pass that writes or reads the buffer moves. Both are unsigned, which lighting is.
+enum SceneColorFormat {
+    SCENE_COLOR_RGBA16F,
+    SCENE_COLOR_R11F_G11F_B10F,
+    // core GL only requires it as a texture; renderable where the driver says so
+    SCENE_COLOR_RGB9_E5,
+    SCENE_COLOR_FORMAT_COUNT
+};
+
+const char *sceneColorFormatName(SceneColorFormat format) {
+    static const char *names[SCENE_COLOR_FORMAT_COUNT] = {"RGBA16F", "R11F_G11F_B10F", "RGB9_E5"};
+    return names[format];
+}
+
+unsigned int sceneColorFormatBytes(SceneColorFormat format) {
+    return format == SCENE_COLOR_RGBA16F ? 8 : 4;
+}
+
+GLint sceneColorInternalFormat(SceneColorFormat format) {
+    static const GLint formats[SCENE_COLOR_FORMAT_COUNT] = {GL_RGBA16F, GL_R11F_G11F_B10F, GL_RGB9_E5};
+    return formats[format];
+}
+
+// Allocated at the window's size and reallocated when it changes. The scene may cover only
+// the lower-left RenderWidth x RenderHeight of them, a fraction of the window picked by the
+// render scale; the resolve stretches that part over the window. Changing the scale does
+// not touch the storage, so it can move every few frames without reallocating anything.
+class SceneTargets {
+public:
+    void Create(int width, int height) {
+        glGenFramebuffers(1, &hdrFramebuffer);
+        glGenFramebuffers(1, &gBufferFramebuffer);
+        glGenTextures(1, &colorBuffer);
+        glGenTextures(1, &depthTexture);
+        glGenTextures(1, &gAlbedoSpecular);
+        glGenTextures(1, &gNormal);
+        probeColorFormats();
+        // color is read with bilinear taps by the upsampling resolve, the rest texel by texel
+        setFilter(colorBuffer, GL_LINEAR);
+        setFilter(depthTexture, GL_NEAREST);
+        setFilter(gAlbedoSpecular, GL_NEAREST);
+        setFilter(gNormal, GL_NEAREST);
+        allocate(width, height);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, hdrFramebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorBuffer, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "Framebuffer not complete!" << std::endl;
+
+        // 8 bytes of color per pixel; the depth is hdrFramebuffer's, so everything drawn
+        // forward after the lighting pass tests against it
+        glBindFramebuffer(GL_FRAMEBUFFER, gBufferFramebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gAlbedoSpecular, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, gNormal, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+        unsigned int attachments[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+        glDrawBuffers(2, attachments);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "G-buffer not complete!" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // New storage for the same texture names, so the attachments stay as they are. A
+    // minimized window reports 0 x 0; the old targets are kept until it comes back.
+    void Resize(int width, int height) {
+        if (width <= 0 || height <= 0 || (width == this->width && height == this->height))
+            return;
+        allocate(width, height);
+    }
+
+    // New storage for the color buffer only. Returns false, keeping the current format, when
+    // the driver cannot render to the requested one.
+    bool SetColorFormat(SceneColorFormat format) {
+        if (!colorFormatSupported[format])
+            return false;
+        if (format != colorFormat) {
+            colorFormat = format;
+            allocateColor();
+        }
+        return true;
+    }
+
+    SceneColorFormat ColorFormat() const { return colorFormat; }
+    bool ColorFormatSupported(SceneColorFormat format) const { return colorFormatSupported[format]; }
+
+    // the part of the targets the scene is drawn into, at least a pixel either way
+    void SetRenderScale(float scale) {
+        renderScale = scale;
+        renderWidth = std::max(1, std::min(width, (int) (width * scale + 0.5f)));
+        renderHeight = std::max(1, std::min(height, (int) (height * scale + 0.5f)));
+    }
+
+    void Delete() {
+        glDeleteFramebuffers(1, &hdrFramebuffer);
+        glDeleteFramebuffers(1, &gBufferFramebuffer);
+        unsigned int textures[4] = {colorBuffer, depthTexture, gAlbedoSpecular, gNormal};
+        glDeleteTextures(4, textures);
+        hdrFramebuffer = gBufferFramebuffer = 0;
+        colorBuffer = depthTexture = gAlbedoSpecular = gNormal = 0;
+    }
+
+    unsigned int HdrFramebuffer() const { return hdrFramebuffer; }
+    unsigned int GBufferFramebuffer() const { return gBufferFramebuffer; }
+    unsigned int ColorBuffer() const { return colorBuffer; }
+    // a texture rather than a renderbuffer, the Hi-Z pyramid and deferred lighting read it
+    unsigned int DepthTexture() const { return depthTexture; }
+    unsigned int GAlbedoSpecular() const { return gAlbedoSpecular; }
+    unsigned int GNormal() const { return gNormal; }
+
+    int Width() const { return width; }
+    int Height() const { return height; }
+    int RenderWidth() const { return renderWidth; }
+    int RenderHeight() const { return renderHeight; }
+    glm::vec2 RenderSize() const { return glm::vec2(renderWidth, renderHeight); }
+
+private:
+    unsigned int hdrFramebuffer = 0, gBufferFramebuffer = 0;
+    unsigned int colorBuffer = 0, depthTexture = 0;
+    unsigned int gAlbedoSpecular = 0, gNormal = 0;
+    int width = 0, height = 0;
+    int renderWidth = 0, renderHeight = 0;
+    float renderScale = 1.0f;
+    SceneColorFormat colorFormat = SCENE_COLOR_RGBA16F;
+    bool colorFormatSupported[SCENE_COLOR_FORMAT_COUNT] = {false};
+
+    void allocate(int width, int height) {
+        this->width = width;
+        this->height = height;
+        allocateColor();
+        glBindTexture(GL_TEXTURE_2D, depthTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        glBindTexture(GL_TEXTURE_2D, gAlbedoSpecular);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8_ALPHA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glBindTexture(GL_TEXTURE_2D, gNormal);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, width, height, 0, GL_RG, GL_FLOAT, NULL);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        SetRenderScale(renderScale);
+    }
+
+    void allocateColor() {
+        glBindTexture(GL_TEXTURE_2D, colorBuffer);
+        glTexImage2D(GL_TEXTURE_2D, 0, sceneColorInternalFormat(colorFormat), width, height, 0, GL_RGB, GL_FLOAT, NULL);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // Renderability is up to the driver for some of them, so each gets a small framebuffer
+    // of its own and whatever comes back complete is offered.
+    void probeColorFormats() {
+        unsigned int texture, framebuffer;
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        // errors left over from before would read as a failed probe
+        while (glGetError() != GL_NO_ERROR)
+            ;
+        for (int format = 0; format < SCENE_COLOR_FORMAT_COUNT; format++) {
+            glGenTextures(1, &texture);
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glTexImage2D(GL_TEXTURE_2D, 0, sceneColorInternalFormat((SceneColorFormat) format), 4, 4, 0,
+                         GL_RGB, GL_FLOAT, NULL);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+            colorFormatSupported[format] = glGetError() == GL_NO_ERROR
+                                           && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+            glDeleteTextures(1, &texture);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(1, &framebuffer);
+        // required color-renderable in core 3.3, whatever the probe said
+        colorFormatSupported[SCENE_COLOR_RGBA16F] = true;
+    }
+
+    static void setFilter(unsigned int texture, GLint filter) {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+        // the upsampling taps at the edge of the window must not wrap to the other side
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+};
+
+#endif //PROJECT_BASE_SCENETARGETS_H
@@ -0,0 +1,275 @@
+//
+// One vertex/fragment pair compiled into a program per combination of #ifdef'd features.
+//
+
+#ifndef PROJECT_BASE_SHADERVARIANTS_H
+#define PROJECT_BASE_SHADERVARIANTS_H
+
+#include <glad/glad.h>
+
+#include <common.h>
+#include <learnopengl/shader.h>
+#include <rg/GLExt.h>
+#include <rg/Material.h>
+
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// One bit per feature, the same in every ShaderVariants, so the frame's light bits and a
+// material's bits can simply be or'ed together. A set bit becomes #define <name> in the
+// source; without it the code behind the #ifdef is not compiled at all.
+enum ShaderFeature {
+    // point and spot lights in the clusters; the directional light is always evaluated
+    FEATURE_CLUSTERED_LIGHTS = 1 << 0,
+    // shadow map lookups for the lights that have a map
+    FEATURE_SHADOWS = 1 << 1,
+    // the material has a texture_specular1; without one the specular term is dropped
+    FEATURE_SPECULAR_MAP = 1 << 2,
+};
+
+const unsigned int SHADER_FEATURE_COUNT = 3;
+
+// the bits that say what a material has rather than how much work to do; a variant with one
+// of them set reads textures the material may not have bound
+const unsigned int MATERIAL_FEATURES = FEATURE_SPECULAR_MAP;
+
+const char *shaderFeatureName(unsigned int bit) {
+    static const char *names[SHADER_FEATURE_COUNT] = {
+            "CLUSTERED_LIGHTS", "SHADOWS", "SPECULAR_MAP"
+    };
+    return names[bit];
+}
+
+// the bits a material decides; nullptr for draws without one
+unsigned int materialFeatures(const Material *material) {
+    unsigned int features = 0;
+    if (material != nullptr && material->HasRole(TEXTURE_SPECULAR))
+        features |= FEATURE_SPECULAR_MAP;
+    return features;
+}
+
+// Variants are compiled the first time they are asked for, not up front. Until one is ready
+// the draw gets a fallback instead: the variant with every supported light feature and the
+// material's own bits, compiled in the constructor for each combination of material bits. It
+// shades anything the others can (a light list that happens to be empty, a light without a
+// shadow map) just without skipping the work, and never samples a texture the material lacks,
+// which would read whatever is left on that unit. With parallel shader compile the driver
+// builds the new program on its own threads and Update only polls it; without, Update
+// compiles one queued variant per frame, so a new combination costs at most one hitch
+// instead of one per draw.
+class ShaderVariants {
+public:
+    // supported: the features the two files have #ifdefs for, the rest are ignored
+    ShaderVariants(const std::string &vertexPath, const std::string &fragmentPath, unsigned int supported)
+        : vertexPath(vertexPath), fragmentPath(fragmentPath), supported(supported) {
+        vertexSource = expandIncludes(readFileContents(vertexPath), vertexPath);
+        fragmentSource = expandIncludes(readFileContents(fragmentPath), fragmentPath);
+        // all started before any is finished, so parallel compile builds them side by side
+        for (unsigned int features = 0; features < VARIANT_COUNT; features++)
+            if (isFallback(features))
+                start(features);
+        for (unsigned int features = 0; features < VARIANT_COUNT; features++)
+            if (isFallback(features))
+                finish(features);
+    }
+
+    // Runs on every variant once it has linked, with the program in use; for the uniforms
+    // that never change, like sampler units. Variants that are already there get it now.
+    void SetInitializer(const std::function<void(Shader &)> &initializer) {
+        this->initializer = initializer;
+        ForEachReady(initializer);
+    }
+
+    // the light features of this frame, or'ed into every Select
+    void SetFrameFeatures(unsigned int features) {
+        frameFeatures = features;
+    }
+
+    // the variant for these features if it is ready, the fallback while it is not
+    Shader &Get(unsigned int features) {
+        features &= supported;
+        Request(features);
+        Variant &variant = variants[features];
+        return variant.state == READY ? *variant.shader : *variants[fallbackFor(features)].shader;
+    }
+
+    // starts on a variant without drawing with it, for the ones sure to be needed soon
+    void Request(unsigned int features) {
+        features &= supported;
+        Variant &variant = variants[features];
+        if (variant.state != NONE)
+            return;
+        variant.state = QUEUED;
+        if (rg::glCaps().parallelShaderCompile)
+            start(features);
+        else
+            queue.push_back(features);
+    }
+
+    // frame features plus the material's; the per-draw selection
+    Shader &Select(const Material *material = nullptr) {
+        return Get(frameFeatures | materialFeatures(material));
+    }
+
+    // Once per frame, before drawing: picks up variants the driver has finished, or
+    // compiles the next queued one when it cannot do that in the background.
+    void Update() {
+        if (rg::glCaps().parallelShaderCompile) {
+            for (unsigned int features = 0; features < VARIANT_COUNT; features++) {
+                if (variants[features].state != COMPILING)
+                    continue;
+                GLint done = GL_FALSE;
+                glGetProgramiv(variants[features].program, GL_COMPLETION_STATUS_KHR, &done);
+                if (done)
+                    finish(features);
+            }
+        } else if (!queue.empty()) {
+            unsigned int features = queue.front();
+            queue.erase(queue.begin());
+            start(features);
+            finish(features);
+        }
+    }
+
+    // f(shader) for every ready variant, with its program in use; for the frame's uniforms
+    template <typename F>
+    void ForEachReady(F f) {
+        for (Variant &variant : variants)
+            if (variant.state == READY) {
+                variant.shader->use();
+                f(*variant.shader);
+            }
+    }
+
+    unsigned int ReadyCount() const { return countState(READY); }
+    unsigned int PendingCount() const { return countState(QUEUED) + countState(COMPILING); }
+
+    void Delete() {
+        for (Variant &variant : variants) {
+            if (variant.program != 0) {
+                Material::ForgetProgram(variant.program);
+                glDeleteProgram(variant.program);
+            }
+            variant = Variant();
+        }
+        queue.clear();
+    }
+
+private:
+    static const unsigned int VARIANT_COUNT = 1 << SHADER_FEATURE_COUNT;
+
+    enum State { NONE, QUEUED, COMPILING, READY, FAILED };
+
+    struct Variant {
+        State state = NONE;
+        GLuint program = 0;
+        GLuint vertex = 0, fragment = 0;
+        std::unique_ptr<Shader> shader;
+    };
+
+    std::string vertexPath, fragmentPath;
+    std::string vertexSource, fragmentSource;
+    unsigned int supported;
+    unsigned int frameFeatures = 0;
+    Variant variants[VARIANT_COUNT];
+    // compiled one per Update when the driver cannot do it in the background
+    std::vector<unsigned int> queue;
+    std::function<void(Shader &)> initializer;
+
+    unsigned int fallbackFor(unsigned int features) const {
+        return (supported & ~MATERIAL_FEATURES) | (features & MATERIAL_FEATURES);
+    }
+
+    bool isFallback(unsigned int features) const {
+        return (features & ~supported) == 0 && fallbackFor(features) == features;
+    }
+
+    // issues the compile and link without asking how they went, which is what would wait
+    void start(unsigned int features) {
+        std::vector<std::string> defines;
+        for (unsigned int bit = 0; bit < SHADER_FEATURE_COUNT; bit++)
+            if (features & (1u << bit))
+                defines.push_back(shaderFeatureName(bit));
+        std::string vertexCode = insertDefines(vertexSource, defines);
+        std::string fragmentCode = insertDefines(fragmentSource, defines);
+        const char *vertexText = vertexCode.c_str();
+        const char *fragmentText = fragmentCode.c_str();
+
+        Variant &variant = variants[features];
+        variant.vertex = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(variant.vertex, 1, &vertexText, NULL);
+        glCompileShader(variant.vertex);
+        variant.fragment = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(variant.fragment, 1, &fragmentText, NULL);
+        glCompileShader(variant.fragment);
+        variant.program = glCreateProgram();
+        glAttachShader(variant.program, variant.vertex);
+        glAttachShader(variant.program, variant.fragment);
+        glLinkProgram(variant.program);
+        variant.state = COMPILING;
+    }
+
+    // A failed variant keeps drawing with the fallback. Its program stays around until Delete,
+    // so no later program gets its name, and with it the sampler units Material cached for it.
+    // A failed fallback is kept anyway, broken, the way Shader keeps a program that did not link.
+    void finish(unsigned int features) {
+        Variant &variant = variants[features];
+        // not short-circuited, every log gets printed
+        bool linked = checkErrors(variant.vertex, false, vertexPath, features)
+                      & checkErrors(variant.fragment, false, fragmentPath, features)
+                      & checkErrors(variant.program, true, vertexPath + " + " + fragmentPath, features);
+        glDeleteShader(variant.vertex);
+        glDeleteShader(variant.fragment);
+        variant.vertex = variant.fragment = 0;
+        if (!linked && !isFallback(features)) {
+            variant.state = FAILED;
+            return;
+        }
+        variant.shader.reset(new Shader(variant.program));
+        variant.state = READY;
+        if (initializer) {
+            variant.shader->use();
+            initializer(*variant.shader);
+        }
+    }
+
+    bool checkErrors(GLuint object, bool program, const std::string &name, unsigned int features) const {
+        GLint success;
+        GLchar infoLog[1024];
+        if (program) {
+            glGetProgramiv(object, GL_LINK_STATUS, &success);
+            if (!success)
+                glGetProgramInfoLog(object, 1024, NULL, infoLog);
+        } else {
+            glGetShaderiv(object, GL_COMPILE_STATUS, &success);
+            if (!success)
+                glGetShaderInfoLog(object, 1024, NULL, infoLog);
+        }
+        if (!success)
+            std::cout << "ERROR::SHADER_VARIANT " << name
+                      << " features 0x" << std::hex << features << std::dec << "\n" << infoLog
+                      << "\n -- --------------------------------------------------- -- " << std::endl;
+        return success;
+    }
+
+    unsigned int countState(State state) const {
+        unsigned int count = 0;
+        for (const Variant &variant : variants)
+            count += variant.state == state ? 1 : 0;
+        return count;
+    }
+};
+
+// lets the batches and the render queue take a plain program or a variant set alike
+Shader &shaderFor(Shader &shader, const Material *) {
+    return shader;
+}
+
+Shader &shaderFor(ShaderVariants &variants, const Material *material) {
+    return variants.Select(material);
+}
+
+#endif //PROJECT_BASE_SHADERVARIANTS_H
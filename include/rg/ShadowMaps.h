@@ -0,0 +1,300 @@
+//
+// Depth maps for the spot and point light, with the static casters cached apart from the moving ones.
+//
+
+#ifndef PROJECT_BASE_SHADOWMAPS_H
+#define PROJECT_BASE_SHADOWMAPS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <learnopengl/mesh.h>
+#include <learnopengl/shader.h>
+#include <rg/Bounds.h>
+#include <rg/Frustum.h>
+#include <rg/InstanceBuffer.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// units of the two maps, after the clustered light buffers
+const unsigned int SPOT_SHADOW_UNIT = 15;
+const unsigned int POINT_SHADOW_UNIT = 16;
+
+const float SHADOW_NEAR_PLANE = 0.1f;
+// The cone of this scene's spot is wider than any useful projection; the field of view is
+// capped here and the rim outside it stays unshadowed.
+const float SPOT_SHADOW_MAX_FOV = 150.0f;
+
+// a mesh drawn into a shadow map, at transform or once per instance
+struct ShadowCaster {
+    Mesh *mesh;
+    glm::mat4 transform;
+    InstanceBuffer *instances;
+};
+
+void drawShadowCasters(const std::vector<ShadowCaster> &casters) {
+    for (const ShadowCaster &caster : casters) {
+        if (caster.instances != nullptr) {
+            caster.mesh->DrawGeometry(caster.instances);
+        } else {
+            setInstanceTransform(caster.transform);
+            caster.mesh->DrawGeometry();
+        }
+    }
+}
+
+// Two depth textures of the same shape: one holding only the static casters, rendered when
+// the light itself changes, and the one that is sampled, which starts as a copy of the first
+// with the dynamic casters drawn over it. The copy and the dynamic draws only happen after
+// something moved inside the light's volume. Sampled with depth comparison on, so every
+// tap is already bilinearly filtered.
+class ShadowMap {
+public:
+    // target is GL_TEXTURE_2D for a spot light, GL_TEXTURE_CUBE_MAP for a point light
+    void Create(GLenum target, unsigned int size) {
+        this->target = target;
+        this->size = size;
+        staticDepth = createDepth(false);
+        depth = createDepth(true);
+        glGenFramebuffers(1, &staticFBO);
+        glGenFramebuffers(1, &FBO);
+        attach(staticFBO, staticDepth, -1);
+        attach(FBO, depth, -1);
+        staticDirty = true;
+    }
+
+    // statics have to be drawn again: the light moved, or a caster left the static set
+    void InvalidateStatic() { staticDirty = true; }
+
+    // a dynamic caster moved; only matters when it was or is inside the light's volume
+    void CasterMoved(const AABB &before, const AABB &after) {
+        if (Affects(before) || Affects(after))
+            dynamicDirty = true;
+    }
+
+    virtual bool Affects(const AABB &bounds) const = 0;
+
+    // Renders whatever is out of date. shader is the depth program for this kind of map and
+    // gets its light uniforms from setDepthUniforms. Returns the number of passes it took.
+    unsigned int Render(Shader &shader, const std::vector<ShadowCaster> &statics,
+                        const std::vector<ShadowCaster> &dynamics) {
+        if (!staticDirty && !dynamicDirty)
+            return 0;
+        GLint previousFBO;
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFBO);
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+
+        shader.use();
+        setDepthUniforms(shader);
+        glViewport(0, 0, size, size);
+        // both sides, the room's walls and glass are single sheets
+        glDisable(GL_CULL_FACE);
+
+        unsigned int passes = 0;
+        if (staticDirty) {
+            glBindFramebuffer(GL_FRAMEBUFFER, staticFBO);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            drawShadowCasters(statics);
+            staticDirty = false;
+            dynamicDirty = true;
+            passes++;
+        }
+        if (dynamicDirty) {
+            copyStatic();
+            glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+            drawShadowCasters(dynamics);
+            dynamicDirty = false;
+            passes++;
+        }
+
+        glEnable(GL_CULL_FACE);
+        glBindFramebuffer(GL_FRAMEBUFFER, previousFBO);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        return passes;
+    }
+
+    void Bind(unsigned int unit) const {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(target, depth);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    void Delete() {
+        glDeleteFramebuffers(1, &staticFBO);
+        glDeleteFramebuffers(1, &FBO);
+        glDeleteTextures(1, &staticDepth);
+        glDeleteTextures(1, &depth);
+    }
+
+    virtual ~ShadowMap() = default;
+
+protected:
+    GLenum target = GL_TEXTURE_2D;
+    unsigned int size = 1024;
+    bool staticDirty = true;
+    bool dynamicDirty = true;
+
+    virtual void setDepthUniforms(Shader &shader) const = 0;
+
+private:
+    GLuint staticDepth = 0, depth = 0;
+    GLuint staticFBO = 0, FBO = 0;
+
+    GLuint createDepth(bool compare) {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(target, texture);
+        if (target == GL_TEXTURE_CUBE_MAP) {
+            for (unsigned int face = 0; face < 6; face++)
+                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_DEPTH_COMPONENT24, size, size, 0,
+                             GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+            glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        } else {
+            glTexImage2D(target, 0, GL_DEPTH_COMPONENT24, size, size, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+            // outside the map is outside the spot's cone: lit
+            float border[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+            glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+            glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+            glTexParameterfv(target, GL_TEXTURE_BORDER_COLOR, border);
+        }
+        GLint filter = compare ? GL_LINEAR : GL_NEAREST;
+        glTexParameteri(target, GL_TEXTURE_MIN_FILTER, filter);
+        glTexParameteri(target, GL_TEXTURE_MAG_FILTER, filter);
+        if (compare) {
+            glTexParameteri(target, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+            glTexParameteri(target, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        }
+        glBindTexture(target, 0);
+        return texture;
+    }
+
+    // face < 0 attaches the whole texture, layered for a cube map
+    void attach(GLuint fbo, GLuint texture, int face) {
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        if (face < 0)
+            glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0);
+        else
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, texture, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // a blit only copies the first layer of a layered attachment, so cube maps go face by face
+    void copyStatic() {
+        unsigned int faces = target == GL_TEXTURE_CUBE_MAP ? 6 : 1;
+        for (unsigned int face = 0; face < faces; face++) {
+            if (faces > 1) {
+                attach(staticFBO, staticDepth, face);
+                attach(FBO, depth, face);
+            }
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, staticFBO);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, FBO);
+            glBlitFramebuffer(0, 0, size, size, 0, 0, size, size, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        }
+        if (faces > 1) {
+            attach(staticFBO, staticDepth, -1);
+            attach(FBO, depth, -1);
+        }
+    }
+};
+
+// perspective map along the spot's axis, as wide as the cone up to SPOT_SHADOW_MAX_FOV
+class SpotShadowMap : public ShadowMap {
+public:
+    // outerCutOff is the cosine of the cone's half angle, range how far the light reaches
+    void SetLight(const glm::vec3 &position, const glm::vec3 &direction, float outerCutOff, float range) {
+        float fov = std::min(2.0f * glm::degrees(std::acos(glm::clamp(outerCutOff, -1.0f, 1.0f))), SPOT_SHADOW_MAX_FOV);
+        glm::vec3 axis = glm::normalize(direction);
+        glm::vec3 up = std::fabs(axis.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        glm::mat4 viewProjection = glm::perspective(glm::radians(fov), 1.0f, SHADOW_NEAR_PLANE,
+                                                     std::max(range, 2.0f * SHADOW_NEAR_PLANE))
+                                   * glm::lookAt(position, position + axis, up);
+        if (viewProjection != lightViewProjection) {
+            lightViewProjection = viewProjection;
+            frustum = extractFrustum(viewProjection);
+            staticDirty = true;
+        }
+    }
+
+    bool Affects(const AABB &bounds) const override {
+        return intersects(frustum, bounds);
+    }
+
+    // world to shadow map texture coordinates and depth
+    glm::mat4 ShadowMatrix() const {
+        glm::mat4 bias = glm::translate(glm::mat4(1.0f), glm::vec3(0.5f)) * glm::scale(glm::mat4(1.0f), glm::vec3(0.5f));
+        return bias * lightViewProjection;
+    }
+
+    // what clustered_lights.glsl samples the map with, bound at SPOT_SHADOW_UNIT
+    void SetUniforms(Shader &shader) const {
+        shader.setInt("spotShadowMap", SPOT_SHADOW_UNIT);
+        shader.setMat4("spotShadowMatrix", ShadowMatrix());
+    }
+
+protected:
+    void setDepthUniforms(Shader &shader) const override {
+        shader.setMat4("lightViewProjection", lightViewProjection);
+    }
+
+private:
+    glm::mat4 lightViewProjection = glm::mat4(0.0f);
+    Frustum frustum;
+};
+
+// All six faces in one pass: the geometry shader sends each triangle to every layer. Depth
+// is the distance to the light over the far plane, so lookups compare distances directly.
+class PointShadowMap : public ShadowMap {
+public:
+    void SetLight(const glm::vec3 &position, float range) {
+        if (position == lightPosition && range == farPlane)
+            return;
+        lightPosition = position;
+        farPlane = range;
+        staticDirty = true;
+    }
+
+    bool Affects(const AABB &bounds) const override {
+        glm::vec3 closest = glm::clamp(lightPosition, bounds.min, bounds.max);
+        return glm::length(closest - lightPosition) <= farPlane;
+    }
+
+    float FarPlane() const { return farPlane; }
+
+    // what clustered_lights.glsl samples the map with, bound at POINT_SHADOW_UNIT
+    void SetUniforms(Shader &shader) const {
+        shader.setInt("pointShadowMap", POINT_SHADOW_UNIT);
+        shader.setFloat("pointShadowFar", farPlane);
+    }
+
+protected:
+    void setDepthUniforms(Shader &shader) const override {
+        static const glm::vec3 directions[6] = {
+                glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f),
+                glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f)
+        };
+        static const glm::vec3 ups[6] = {
+                glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f),
+                glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)
+        };
+        glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, SHADOW_NEAR_PLANE, farPlane);
+        for (unsigned int face = 0; face < 6; face++)
+            shader.setMat4("faceViewProjections[" + std::to_string(face) + "]",
+                           projection * glm::lookAt(lightPosition, lightPosition + directions[face], ups[face]));
+        shader.setVec3("lightPosition", lightPosition);
+        shader.setFloat("farPlane", farPlane);
+    }
+
+private:
+    glm::vec3 lightPosition = glm::vec3(0.0f);
+    float farPlane = 0.0f;
+};
+
+#endif //PROJECT_BASE_SHADOWMAPS_H
@@ -0,0 +1,202 @@
+//
+// Bakes meshes that never move into world space and merges them into one buffer per material.
+//
+
+#ifndef PROJECT_BASE_STATICBATCH_H
+#define PROJECT_BASE_STATICBATCH_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/mesh.h>
+#include <learnopengl/shader.h>
+#include <rg/Lightmap.h>
+#include <rg/Material.h>
+#include <rg/RenderQueue.h>
+#include <rg/TextureArray.h>
+
+#include <memory>
+#include <vector>
+
+class StaticBatcher {
+public:
+    // Registers a copy of mesh at transform. The mesh provides vertices, material and texture
+    // layer and has to outlive the batcher. Returns a handle for Remove and SetLightmapCoords.
+    unsigned int Add(const Mesh &mesh, const glm::mat4 &transform) {
+        unsigned int batch = findOrAddBatch(mesh.material);
+        objects.push_back(Object{&mesh, transform, batch, true, {}});
+        batches[batch].dirty = true;
+        return objects.size() - 1;
+    }
+
+    // Takes an object out of the static set, e.g. once it starts moving; the caller draws it
+    // on its own from then on. Only the batch it was in gets rebuilt on the next Build.
+    void Remove(unsigned int object) {
+        if (!objects[object].active)
+            return;
+        objects[object].active = false;
+        batches[objects[object].batch].dirty = true;
+    }
+
+    bool Contains(unsigned int object) const { return objects[object].active; }
+
+    // Lightmap coordinates for the object's vertices, in mesh vertex order, streamed at
+    // LIGHTMAP_COORDS_LOCATION. Objects in the same batch without any read (0, 0).
+    void SetLightmapCoords(unsigned int object, const std::vector<glm::vec2> &coords) {
+        objects[object].lightmapCoords = coords;
+        batches[objects[object].batch].dirty = true;
+    }
+
+    // rebuilds the batches that changed since the last call
+    void Build() {
+        for (Batch &batch : batches)
+            if (batch.dirty)
+                rebuild(batch);
+    }
+
+    // One queue item per non-empty batch; vertices are already in world space. Program is a
+    // Shader or a ShaderVariants, here and below.
+    template <typename Program>
+    void Submit(RenderQueue &queue, Program &shader) {
+        for (Batch &batch : batches)
+            if (batch.mesh)
+                queue.Submit(shader, *batch.mesh, glm::mat4(1.0f));
+    }
+
+    // blended batches get their own program, for passes that cannot draw them with the rest
+    template <typename OpaqueProgram, typename BlendedProgram>
+    void Submit(RenderQueue &queue, OpaqueProgram &opaqueShader, BlendedProgram &blendedShader) {
+        for (Batch &batch : batches) {
+            if (!batch.mesh)
+                continue;
+            if (batch.mesh->material != nullptr && batch.mesh->material->blend)
+                queue.Submit(blendedShader, *batch.mesh, glm::mat4(1.0f));
+            else
+                queue.Submit(opaqueShader, *batch.mesh, glm::mat4(1.0f));
+        }
+    }
+
+    unsigned int BatchCount() const {
+        unsigned int count = 0;
+        for (const Batch &batch : batches)
+            count += batch.mesh ? 1 : 0;
+        return count;
+    }
+
+    void Delete() {
+        for (Batch &batch : batches)
+            release(batch);
+    }
+
+private:
+    struct Object {
+        const Mesh *mesh;
+        glm::mat4 transform;
+        unsigned int batch;
+        bool active;
+        std::vector<glm::vec2> lightmapCoords;
+    };
+
+    struct Batch {
+        Material *material;
+        std::unique_ptr<Mesh> mesh;
+        // per-vertex texture array layer at TEXTURE_LAYER_LOCATION
+        unsigned int layerBuffer = 0;
+        // per-vertex lightmap coordinates, when any object of the batch has them
+        unsigned int lightmapBuffer = 0;
+        bool dirty = true;
+    };
+
+    std::vector<Object> objects;
+    std::vector<Batch> batches;
+
+    unsigned int findOrAddBatch(Material *material) {
+        for (unsigned int i = 0; i < batches.size(); i++)
+            if (batches[i].material == material)
+                return i;
+        batches.push_back(Batch());
+        batches.back().material = material;
+        return batches.size() - 1;
+    }
+
+    void rebuild(Batch &batch) {
+        release(batch);
+        batch.dirty = false;
+
+        unsigned int index = &batch - batches.data();
+        vector<Vertex> vertices;
+        vector<unsigned int> indices;
+        vector<float> layers;
+        vector<glm::vec2> lightmapCoords;
+        bool lightmapped = false;
+        for (const Object &object : objects) {
+            if (!object.active || object.batch != index)
+                continue;
+            glm::mat3 linear = glm::mat3(object.transform);
+            // cofactor matrix: transforms normals like the inverse transpose, but stays valid
+            // for the flattened (zero scale) floor and glass
+            glm::mat3 normalMatrix(glm::cross(linear[1], linear[2]),
+                                   glm::cross(linear[2], linear[0]),
+                                   glm::cross(linear[0], linear[1]));
+            float layer = object.mesh->textureLayer >= 0 ? (float) object.mesh->textureLayer : 0.0f;
+
+            unsigned int baseVertex = vertices.size();
+            lightmapped = lightmapped || !object.lightmapCoords.empty();
+            for (unsigned int i = 0; i < object.mesh->vertices.size(); i++)
+                lightmapCoords.push_back(i < object.lightmapCoords.size() ? object.lightmapCoords[i] : glm::vec2(0.0f));
+            for (Vertex vertex : object.mesh->vertices) {
+                vertex.Position = glm::vec3(object.transform * glm::vec4(vertex.Position, 1.0f));
+                vertex.Normal = safeNormalize(normalMatrix * vertex.Normal);
+                vertex.Tangent = safeNormalize(linear * vertex.Tangent);
+                vertex.Bitangent = safeNormalize(linear * vertex.Bitangent);
+                vertices.push_back(vertex);
+                layers.push_back(layer);
+            }
+            for (unsigned int i : object.mesh->indices)
+                indices.push_back(baseVertex + i);
+        }
+        if (vertices.empty())
+            return;
+
+        batch.mesh.reset(new Mesh(vertices, indices, batch.material->Textures()));
+        batch.mesh->glslIdentifierPrefix = batch.material->GlslIdentifierPrefix();
+        batch.mesh->material = batch.material;
+
+        glBindVertexArray(batch.mesh->VAO);
+        glGenBuffers(1, &batch.layerBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, batch.layerBuffer);
+        glBufferData(GL_ARRAY_BUFFER, layers.size() * sizeof(float), layers.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(TEXTURE_LAYER_LOCATION);
+        glVertexAttribPointer(TEXTURE_LAYER_LOCATION, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void*)0);
+        if (lightmapped) {
+            glGenBuffers(1, &batch.lightmapBuffer);
+            glBindBuffer(GL_ARRAY_BUFFER, batch.lightmapBuffer);
+            glBufferData(GL_ARRAY_BUFFER, lightmapCoords.size() * sizeof(glm::vec2), lightmapCoords.data(), GL_STATIC_DRAW);
+            glEnableVertexAttribArray(LIGHTMAP_COORDS_LOCATION);
+            glVertexAttribPointer(LIGHTMAP_COORDS_LOCATION, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void*)0);
+        }
+        glBindVertexArray(0);
+    }
+
+    void release(Batch &batch) {
+        if (batch.mesh) {
+            batch.mesh->Delete();
+            batch.mesh.reset();
+        }
+        if (batch.layerBuffer != 0) {
+            glDeleteBuffers(1, &batch.layerBuffer);
+            batch.layerBuffer = 0;
+        }
+        if (batch.lightmapBuffer != 0) {
+            glDeleteBuffers(1, &batch.lightmapBuffer);
+            batch.lightmapBuffer = 0;
+        }
+    }
+
+    static glm::vec3 safeNormalize(const glm::vec3 &v) {
+        float length = glm::length(v);
+        return length > 0.0f ? v / length : v;
+    }
+};
+
+#endif //PROJECT_BASE_STATICBATCH_H
@@ -0,0 +1,121 @@
+//
+// Images of one size packed as the layers of a single GL_TEXTURE_2D_ARRAY.
+//
+
+#ifndef PROJECT_BASE_TEXTUREARRAY_H
+#define PROJECT_BASE_TEXTUREARRAY_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <stb_image.h>
+
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// room_array.vs reads the layer here. Like the instance transform it falls back to the
+// generic attribute value, so single draws set it with setTextureLayer.
+const unsigned int TEXTURE_LAYER_LOCATION = 10;
+
+void setTextureLayer(unsigned int layer) {
+    glVertexAttrib1f(TEXTURE_LAYER_LOCATION, (float) layer);
+}
+
+// bilinear resample of an RGBA8 image; fine for the < 2x size differences between room textures
+std::vector<unsigned char> resampleRGBA(const unsigned char *src, int srcWidth, int srcHeight, int width, int height) {
+    std::vector<unsigned char> dst(width * height * 4);
+    float scaleX = (float) srcWidth / width;
+    float scaleY = (float) srcHeight / height;
+    for (int y = 0; y < height; y++) {
+        float sy = (y + 0.5f) * scaleY - 0.5f;
+        int y0 = sy < 0.0f ? 0 : (int) sy;
+        int y1 = y0 + 1 < srcHeight ? y0 + 1 : srcHeight - 1;
+        float fy = sy < 0.0f ? 0.0f : sy - y0;
+        for (int x = 0; x < width; x++) {
+            float sx = (x + 0.5f) * scaleX - 0.5f;
+            int x0 = sx < 0.0f ? 0 : (int) sx;
+            int x1 = x0 + 1 < srcWidth ? x0 + 1 : srcWidth - 1;
+            float fx = sx < 0.0f ? 0.0f : sx - x0;
+            for (int c = 0; c < 4; c++) {
+                float top = src[(y0 * srcWidth + x0) * 4 + c] * (1.0f - fx) + src[(y0 * srcWidth + x1) * 4 + c] * fx;
+                float bottom = src[(y1 * srcWidth + x0) * 4 + c] * (1.0f - fx) + src[(y1 * srcWidth + x1) * 4 + c] * fx;
+                dst[(y * width + x) * 4 + c] = (unsigned char) (top * (1.0f - fy) + bottom * fy + 0.5f);
+            }
+        }
+    }
+    return dst;
+}
+
+class TextureArray {
+public:
+    // every layer is stored at this size; images that differ are resampled, not padded,
+    // so GL_REPEAT tiling keeps working
+    TextureArray(int width, int height) : width(width), height(height) {}
+
+    // loads the image into the next layer and returns the layer index
+    unsigned int Add(const std::string &path) {
+        int imageWidth, imageHeight, nrComponents;
+        unsigned char *data = stbi_load(path.c_str(), &imageWidth, &imageHeight, &nrComponents, 4);
+        unsigned int layer = layers++;
+        pixels.resize(layers * width * height * 4, 255);
+        unsigned char *target = &pixels[layer * width * height * 4];
+        if (data) {
+            if (imageWidth == width && imageHeight == height) {
+                std::copy(data, data + width * height * 4, target);
+            } else {
+                std::vector<unsigned char> resized = resampleRGBA(data, imageWidth, imageHeight, width, height);
+                std::copy(resized.begin(), resized.end(), target);
+            }
+        } else {
+            std::cout << "Texture failed to load at path: " << path << std::endl;
+        }
+        stbi_image_free(data);
+        return layer;
+    }
+
+    // mean color of a layer, decoded to linear when the layer holds sRGB; only until Build
+    glm::vec3 AverageColor(unsigned int layer, bool srgb) const {
+        double sum[3] = {0.0, 0.0, 0.0};
+        const unsigned char *texels = &pixels[layer * width * height * 4];
+        for (int i = 0; i < width * height; i++)
+            for (int c = 0; c < 3; c++) {
+                double value = texels[i * 4 + c] / 255.0;
+                if (srgb)
+                    value = value <= 0.04045 ? value / 12.92 : std::pow((value + 0.055) / 1.055, 2.4);
+                sum[c] += value;
+            }
+        double count = (double) width * height;
+        return glm::vec3(sum[0] / count, sum[1] / count, sum[2] / count);
+    }
+
+    // uploads all layers with mipmaps and frees the CPU copy
+    unsigned int Build(bool gammaCorrection) {
+        glGenTextures(1, &id);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, id);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, gammaCorrection ? GL_SRGB8_ALPHA8 : GL_RGBA8,
+                     width, height, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        std::vector<unsigned char>().swap(pixels);
+        return id;
+    }
+
+    unsigned int ID() const { return id; }
+    unsigned int LayerCount() const { return layers; }
+
+private:
+    int width, height;
+    // RGBA8 layers back to back until Build
+    std::vector<unsigned char> pixels;
+    unsigned int layers = 0;
+    unsigned int id = 0;
+};
+
+#endif //PROJECT_BASE_TEXTUREARRAY_H
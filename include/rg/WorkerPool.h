@@ -0,0 +1,108 @@
+//
+// Fixed set of worker threads for data-parallel loops.
+//
+
+#ifndef PROJECT_BASE_WORKERPOOL_H
+#define PROJECT_BASE_WORKERPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkerPool {
+public:
+    // threadCount extra threads besides the caller; defaults to one per remaining hardware thread
+    explicit WorkerPool(unsigned int threadCount = defaultThreadCount()) {
+        for (unsigned int i = 0; i < threadCount; i++)
+            threads.emplace_back([this]() { workerLoop(); });
+    }
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread &thread : threads)
+            thread.join();
+    }
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    // Runs job(i) for every i in [0, count) on the workers and the calling thread, and
+    // returns once all of them finished. Indices are handed out one at a time, so uneven
+    // jobs balance themselves.
+    void ParallelFor(unsigned int count, const std::function<void(unsigned int)> &job) {
+        if (count == 0)
+            return;
+        if (threads.empty() || count == 1) {
+            for (unsigned int i = 0; i < count; i++)
+                job(i);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            currentJob = &job;
+            jobCount = count;
+            nextIndex = 0;
+            busyWorkers = threads.size();
+            generation++;
+        }
+        wake.notify_all();
+
+        runJobs();
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this]() { return busyWorkers == 0; });
+        currentJob = nullptr;
+    }
+
+    unsigned int ThreadCount() const { return threads.size() + 1; }
+
+    static unsigned int defaultThreadCount() {
+        unsigned int hardware = std::thread::hardware_concurrency();
+        return hardware > 1 ? hardware - 1 : 0;
+    }
+
+private:
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(unsigned int)> *currentJob = nullptr;
+    unsigned int jobCount = 0;
+    std::atomic<unsigned int> nextIndex{0};
+    unsigned int busyWorkers = 0;
+    unsigned long long generation = 0;
+    bool stopping = false;
+
+    void runJobs() {
+        for (unsigned int i = nextIndex++; i < jobCount; i = nextIndex++)
+            (*currentJob)(i);
+    }
+
+    void workerLoop() {
+        unsigned long long seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&]() { return stopping || generation != seen; });
+                if (stopping)
+                    return;
+                seen = generation;
+            }
+            runJobs();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                busyWorkers--;
+            }
+            done.notify_one();
+        }
+    }
+};
+
+#endif //PROJECT_BASE_WORKERPOOL_H
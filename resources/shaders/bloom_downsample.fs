@@ -0,0 +1,54 @@
+#version 330 core
+out vec3 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D source;
+uniform vec2 sourceTexel;
+// the drawn part of source, in texture coordinates
+uniform vec2 sourceExtent;
+// first pass only: each group of taps is weighted down by its brightness, so a single
+// very bright pixel cannot flicker into a bloom much larger than itself
+uniform bool karisAverage;
+
+vec3 tap(vec2 uv, float x, float y)
+{
+    vec2 coords = uv + vec2(x, y) * sourceTexel;
+    return texture(source, clamp(coords, sourceTexel * 0.5, sourceExtent - sourceTexel * 0.5)).rgb;
+}
+
+float karisWeight(vec3 color)
+{
+    return 1.0 / (1.0 + dot(color, vec3(0.2126, 0.7152, 0.0722)));
+}
+
+// 13 bilinear taps, as five overlapping 2x2 boxes: the inner one counts half, the four
+// corner ones an eighth each
+void main()
+{
+    vec2 uv = TexCoords * sourceExtent;
+    vec3 a = tap(uv, -2.0, 2.0), b = tap(uv, 0.0, 2.0), c = tap(uv, 2.0, 2.0);
+    vec3 d = tap(uv, -2.0, 0.0), e = tap(uv, 0.0, 0.0), f = tap(uv, 2.0, 0.0);
+    vec3 g = tap(uv, -2.0, -2.0), h = tap(uv, 0.0, -2.0), i = tap(uv, 2.0, -2.0);
+    vec3 j = tap(uv, -1.0, 1.0), k = tap(uv, 1.0, 1.0);
+    vec3 l = tap(uv, -1.0, -1.0), m = tap(uv, 1.0, -1.0);
+
+    vec3 inner = (j + k + l + m) * 0.25;
+    vec3 topLeft = (a + b + d + e) * 0.25;
+    vec3 topRight = (b + c + e + f) * 0.25;
+    vec3 bottomLeft = (d + e + g + h) * 0.25;
+    vec3 bottomRight = (e + f + h + i) * 0.25;
+
+    if (karisAverage) {
+        float wInner = 0.5 * karisWeight(inner);
+        float wTopLeft = 0.125 * karisWeight(topLeft);
+        float wTopRight = 0.125 * karisWeight(topRight);
+        float wBottomLeft = 0.125 * karisWeight(bottomLeft);
+        float wBottomRight = 0.125 * karisWeight(bottomRight);
+        FragColor = (inner * wInner + topLeft * wTopLeft + topRight * wTopRight
+                     + bottomLeft * wBottomLeft + bottomRight * wBottomRight)
+                    / (wInner + wTopLeft + wTopRight + wBottomLeft + wBottomRight);
+    } else {
+        FragColor = inner * 0.5 + (topLeft + topRight + bottomLeft + bottomRight) * 0.125;
+    }
+}
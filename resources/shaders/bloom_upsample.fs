@@ -0,0 +1,25 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D source;
+uniform vec2 sourceTexel;
+// the drawn part of source, in texture coordinates
+uniform vec2 sourceExtent;
+
+vec3 tap(vec2 uv, float x, float y)
+{
+    vec2 coords = uv + vec2(x, y) * sourceTexel;
+    return texture(source, clamp(coords, sourceTexel * 0.5, sourceExtent - sourceTexel * 0.5)).rgb;
+}
+
+// 3x3 tent, 1 2 1 / 2 4 2 / 1 2 1; blended half and half with what the level already holds
+void main()
+{
+    vec2 uv = TexCoords * sourceExtent;
+    vec3 color = tap(uv, 0.0, 0.0) * 4.0;
+    color += (tap(uv, -1.0, 0.0) + tap(uv, 1.0, 0.0) + tap(uv, 0.0, -1.0) + tap(uv, 0.0, 1.0)) * 2.0;
+    color += tap(uv, -1.0, -1.0) + tap(uv, 1.0, -1.0) + tap(uv, -1.0, 1.0) + tap(uv, 1.0, 1.0);
+    FragColor = vec4(color / 16.0, 1.0);
+}
@@ -0,0 +1,160 @@
+// Lighting shared by the room shaders: one directional light plus every point and spot
+// light in the fragment's cluster, as binned by rg/ClusteredLights.h. Included after the
+// #version line; the includer samples its material once and hands it over as a Surface.
+// CLUSTERED_LIGHTS, SHADOWS and SPECULAR_MAP come from rg/ShaderVariants.h; whatever is
+// not defined is not compiled in.
+
+struct DirLight {
+    vec3 direction;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct Surface {
+    vec3 position;
+    // already flipped the way room.fs always lit with (-normal)
+    vec3 normal;
+    vec3 viewDir;
+    vec3 albedo;
+    vec3 specular;
+    float shininess;
+};
+
+uniform DirLight dirLight;
+
+#ifdef CLUSTERED_LIGHTS
+// 6 texels per light: position + range, direction + cutOff, ambient + outerCutOff,
+// diffuse + constant, specular + linear, quadratic + shadow map
+uniform samplerBuffer lightData;
+// offset into clusterLightIndices and light count, per cluster
+uniform usamplerBuffer clusterData;
+uniform usamplerBuffer clusterLightIndices;
+uniform ivec3 clusterGridSize;
+uniform vec2 clusterTileSize;
+uniform vec2 clusterDepthScaleBias;
+#endif
+
+#ifdef SHADOWS
+// the shadow map a light reads, values of LightShadow in rg/ClusteredLights.h
+const int SHADOW_NONE = 0;
+const int SHADOW_SPOT = 1;
+const int SHADOW_POINT = 2;
+uniform sampler2DShadow spotShadowMap;
+uniform mat4 spotShadowMatrix;
+uniform samplerCubeShadow pointShadowMap;
+uniform float pointShadowFar;
+// PCF kernel: (2r + 1)^2 taps for the spot, 20 spread taps for the point light; 0 is one tap
+uniform int shadowPcfRadius;
+
+// surfaces are pushed along their normal before the lookup, against acne on grazing walls
+const float SHADOW_NORMAL_OFFSET = 0.05;
+const float SHADOW_BIAS = 0.0005;
+#endif
+
+#ifdef CLUSTERED_LIGHTS
+int clusterIndex(float viewDepth)
+{
+    ivec2 tile = clamp(ivec2(gl_FragCoord.xy / clusterTileSize), ivec2(0), clusterGridSize.xy - 1);
+    int slice = clamp(int(log(viewDepth) * clusterDepthScaleBias.x + clusterDepthScaleBias.y), 0, clusterGridSize.z - 1);
+    return (slice * clusterGridSize.y + tile.y) * clusterGridSize.x + tile.x;
+}
+#endif
+
+#ifdef SHADOWS
+float spotShadow(Surface surface)
+{
+    vec4 coords = spotShadowMatrix * vec4(surface.position + surface.normal * SHADOW_NORMAL_OFFSET, 1.0);
+    // behind the light
+    if (coords.w <= 0.0)
+        return 1.0;
+    coords.xyz /= coords.w;
+    vec2 texel = 1.0 / vec2(textureSize(spotShadowMap, 0));
+    float lit = 0.0;
+    for (int y = -shadowPcfRadius; y <= shadowPcfRadius; y++)
+        for (int x = -shadowPcfRadius; x <= shadowPcfRadius; x++)
+            lit += texture(spotShadowMap, vec3(coords.xy + vec2(x, y) * texel, coords.z - SHADOW_BIAS));
+    float taps = float(2 * shadowPcfRadius + 1);
+    return lit / (taps * taps);
+}
+
+float pointShadow(Surface surface, vec3 lightPosition)
+{
+    const vec3 offsets[20] = vec3[20](
+            vec3(1, 1, 1), vec3(1, -1, 1), vec3(-1, -1, 1), vec3(-1, 1, 1),
+            vec3(1, 1, -1), vec3(1, -1, -1), vec3(-1, -1, -1), vec3(-1, 1, -1),
+            vec3(1, 1, 0), vec3(1, -1, 0), vec3(-1, -1, 0), vec3(-1, 1, 0),
+            vec3(1, 0, 1), vec3(-1, 0, 1), vec3(1, 0, -1), vec3(-1, 0, -1),
+            vec3(0, 1, 1), vec3(0, -1, 1), vec3(0, -1, -1), vec3(0, 1, -1));
+    vec3 toSurface = surface.position + surface.normal * SHADOW_NORMAL_OFFSET - lightPosition;
+    float distance = length(toSurface);
+    float reference = distance / pointShadowFar - SHADOW_BIAS;
+    if (shadowPcfRadius == 0)
+        return texture(pointShadowMap, vec4(toSurface, reference));
+    // a fixed angular spread per radius step, so the penumbra does not shrink with distance
+    float spread = 0.005 * float(shadowPcfRadius) * distance;
+    float lit = 0.0;
+    for (int i = 0; i < 20; i++)
+        lit += texture(pointShadowMap, vec4(toSurface + offsets[i] * spread, reference));
+    return lit / 20.0;
+}
+#endif
+
+// ambient is never shadowed
+vec3 shadeLight(Surface surface, vec3 lightDir, vec3 ambient, vec3 diffuse, vec3 specular, float shadow)
+{
+    float diff = max(dot(surface.normal, lightDir), 0.0);
+    vec3 result = (ambient + diffuse * diff * shadow) * surface.albedo;
+#ifdef SPECULAR_MAP
+    vec3 halfwayDir = normalize(lightDir + surface.viewDir);
+    float spec = pow(max(dot(surface.normal, halfwayDir), 0.0), surface.shininess);
+    result += specular * spec * shadow * surface.specular;
+#endif
+    return result;
+}
+
+// viewDepth is the distance along the view direction; 1.0 / gl_FragCoord.w for a mesh
+vec3 clusteredLighting(Surface surface, float viewDepth)
+{
+    vec3 result = shadeLight(surface, normalize(-dirLight.direction), dirLight.ambient, dirLight.diffuse, dirLight.specular, 1.0);
+
+#ifdef CLUSTERED_LIGHTS
+    uvec2 cluster = texelFetch(clusterData, clusterIndex(viewDepth)).xy;
+    for (uint i = 0u; i < cluster.y; i++) {
+        int base = int(texelFetch(clusterLightIndices, int(cluster.x + i)).r) * 6;
+        vec4 positionRange = texelFetch(lightData, base);
+        vec3 toLight = positionRange.xyz - surface.position;
+        float distance = length(toLight);
+        if (distance >= positionRange.w)
+            continue;
+        vec3 lightDir = toLight / distance;
+
+        vec4 directionCutOff = texelFetch(lightData, base + 1);
+        vec4 ambientOuterCutOff = texelFetch(lightData, base + 2);
+        vec4 diffuseConstant = texelFetch(lightData, base + 3);
+        vec4 specularLinear = texelFetch(lightData, base + 4);
+        vec4 quadraticShadow = texelFetch(lightData, base + 5);
+
+        float attenuation = 1.0 / (diffuseConstant.w + specularLinear.w * distance + quadraticShadow.x * distance * distance);
+        // eases the falloff to zero at the range the light was binned with
+        float window = clamp(1.0 - pow(distance / positionRange.w, 4.0), 0.0, 1.0);
+        attenuation *= window * window;
+        float theta = dot(lightDir, -directionCutOff.xyz);
+        float intensity = clamp((theta - ambientOuterCutOff.w) / (directionCutOff.w - ambientOuterCutOff.w), 0.0, 1.0);
+
+        float shadow = 1.0;
+#ifdef SHADOWS
+        int shadowMap = int(quadraticShadow.y);
+        if (shadowMap == SHADOW_SPOT)
+            shadow = spotShadow(surface);
+        else if (shadowMap == SHADOW_POINT)
+            shadow = pointShadow(surface, positionRange.xyz);
+#endif
+
+        result += attenuation * intensity
+                  * shadeLight(surface, lightDir, ambientOuterCutOff.rgb, diffuseConstant.rgb, specularLinear.rgb, shadow);
+    }
+#endif
+    return result;
+}
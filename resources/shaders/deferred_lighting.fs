@@ -0,0 +1,45 @@
+#version 330 core
+out vec4 FragColor;
+
+// specular is read from the G-buffer for every pixel, a material without a map wrote 0
+#define SPECULAR_MAP
+#include "clustered_lights.glsl"
+#include "gbuffer.glsl"
+
+// the G-buffer has no shininess, every room material uses this one
+struct Material {
+    float shininess;
+};
+in vec2 TexCoords;
+
+uniform sampler2D gAlbedoSpecular;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+
+uniform Material material;
+uniform vec3 viewPosition;
+uniform mat4 inverseProjection;
+uniform mat4 inverseView;
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, pixel, 0).r;
+    // nothing drawn here; the sky fills it in later
+    if (depth == 1.0)
+        discard;
+
+    vec4 viewSpace = inverseProjection * vec4(vec3(TexCoords, depth) * 2.0 - 1.0, 1.0);
+    viewSpace /= viewSpace.w;
+    vec4 albedoSpecular = texelFetch(gAlbedoSpecular, pixel, 0);
+
+    Surface surface;
+    surface.position = vec3(inverseView * viewSpace);
+    surface.normal = decodeNormal(texelFetch(gNormal, pixel, 0).xy);
+    surface.viewDir = normalize(viewPosition - surface.position);
+    surface.albedo = albedoSpecular.rgb;
+    surface.specular = vec3(albedoSpecular.a);
+    surface.shininess = material.shininess;
+
+    FragColor = vec4(clusteredLighting(surface, -viewSpace.z), 1.0);
+}
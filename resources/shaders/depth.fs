@@ -0,0 +1,6 @@
+#version 330 core
+
+// depth prepass: color writes are masked off, only the depth test runs
+void main()
+{
+}
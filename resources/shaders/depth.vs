@@ -0,0 +1,15 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 5) in mat4 aModel; // per instance, or the generic value for single draws
+
+uniform mat4 view;
+uniform mat4 projection;
+
+// same expression as room.vs and room_array.vs, so the main pass can test with GL_EQUAL
+invariant gl_Position;
+
+void main()
+{
+    vec3 FragPos = vec3(aModel * vec4(aPos, 1.0));
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
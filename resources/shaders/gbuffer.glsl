@@ -0,0 +1,25 @@
+// G-buffer layout of the deferred path, shared by the gbuffer*.fs writers and
+// deferred_lighting.fs:
+//   attachment 0, SRGB8_ALPHA8: albedo, specular mask in alpha
+//   attachment 1, RG16F: the normal room.fs lights with, octahedral encoded
+//   depth: the depth texture hdrFBO uses, positions are rebuilt from it
+
+vec2 signNotZero(vec2 v)
+{
+    return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+// unit vector to the [-1, 1] square: project onto the octahedron, fold the lower half out
+vec2 encodeNormal(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    return n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * signNotZero(n.xy);
+}
+
+vec3 decodeNormal(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * signNotZero(n.xy);
+    return normalize(n);
+}
@@ -0,0 +1,28 @@
+#version 330 core
+layout (location = 0) out vec4 GAlbedoSpecular;
+layout (location = 1) out vec2 GNormal;
+
+#include "gbuffer.glsl"
+
+struct Material {
+    sampler2DArray texture_diffuse1;
+    sampler2DArray texture_specular1;
+
+    float shininess;
+};
+in vec2 TexCoords;
+in vec3 Normal;
+flat in float Layer;
+
+uniform Material material;
+
+void main()
+{
+#ifdef SPECULAR_MAP
+    float specular = texture(material.texture_specular1, vec3(TexCoords, Layer)).a;
+#else
+    float specular = 0.0;
+#endif
+    GAlbedoSpecular = vec4(texture(material.texture_diffuse1, vec3(TexCoords, Layer)).rgb, specular);
+    GNormal = encodeNormal(-normalize(Normal));
+}
@@ -0,0 +1,80 @@
+#version 330 core
+out vec4 FragColor;
+
+#include "clustered_lights.glsl"
+
+in vec2 QuadCoords;
+in vec3 FragPos;
+flat in vec3 SurfaceOffset;
+flat in mat3 NormalMatrix;
+flat in vec2 FrameBase;
+flat in vec2 FrameBlend;
+flat in float Opacity;
+
+uniform sampler2D impostorAlbedo;
+uniform sampler2D impostorNormalDepth;
+uniform float gridSize;
+
+uniform vec3 viewPosition;
+uniform mat4 view;
+uniform mat4 projection;
+
+// pulls the impostor slightly in front of the mesh it fades over
+const float DEPTH_BIAS = 0.02;
+
+// 4x4 Bayer thresholds in (0, 1)
+float ditherThreshold()
+{
+    const float bayer[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0,
+                                      3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+    ivec2 p = ivec2(gl_FragCoord.xy) & 3;
+    return (bayer[p.y * 4 + p.x] + 0.5) / 16.0;
+}
+
+vec2 frameCoords(vec2 frame)
+{
+    frame = clamp(frame, vec2(0.0), vec2(gridSize - 1.0));
+    return (frame + QuadCoords) / gridSize;
+}
+
+void main()
+{
+    if (ditherThreshold() >= Opacity)
+        discard;
+
+    // bilinear blend of the four nearest views; alpha weights keep empty texels out
+    vec2 frames[4] = vec2[4](FrameBase, FrameBase + vec2(1.0, 0.0), FrameBase + vec2(0.0, 1.0), FrameBase + vec2(1.0));
+    float weights[4] = float[4]((1.0 - FrameBlend.x) * (1.0 - FrameBlend.y), FrameBlend.x * (1.0 - FrameBlend.y),
+                                (1.0 - FrameBlend.x) * FrameBlend.y, FrameBlend.x * FrameBlend.y);
+    vec4 albedo = vec4(0.0);
+    vec4 normalDepth = vec4(0.0);
+    for (int i = 0; i < 4; i++) {
+        vec2 uv = frameCoords(frames[i]);
+        vec4 a = texture(impostorAlbedo, uv);
+        float w = weights[i] * a.a;
+        albedo += vec4(a.rgb * w, w);
+        normalDepth += texture(impostorNormalDepth, uv) * w;
+    }
+    if (albedo.a < 0.5)
+        discard;
+    albedo.rgb /= albedo.a;
+    normalDepth /= albedo.a;
+
+    vec3 surfacePosition = FragPos + SurfaceOffset * (1.0 - 2.0 * normalDepth.a + DEPTH_BIAS);
+    vec4 clip = projection * view * vec4(surfacePosition, 1.0);
+    gl_FragDepth = clip.z / clip.w * 0.5 + 0.5;
+
+    // the atlas has no specular map
+    Surface surface;
+    surface.position = surfacePosition;
+    // vector times matrix, as room.vs applies aNormalMatrix, so the impostor lights like the
+    // mesh it fades in and out of
+    surface.normal = -normalize((normalDepth.xyz * 2.0 - 1.0) * NormalMatrix);
+    surface.viewDir = normalize(viewPosition - surfacePosition);
+    surface.albedo = albedo.rgb;
+    surface.specular = vec3(0.0);
+    surface.shininess = 1.0;
+
+    // clip.w is the view depth of the surface, not of the quad
+    FragColor = vec4(clusteredLighting(surface, clip.w), 1.0);
+}
@@ -0,0 +1,62 @@
+#version 330 core
+layout (location = 0) in vec2 aCorner;     // billboard corner in [-1, 1]
+layout (location = 5) in mat4 aModel;      // per instance
+layout (location = 11) in float aOpacity;  // per instance, 1 past the fade band
+
+out vec2 QuadCoords;
+out vec3 FragPos;
+// world-space vector from the billboard plane to the front of the bounding sphere
+flat out vec3 SurfaceOffset;
+flat out mat3 NormalMatrix;
+// lower-left of the 2x2 atlas frames around the view direction, and the weights between them
+flat out vec2 FrameBase;
+flat out vec2 FrameBlend;
+flat out float Opacity;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform vec3 viewPosition;
+
+uniform vec3 sphereCenter;
+uniform float sphereRadius;
+uniform float gridSize;
+
+float signNotZero(float v)
+{
+    return v >= 0.0 ? 1.0 : -1.0;
+}
+
+// inverse of octahedralDirection in rg/Impostor.h
+vec2 octahedralEncode(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 p = n.xz;
+    if (n.y < 0.0)
+        p = vec2((1.0 - abs(n.z)) * signNotZero(n.x), (1.0 - abs(n.x)) * signNotZero(n.z));
+    return p;
+}
+
+void main()
+{
+    vec3 center = vec3(aModel * vec4(sphereCenter, 1.0));
+    mat3 toObject = inverse(mat3(aModel));
+    vec3 viewDir = normalize(toObject * (viewPosition - center));
+
+    // same basis the bake used for the frame looking from viewDir
+    vec3 worldUp = abs(viewDir.y) > 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(0.0, 1.0, 0.0);
+    vec3 right = normalize(cross(worldUp, viewDir));
+    vec3 up = cross(viewDir, right);
+    vec3 corner = sphereCenter + (right * aCorner.x + up * aCorner.y) * sphereRadius;
+
+    FragPos = vec3(aModel * vec4(corner, 1.0));
+    SurfaceOffset = mat3(aModel) * viewDir * sphereRadius;
+    // the same matrix the mesh gets as aNormalMatrix
+    NormalMatrix = transpose(toObject);
+
+    vec2 cell = (octahedralEncode(viewDir) * 0.5 + 0.5) * gridSize - 0.5;
+    FrameBase = floor(cell);
+    FrameBlend = cell - FrameBase;
+    QuadCoords = aCorner * 0.5 + 0.5;
+    Opacity = aOpacity;
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
@@ -0,0 +1,19 @@
+#version 330 core
+layout (location = 0) out vec4 Albedo;
+layout (location = 1) out vec4 NormalDepth;
+
+struct Material {
+    sampler2D texture_diffuse1;
+};
+
+in vec2 TexCoords;
+in vec3 Normal;
+
+uniform Material material;
+
+void main()
+{
+    Albedo = vec4(texture(material.texture_diffuse1, TexCoords).rgb, 1.0);
+    // object-space normal, and the orthographic depth: 0 at the front of the bounding sphere
+    NormalDepth = vec4(normalize(Normal) * 0.5 + 0.5, gl_FragCoord.z);
+}
@@ -0,0 +1,11 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+#include "post.glsl"
+
+void main()
+{
+    FragColor = vec4(postProcess(ivec2(gl_FragCoord.xy), TexCoords), 1.0);
+}
@@ -0,0 +1,86 @@
+// The whole way from the HDR scene to a display value, shared by post.fs and post.comp (see
+// rg/PostProcess.h). Included after the #version line; the includer picks the pixel.
+
+uniform sampler2D hdrBuffer;
+// pixels of hdrBuffer the scene was drawn into, from its lower-left corner
+uniform vec2 sourceSize;
+// rg/Bloom.h's result, in the lower-left bloomExtent of bloomBuffer; mixed in by bloomStrength
+uniform sampler2D bloomBuffer;
+uniform vec2 bloomExtent;
+uniform float bloomStrength;
+uniform float exposure;
+
+// tone curve, grade and gamma in one table, indexed by a log2 shaper (rg/ColorGrading.h)
+uniform sampler3D gradingLut;
+uniform float lutEpsilon;
+uniform float lutLogMin;
+uniform float lutInverseLogRange;
+uniform float lutSize;
+
+// Catmull-Rom over the 4x4 texels around uv, folded into 9 bilinear taps: the middle two
+// weights of each axis are merged into one tap between their texels. Sharper than bilinear
+// when the scene was rendered small, which keeps the lower scales from looking soft. Taps
+// are kept inside the rendered part; the negative lobes can overshoot below zero on hard
+// edges, which is clamped.
+vec3 sampleCatmullRom(vec2 uv)
+{
+    vec2 texel = 1.0 / vec2(textureSize(hdrBuffer, 0));
+    vec2 position = uv * sourceSize;
+    vec2 center = floor(position - 0.5) + 0.5;
+    vec2 f = position - center;
+
+    vec2 w0 = f * (-0.5 + f * (1.0 - 0.5 * f));
+    vec2 w1 = 1.0 + f * f * (-2.5 + 1.5 * f);
+    vec2 w2 = f * (0.5 + f * (2.0 - 1.5 * f));
+    vec2 w3 = f * f * (-0.5 + 0.5 * f);
+    vec2 w12 = w1 + w2;
+
+    vec2 lo = vec2(0.5), hi = sourceSize - 0.5;
+    vec2 p0 = clamp(center - 1.0, lo, hi) * texel;
+    vec2 p12 = clamp(center + w2 / w12, lo, hi) * texel;
+    vec2 p3 = clamp(center + 2.0, lo, hi) * texel;
+
+    vec3 result = vec3(0.0);
+    result += texture(hdrBuffer, vec2(p0.x, p0.y)).rgb * w0.x * w0.y;
+    result += texture(hdrBuffer, vec2(p12.x, p0.y)).rgb * w12.x * w0.y;
+    result += texture(hdrBuffer, vec2(p3.x, p0.y)).rgb * w3.x * w0.y;
+    result += texture(hdrBuffer, vec2(p0.x, p12.y)).rgb * w0.x * w12.y;
+    result += texture(hdrBuffer, vec2(p12.x, p12.y)).rgb * w12.x * w12.y;
+    result += texture(hdrBuffer, vec2(p3.x, p12.y)).rgb * w3.x * w12.y;
+    result += texture(hdrBuffer, vec2(p0.x, p3.y)).rgb * w0.x * w3.y;
+    result += texture(hdrBuffer, vec2(p12.x, p3.y)).rgb * w12.x * w3.y;
+    result += texture(hdrBuffer, vec2(p3.x, p3.y)).rgb * w3.x * w3.y;
+    return max(result, vec3(0.0));
+}
+
+// Triangular noise of one 8-bit step, from two interleaved gradient noise values; hides the
+// banding of smooth gradients in the 8-bit window.
+vec3 dither(ivec2 pixel)
+{
+    const vec3 magic = vec3(0.06711056, 0.00583715, 52.9829189);
+    float a = fract(magic.z * fract(dot(vec2(pixel), magic.xy)));
+    float b = fract(magic.z * fract(dot(vec2(pixel) + vec2(37.0, 17.0), magic.xy)));
+    return vec3((a + b - 1.0) / 255.0);
+}
+
+// pixel in the output, uv its center in [0, 1]
+vec3 postProcess(ivec2 pixel, vec2 uv)
+{
+    vec3 hdrColor;
+    // rendered at window size: one pixel per pixel, nothing to filter
+    if (sourceSize == vec2(textureSize(hdrBuffer, 0)))
+        hdrColor = texelFetch(hdrBuffer, pixel, 0).rgb;
+    else
+        hdrColor = sampleCatmullRom(uv);
+    if (bloomStrength > 0.0) {
+        vec2 bloomTexel = 1.0 / vec2(textureSize(bloomBuffer, 0));
+        vec3 bloom = texture(bloomBuffer, min(uv * bloomExtent, bloomExtent - bloomTexel * 0.5)).rgb;
+        // a mix rather than an add: the bloom holds as much light as the frame, only spread out
+        hdrColor = mix(hdrColor, bloom, bloomStrength);
+    }
+
+    // one log2 per channel for the shaper, the only transcendental left per pixel
+    vec3 shaped = clamp((log2(hdrColor * exposure + lutEpsilon) - lutLogMin) * lutInverseLogRange, 0.0, 1.0);
+    vec3 graded = texture(gradingLut, shaped * ((lutSize - 1.0) / lutSize) + 0.5 / lutSize).rgb;
+    return graded + dither(pixel);
+}
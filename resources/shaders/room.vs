@@ -2,21 +2,24 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+layout (location = 5) in mat4 aModel; // per instance, or the generic value for single draws
+layout (location = 13) in mat3 aNormalMatrix; // computed with aModel on the CPU, see rg/InstanceBuffer.h
 
 out vec2 TexCoords;
 out vec3 Normal;
 out vec3 FragPos;
 
-uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+// written by the depth prepass with the same expression; see depth.vs
+invariant gl_Position;
+
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
+    FragPos = vec3(aModel * vec4(aPos, 1.0));
 
-    mat3 normalMatrix = transpose(inverse(mat3(model)));
-    Normal = normalize(aNormal * normalMatrix);
+    Normal = normalize(aNormal * aNormalMatrix);
 
     TexCoords = aTexCoords;    
     gl_Position = projection * view * vec4(FragPos, 1.0);
@@ -0,0 +1,38 @@
+#version 330 core
+out vec4 FragColor;
+
+#include "clustered_lights.glsl"
+
+struct Material {
+    sampler2DArray texture_diffuse1;
+    sampler2DArray texture_specular1;
+
+    float shininess;
+};
+in vec2 TexCoords;
+in vec3 Normal;
+in vec3 FragPos;
+flat in float Layer;
+
+uniform Material material;
+
+uniform vec3 viewPosition;
+
+void main()
+{
+    vec4 diffuse = texture(material.texture_diffuse1, vec3(TexCoords, Layer));
+
+    Surface surface;
+    surface.position = FragPos;
+    surface.normal = -normalize(Normal);
+    surface.viewDir = normalize(viewPosition - FragPos);
+    surface.albedo = diffuse.rgb;
+#ifdef SPECULAR_MAP
+    surface.specular = vec3(texture(material.texture_specular1, vec3(TexCoords, Layer)).a);
+#else
+    surface.specular = vec3(0.0);
+#endif
+    surface.shininess = material.shininess;
+
+    FragColor = vec4(clusteredLighting(surface, 1.0 / gl_FragCoord.w), diffuse.a);
+}
@@ -0,0 +1,29 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 5) in mat4 aModel; // per instance, or the generic value for single draws
+layout (location = 13) in mat3 aNormalMatrix; // computed with aModel on the CPU, see rg/InstanceBuffer.h
+layout (location = 10) in float aLayer; // texture array layer, generic value unless batched
+
+out vec2 TexCoords;
+out vec3 Normal;
+out vec3 FragPos;
+flat out float Layer;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+// written by the depth prepass with the same expression; see depth.vs
+invariant gl_Position;
+
+void main()
+{
+    FragPos = vec3(aModel * vec4(aPos, 1.0));
+
+    Normal = normalize(aNormal * aNormalMatrix);
+
+    TexCoords = aTexCoords;
+    Layer = aLayer;
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
@@ -0,0 +1,29 @@
+#version 330 core
+out vec4 FragColor;
+
+// room_array.fs with the lighting read from the baked lightmap instead of computed
+struct Material {
+    sampler2DArray texture_diffuse1;
+};
+in vec2 TexCoords;
+in vec2 LightmapCoords;
+flat in float Layer;
+
+uniform Material material;
+
+// one layer per baked light, weighted 1 when the light is on and 0 when it is off
+const int MAX_LIGHTMAP_LAYERS = 4;
+uniform sampler2DArray lightmap;
+uniform int lightmapLayers;
+uniform float lightmapWeights[MAX_LIGHTMAP_LAYERS];
+
+void main()
+{
+    vec4 diffuse = texture(material.texture_diffuse1, vec3(TexCoords, Layer));
+
+    vec3 irradiance = vec3(0.0);
+    for (int layer = 0; layer < lightmapLayers; layer++)
+        irradiance += lightmapWeights[layer] * texture(lightmap, vec3(LightmapCoords, layer)).rgb;
+
+    FragColor = vec4(diffuse.rgb * irradiance, diffuse.a);
+}
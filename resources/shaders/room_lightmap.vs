@@ -0,0 +1,25 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 5) in mat4 aModel; // per instance, or the generic value for single draws
+layout (location = 10) in float aLayer; // texture array layer, generic value unless batched
+layout (location = 12) in vec2 aLightmapCoords; // only the static room batch has these
+
+out vec2 TexCoords;
+out vec2 LightmapCoords;
+flat out float Layer;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+// written by the depth prepass with the same expression; see depth.vs
+invariant gl_Position;
+
+void main()
+{
+    vec3 FragPos = vec3(aModel * vec4(aPos, 1.0));
+    TexCoords = aTexCoords;
+    LightmapCoords = aLightmapCoords;
+    Layer = aLayer;
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
@@ -0,0 +1,36 @@
+#version 430 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 9) in uint aDrawId; // per instance, offset by the command's baseInstance
+
+struct DrawData {
+    mat4 model;
+    mat3 normalMatrix; // transpose(inverse(mat3(model))), computed on the CPU
+    uint materialIndex;
+};
+
+layout (std430, binding = 0) readonly buffer DrawDataBuffer {
+    DrawData draws[];
+};
+
+out vec2 TexCoords;
+out vec3 Normal;
+out vec3 FragPos;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+// written by the depth prepass with the same expression; see depth.vs
+invariant gl_Position;
+
+void main()
+{
+    mat4 model = draws[aDrawId].model;
+    FragPos = vec3(model * vec4(aPos, 1.0));
+
+    Normal = normalize(aNormal * draws[aDrawId].normalMatrix);
+
+    TexCoords = aTexCoords;
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
@@ -0,0 +1,11 @@
+#version 330 core
+in vec3 WorldPos;
+
+uniform vec3 lightPosition;
+uniform float farPlane;
+
+void main()
+{
+    // linear distance, so lookups compare it without knowing the face's projection
+    gl_FragDepth = length(WorldPos - lightPosition) / farPlane;
+}
@@ -0,0 +1,20 @@
+#version 330 core
+layout (triangles) in;
+layout (triangle_strip, max_vertices = 18) out;
+
+uniform mat4 faceViewProjections[6];
+
+out vec3 WorldPos;
+
+void main()
+{
+    for (int face = 0; face < 6; face++) {
+        gl_Layer = face;
+        for (int i = 0; i < 3; i++) {
+            WorldPos = gl_in[i].gl_Position.xyz;
+            gl_Position = faceViewProjections[face] * gl_in[i].gl_Position;
+            EmitVertex();
+        }
+        EndPrimitive();
+    }
+}
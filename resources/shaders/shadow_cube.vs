@@ -0,0 +1,9 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 5) in mat4 aModel; // per instance, or the generic value for single draws
+
+void main()
+{
+    // world space; the geometry shader projects once per face
+    gl_Position = aModel * vec4(aPos, 1.0);
+}
@@ -15,7 +15,40 @@
 #include <learnopengl/camera.h>
 #include <learnopengl/model.h>
 
+#include <rg/AutoExposure.h>
+#include <rg/BVH.h>
+#include <rg/Bloom.h>
+#include <rg/CameraPath.h>
+#include <rg/ClusteredLights.h>
+#include <rg/ColorGrading.h>
+#include <rg/ComputeShader.h>
+#include <rg/DynamicResolution.h>
+#include <rg/FormatComparison.h>
+#include <rg/Frustum.h>
+#include <rg/GLExt.h>
+#include <rg/GpuInstanceCuller.h>
+#include <rg/GpuTimer.h>
+#include <rg/HiZBuffer.h>
+#include <rg/Impostor.h>
+#include <rg/InstanceBuffer.h>
+#include <rg/Lightmap.h>
+#include <rg/MultiDrawBatch.h>
+#include <rg/OcclusionRasterizer.h>
+#include <rg/Portals.h>
+#include <rg/PostProcess.h>
+#include <rg/Primitives.h>
+#include <rg/RenderQueue.h>
+#include <rg/RenderStats.h>
+#include <rg/Scene.h>
+#include <rg/SceneTargets.h>
+#include <rg/ShaderVariants.h>
+#include <rg/ShadowMaps.h>
+#include <rg/StaticBatch.h>
+#include <rg/TextureArray.h>
+
+#include <chrono>
 #include <iostream>
+#include <random>
 
 void framebuffer_size_callback(GLFWwindow *window, int width, int height);
 
@@ -27,6 +60,8 @@ void processInput(GLFWwindow *window);
 
 void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods);
 
+void mouse_button_callback(GLFWwindow *window, int button, int action, int mods);
+
 unsigned int loadTexture(const char *path, bool gammaCorrection);
 
 void renderQuad();
@@ -38,6 +73,9 @@ unsigned int loadCubemap(vector<std::string> faces);
 // settings
 const unsigned int SCR_WIDTH = 1600;
 const unsigned int SCR_HEIGHT = 1200;
+// the window's framebuffer in pixels, kept by framebuffer_size_callback
+int framebufferWidth = SCR_WIDTH;
+int framebufferHeight = SCR_HEIGHT;
 bool hdr = true;
 bool hdrKeyPressed = false;
 float exposure = 1.5f;
@@ -48,6 +86,10 @@ double lastX = SCR_WIDTH / 2.0f;
 double lastY = SCR_HEIGHT / 2.0f;
 bool firstMouse = true;
 
+// set by a click in pick mode, handled in the render loop where view/projection are known
+bool pickRequested = false;
+double pickX = 0.0, pickY = 0.0;
+
 // timing
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
@@ -92,6 +134,59 @@ struct ProgramState {
     bool CameraMouseMovementUpdateEnabled = true;
     bool PointLightEnabled = false;
     bool SpotLightEnabled = true;
+    bool MultiDrawIndirectEnabled = false;
+    bool StaticBatchingEnabled = true;
+    bool SpinCat = false;
+    // the table glass floats up and down; the first time it moves it leaves the static batch
+    bool FloatGlass = false;
+    bool FrustumCullingEnabled = true;
+    // objects smaller than this on screen are culled too
+    float CullMinPixelSize = 2.0f;
+    // walls, tv and sofa are rasterized on the CPU and hide what is behind them
+    bool OcclusionCullingEnabled = true;
+    // cells and contents not seen through any portal are skipped, the sky included
+    bool PortalCullingEnabled = true;
+    // the instanced stress cats are culled by a compute shader instead of the CPU (GL 4.3)
+    bool GpuCullingEnabled = true;
+    // models past ImpostorDistance are drawn as baked billboards, cross-faded over ImpostorFadeRange
+    bool ImpostorsEnabled = true;
+    float ImpostorDistance = 20.0f;
+    float ImpostorFadeRange = 3.0f;
+    // colored point lights scattered over the floor on top of the point and spot light
+    int ExtraLightCount = 0;
+    // the point and spot light cast shadows; PCF radius 0 is a single filtered tap
+    bool ShadowsEnabled = true;
+    int ShadowPcfRadius = 1;
+    // The static room batch reads its light from the baked lightmap (forward shading only).
+    // Off by default: it has no specular, and it stands in only while the lights are as baked.
+    bool LightmapEnabled = false;
+    // opaque geometry is drawn depth-only first, so the lit pass shades each pixel once
+    bool DepthPrepassEnabled = false;
+    // opaque surfaces go to a G-buffer and are lit once per pixel; blended ones and impostors stay forward
+    bool DeferredShadingEnabled = false;
+    // the scene is drawn below window resolution while its GPU time is over FrameBudgetMs,
+    // never below MinRenderScale of it, and upsampled to the window in the resolve
+    bool DynamicResolutionEnabled = false;
+    float FrameBudgetMs = 16.0f;
+    float MinRenderScale = 0.5f;
+    // exposure follows the frame's luminance histogram (GL 4.3); compensation is in stops
+    bool AutoExposureEnabled = true;
+    float ExposureCompensation = 0.0f;
+    // the share of the frame replaced by its blurred mip chain in the resolve
+    bool BloomEnabled = true;
+    float BloomStrength = 0.04f;
+    // storage of the HDR scene color; the packed formats halve its bandwidth
+    SceneColorFormat HdrColorFormat = SCENE_COLOR_RGBA16F;
+    // the look baked into the post pass's LUT; ColorGradingLook is the preset it started from
+    ColorGrading Grading;
+    int ColorGradingLook = 0;
+    // the post pass as a compute shader in tiles instead of a fullscreen triangle (GL 4.3)
+    bool ComputePostEnabled = false;
+    // left click casts a ray through the scene BVH
+    bool PickMode = false;
+    std::string PickedObject = "none";
+    bool BVHStressRequested = false;
+    int StressInstanceCount = 0;
 
     PointLight pointLight;
     DirLight dirLight;
@@ -133,6 +228,45 @@ ProgramState *programState;
 
 void DrawImGui(ProgramState *programState);
 
+void setRoomUniforms(Shader &shader, ProgramState *programState, const ClusteredLights &lights,
+                     const SpotShadowMap &spotShadow, const PointShadowMap &pointShadow,
+                     const glm::mat4 &view, const glm::mat4 &projection);
+
+Light toLight(const PointLight &light);
+
+Light toLight(const SpotLight &light);
+
+std::vector<Light> scatteredLights(int count);
+
+std::vector<glm::mat4> gridTransforms(int count, const glm::mat4 &base);
+
+Ray cursorRay(double x, double y, const glm::vec2 &windowSize, const glm::mat4 &view, const glm::mat4 &projection);
+
+struct BVHStressResult {
+    unsigned int objects = 0;
+    unsigned int nodes = 0;
+    float buildMs = 0.0f;
+    float cullMs = 0.0f;
+    unsigned int visible = 0;
+    float raycastUs = 0.0f;
+    float overlapUs = 0.0f;
+    float refitUs = 0.0f;
+};
+BVHStressResult bvhStressResult;
+
+BVHStressResult runBVHStress(unsigned int count, const Frustum &frustum, const glm::vec3 &cameraPosition);
+
+// recorded camera flight, replayed to time the forward and deferred paths on the same frames
+CameraPath cameraPath;
+// last replay's times: forward at 0 and deferred at 1, plus 2 with the depth prepass on
+CameraPath::Timing replayTimings[4];
+// false once a light has been edited away from what the lightmap was baked with
+bool lightmapCurrent = true;
+// the same replay drawn with RGBA16F and with the selected scene color format, compared
+FormatComparison formatComparison;
+// the scene color formats the driver can render to, offered in the overlay
+bool sceneColorFormatSupported[SCENE_COLOR_FORMAT_COUNT] = {false};
+
 int main() {
     // glfw: initialize and configure
     // ------------------------------
@@ -154,10 +288,13 @@ int main() {
         return -1;
     }
     glfwMakeContextCurrent(window);
+    // larger than the window on high-DPI displays
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
     glfwSetKeyCallback(window, key_callback);
+    glfwSetMouseButtonCallback(window, mouse_button_callback);
     // tell GLFW to capture our mouse
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL); //ne radi sa GLFW_CURSOR_DISABLED
     // glad: load all OpenGL function pointers
@@ -166,6 +303,7 @@ int main() {
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    rg::loadGLExtensions((GLADloadproc) glfwGetProcAddress);
 
     //DO NOT tell stb_image.h to flip loaded texture's on the y-axis (before loading model).
     stbi_set_flip_vertically_on_load(false); //work for all model maps and cubemap
@@ -188,39 +326,81 @@ int main() {
     // -----------------------------
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_CULL_FACE);
-    glEnable(GL_BLEND);
+    // blending is enabled per material by the render queue
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     //glFrontFace(GL_CW);
 
     // build and compile shaders
     // -------------------------
-    Shader roomShader("resources/shaders/room.vs", "resources/shaders/room.fs");
+    // The lit shaders are variant sets: each draw gets the program specialized for the lights
+    // on this frame and its material's maps, compiled the first time it is asked for.
+    const unsigned int LIT_FEATURES = FEATURE_CLUSTERED_LIGHTS | FEATURE_SHADOWS | FEATURE_SPECULAR_MAP;
+    ShaderVariants roomShader("resources/shaders/room.vs", "resources/shaders/room.fs", LIT_FEATURES);
+    // room surfaces: same lighting, textures from the room texture arrays
+    ShaderVariants roomArrayShader("resources/shaders/room_array.vs", "resources/shaders/room_array.fs", LIT_FEATURES);
+    // the static room batch again, lit from the lightmap
+    Shader roomLightmapShader("resources/shaders/room_lightmap.vs", "resources/shaders/room_lightmap.fs");
     Shader cubemapShader("resources/shaders/cubemap.vs", "resources/shaders/cubemap.fs");
-    Shader hdrShader("resources/shaders/hdr.vs", "resources/shaders/hdr.fs");
+    ShaderVariants impostorShader("resources/shaders/impostor.vs", "resources/shaders/impostor.fs",
+                                  FEATURE_CLUSTERED_LIGHTS | FEATURE_SHADOWS);
+    // deferred path: the same vertex shaders writing the G-buffer, then one lighting pass
+    ShaderVariants gBufferShader("resources/shaders/room.vs", "resources/shaders/gbuffer.fs", FEATURE_SPECULAR_MAP);
+    ShaderVariants gBufferArrayShader("resources/shaders/room_array.vs", "resources/shaders/gbuffer_array.fs",
+                                      FEATURE_SPECULAR_MAP);
+    ShaderVariants deferredLightingShader("resources/shaders/hdr.vs", "resources/shaders/deferred_lighting.fs",
+                                          FEATURE_CLUSTERED_LIGHTS | FEATURE_SHADOWS);
+    // depth prepass; computes gl_Position exactly like the lit vertex shaders
+    Shader depthShader("resources/shaders/depth.vs", "resources/shaders/depth.fs");
+    Shader bloomDownsampleShader("resources/shaders/fullscreen.vs", "resources/shaders/bloom_downsample.fs");
+    Shader bloomUpsampleShader("resources/shaders/fullscreen.vs", "resources/shaders/bloom_upsample.fs");
+    // everything between the HDR frame and the window, see PostProcess
+    Shader postShader("resources/shaders/fullscreen.vs", "resources/shaders/post.fs");
+    // depth only: the spot's map directly, the point light's cube in one pass through a geometry shader
+    Shader shadowDepthShader("resources/shaders/shadow_depth.vs", "resources/shaders/shadow_depth.fs");
+    Shader shadowCubeShader("resources/shaders/shadow_cube.vs", "resources/shaders/shadow_cube.fs",
+                            "resources/shaders/shadow_cube.gs");
+    // same lighting as roomShader, but model matrices come from the multi-draw SSBO
+    ShaderVariants *roomMdiShader = nullptr;
+    ShaderVariants *gBufferMdiShader = nullptr;
+    Shader *depthMdiShader = nullptr;
+    if (rg::glCaps().multiDrawIndirect) {
+        roomMdiShader = new ShaderVariants("resources/shaders/room_mdi.vs", "resources/shaders/room.fs", LIT_FEATURES);
+        gBufferMdiShader = new ShaderVariants("resources/shaders/room_mdi.vs", "resources/shaders/gbuffer.fs",
+                                              FEATURE_SPECULAR_MAP);
+        depthMdiShader = new Shader("resources/shaders/room_mdi.vs", "resources/shaders/depth.fs");
+    }
+    std::vector<ShaderVariants *> shaderVariants = {&roomShader, &roomArrayShader, &impostorShader,
+                                                    &gBufferShader, &gBufferArrayShader, &deferredLightingShader};
+    if (roomMdiShader != nullptr) {
+        shaderVariants.push_back(roomMdiShader);
+        shaderVariants.push_back(gBufferMdiShader);
+    }
+    ComputeShader *cullInstancesShader = nullptr;
+    ComputeShader *hizReduceShader = nullptr;
+    if (rg::glCaps().compute && rg::glCaps().multiDrawIndirect) {
+        cullInstancesShader = new ComputeShader("resources/shaders/cull_instances.comp");
+        hizReduceShader = new ComputeShader("resources/shaders/hiz_reduce.comp");
+    }
+    ComputeShader *luminanceHistogramShader = nullptr;
+    ComputeShader *postComputeShader = nullptr;
+    AutoExposure autoExposure;
+    if (rg::glCaps().compute) {
+        luminanceHistogramShader = new ComputeShader("resources/shaders/luminance_histogram.comp");
+        postComputeShader = new ComputeShader("resources/shaders/post.comp");
+        autoExposure.Create();
+    }
 
-    // configure floating point framebuffer
+    // floating point color, G-buffer and depth, recreated whenever the window changes size
     // ------------------------------------
-    unsigned int hdrFBO;
-    glGenFramebuffers(1, &hdrFBO);
-    // create floating point color buffer
-    unsigned int colorBuffer;
-    glGenTextures(1, &colorBuffer);
-    glBindTexture(GL_TEXTURE_2D, colorBuffer);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    // create depth buffer (renderbuffer)
-    unsigned int rboDepth;
-    glGenRenderbuffers(1, &rboDepth);
-    glBindRenderbuffer(GL_RENDERBUFFER, rboDepth);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, SCR_WIDTH, SCR_HEIGHT);
-    // attach buffers
-    glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorBuffer, 0);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rboDepth);
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        std::cout << "Framebuffer not complete!" << std::endl;
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    SceneTargets targets;
+    targets.Create(framebufferWidth, framebufferHeight);
+    for (int i = 0; i < SCENE_COLOR_FORMAT_COUNT; i++)
+        sceneColorFormatSupported[i] = targets.ColorFormatSupported((SceneColorFormat) i);
+    DynamicResolution dynamicResolution;
+    Bloom bloom;
+    bloom.Create(framebufferWidth, framebufferHeight);
+    PostProcess post;
+    post.Create(framebufferWidth, framebufferHeight);
 
 
     float cubeVertices[] = { // from learn opengl
@@ -393,87 +573,80 @@ int main() {
             };
     unsigned int cubemapTexture = loadCubemap(faces);
 
-    //floor
-    unsigned int floorVBO, floorVAO;
-    glGenVertexArrays(1, &floorVAO);
-    glGenBuffers(1, &floorVBO);
-
-    glBindVertexArray(floorVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, floorVBO);
-
-    glBufferData(GL_ARRAY_BUFFER, sizeof(floorVertices), floorVertices, GL_STATIC_DRAW);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-    glEnableVertexAttribArray(2);
+    // room textures, one layer per surface; diffuse and specular layers line up
+    TextureArray roomDiffuseArray(1024, 1024);
+    TextureArray roomSpecularArray(1024, 1024);
+    unsigned int floorLayer = roomDiffuseArray.Add(FileSystem::getPath("resources/textures/wood_floor_diffuse.jpg"));
+    roomSpecularArray.Add(FileSystem::getPath("resources/textures/wood_floor_specular.jpg"));
+    unsigned int wallsLayer = roomDiffuseArray.Add(FileSystem::getPath("resources/textures/wall_diffuse.jpg"));
+    roomSpecularArray.Add(FileSystem::getPath("resources/textures/wall_specular.jpg"));
+    unsigned int woodLayer = roomDiffuseArray.Add(FileSystem::getPath("resources/textures/wood_diffuse2.jpg"));
+    roomSpecularArray.Add(FileSystem::getPath("resources/textures/wood_specular2.jpg"));
+    unsigned int glassLayer = roomDiffuseArray.Add(FileSystem::getPath("resources/textures/glass.png"));
+    roomSpecularArray.Add(FileSystem::getPath("resources/textures/glass_specular.jpg"));
+    // mean colors of the opaque surfaces, what the lightmap bounces light with
+    glm::vec3 floorAlbedo = roomDiffuseArray.AverageColor(floorLayer, true);
+    glm::vec3 wallsAlbedo = roomDiffuseArray.AverageColor(wallsLayer, true);
+    glm::vec3 woodAlbedo = roomDiffuseArray.AverageColor(woodLayer, true);
+    roomDiffuseArray.Build(true);
+    roomSpecularArray.Build(true);
+
+    std::vector<Texture> roomTextures = {
+            Texture{roomDiffuseArray.ID(), "texture_diffuse", "room_diffuse", GL_TEXTURE_2D_ARRAY},
+            Texture{roomSpecularArray.ID(), "texture_specular", "room_specular", GL_TEXTURE_2D_ARRAY}
+    };
+    // every opaque room surface binds the same arrays, so they sort and bind as one material
+    Material roomMaterial(roomTextures);
 
-    unsigned int floorDiffuseMap = loadTexture(FileSystem::getPath("resources/textures/wood_floor_diffuse.jpg").c_str(), true);
-    unsigned int floorSpecularMap = loadTexture(FileSystem::getPath("resources/textures/wood_floor_specular.jpg").c_str(), true);
+    //floor
+    Mesh floorMesh = createPrimitive(floorVertices, 6, roomMaterial, floorLayer);
+    glm::mat4 floorTransform = glm::scale(glm::mat4(1.0f), glm::vec3(30.0f, 0.0f, 30.0f));
 
     //walls
-    unsigned int wallsVBO, wallsVAO;
-    glGenVertexArrays(1, &wallsVAO);
-    glGenBuffers(1, &wallsVBO);
-
-    glBindVertexArray(wallsVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, wallsVBO);
-
-    glBufferData(GL_ARRAY_BUFFER, sizeof(wallsVertices), wallsVertices, GL_STATIC_DRAW);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-    glEnableVertexAttribArray(2);
-
-    unsigned int wallsDiffuseMap = loadTexture(FileSystem::getPath("resources/textures/wall_diffuse.jpg").c_str(), true);
-    unsigned int wallsSpecularMap = loadTexture(FileSystem::getPath("resources/textures/wall_specular.jpg").c_str(), true);
+    Mesh wallsMesh = createPrimitive(wallsVertices, 24, roomMaterial, wallsLayer);
+    glm::mat4 wallsTransform = glm::mat4(1.0f);
+    wallsTransform = glm::translate(wallsTransform, glm::vec3(0.0, 5.0, 0.0));
+    wallsTransform = glm::scale(wallsTransform, glm::vec3(30.0f, 10.0f, 30.0f));
 
     //table legs
+    Mesh tableLegMesh = createPrimitive(cubeVertices, 36, roomMaterial, woodLayer);
 
-    unsigned int cubeVBO, cubeVAO;
-    glGenVertexArrays(1, &cubeVAO);
-    glGenBuffers(1, &cubeVBO);
-
-    glBindVertexArray(cubeVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
-
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVertices), cubeVertices, GL_STATIC_DRAW);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-    glEnableVertexAttribArray(2);
-
-    unsigned int woodDiffuseMap = loadTexture(FileSystem::getPath("resources/textures/wood_diffuse2.jpg").c_str(), true);
-    unsigned int woodSpecularMap = loadTexture(FileSystem::getPath("resources/textures/wood_specular2.jpg").c_str(), true);
-
-    //table glass
-
-    unsigned int glassVBO, glassVAO;
-    glGenVertexArrays(1, &glassVAO);
-    glGenBuffers(1, &glassVBO);
-
-    glBindVertexArray(glassVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, glassVBO);
-
-    glBufferData(GL_ARRAY_BUFFER, sizeof(glassVertices), glassVertices, GL_STATIC_DRAW);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-    glEnableVertexAttribArray(2);
-
-    unsigned int glassDiffuseMap = loadTexture(FileSystem::getPath("resources/textures/glass.png").c_str(), true);
-    unsigned int glassSpecularMap = loadTexture(FileSystem::getPath("resources/textures/glass_specular.jpg").c_str(), true);
+    std::vector<glm::mat4> tableLegTransforms;
+    for (const glm::vec3 &position : tableLegsPosition) {
+        glm::mat4 model = glm::mat4(1.0f);
+        model = glm::translate(model, position);
+        model = glm::scale(model, glm::vec3(0.5f, 2.0f, 0.5f));
+        tableLegTransforms.push_back(model);
+    }
+    InstanceBuffer tableLegInstances;
+    tableLegInstances.SetTransforms(tableLegTransforms);
+
+    //table glass, same textures but blended
+    Material glassMaterial(roomTextures, true, false);
+    Mesh glassMesh = createPrimitive(glassVertices, 6, glassMaterial, glassLayer);
+    glm::mat4 glassTransform = glm::mat4(1.0f);
+    glassTransform = glm::translate(glassTransform, glm::vec3(-1.53f, 2.01f, 1.49f));
+    glassTransform = glm::scale(glassTransform, glm::vec3(9.6f, 0.0f, 7.6f));
+
+    // none of the room pieces move: bake them into one buffer per material
+    // (floor, walls and legs in one, the glass in another)
+    StaticBatcher staticBatcher;
+    unsigned int floorBatchObject = staticBatcher.Add(floorMesh, floorTransform);
+    unsigned int wallsBatchObject = staticBatcher.Add(wallsMesh, wallsTransform);
+    std::vector<unsigned int> tableLegBatchObjects;
+    for (const glm::mat4 &transform : tableLegTransforms)
+        tableLegBatchObjects.push_back(staticBatcher.Add(tableLegMesh, transform));
+    unsigned int glassBatchObject = staticBatcher.Add(glassMesh, glassTransform);
+    staticBatcher.Build();
+
+    // the room is a single cell and the missing ceiling its one portal to the outside
+    CellGraph cells;
+    AABB roomBounds;
+    roomBounds.Expand(glm::vec3(-15.0f, 0.0f, -15.0f));
+    roomBounds.Expand(glm::vec3(15.0f, 10.0f, 15.0f));
+    unsigned int roomCell = cells.AddCell(roomBounds);
+    cells.AddPortal(roomCell, OUTSIDE_CELL, {glm::vec3(-15.0f, 10.0f, -15.0f), glm::vec3(15.0f, 10.0f, -15.0f),
+                                             glm::vec3(15.0f, 10.0f, 15.0f), glm::vec3(-15.0f, 10.0f, 15.0f)});
 
 
     // load models
@@ -497,6 +670,94 @@ int main() {
     unsigned int sofaDiffuse = loadTexture(FileSystem::getPath("resources/objects/sofa/sofa_diffuse.jpg").c_str(), true);
     unsigned int sofaSpecular = loadTexture(FileSystem::getPath("resources/objects/sofa/sofa_specular.jpg").c_str(), true);
 
+    // placement of the models; world matrices are only recomputed when one of these changes
+    SceneStore scene;
+    glm::quat catRotation = glm::angleAxis(glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f))
+                            * glm::angleAxis(glm::radians(-45.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    unsigned int catObject = scene.Create(glm::vec3(7.0f, 0.0f, 0.0f), catRotation, glm::vec3(0.08f));
+    unsigned int lampObject = scene.Create(glm::vec3(0.0f, 8.0f, 0.0f),
+                                           glm::angleAxis(glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
+                                           glm::vec3(0.03f));
+    unsigned int tvObject = scene.Create(glm::vec3(-3.0f, 3.0f, -11.0f));
+    unsigned int sofaObject = scene.Create(glm::vec3(-5.0f, 0.6f, 9.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f),
+                                           glm::vec3(0.025f));
+
+    struct SceneModel {
+        const char *name;
+        Model *model;
+        unsigned int object;
+        unsigned int batchHandle;
+    };
+    std::vector<SceneModel> sceneModels = {
+            {"cat", &catModel, catObject, 0}, {"lamp", &lampModel, lampObject, 0},
+            {"tv", &tvModel, tvObject, 0}, {"sofa", &sofaModel, sofaObject, 0}
+    };
+    for (const SceneModel &sceneModel : sceneModels)
+        scene.SetLocalBounds(sceneModel.object, sceneModel.model->bounds);
+    scene.Update();
+
+    // BVH item i is sceneModels[i]; refitted when an object moves
+    BVH sceneBVH;
+    std::vector<AABB> sceneBounds;
+    for (const SceneModel &sceneModel : sceneModels)
+        sceneBounds.push_back(scene.WorldBounds(sceneModel.object));
+    sceneBVH.Build(sceneBounds);
+    std::vector<unsigned int> visibleItems;
+    std::vector<char> itemVisible(sceneModels.size());
+    // per-mesh triangle BVHs, built the first time a model's box is hit by a pick ray
+    std::vector<std::vector<std::unique_ptr<TriangleBVH>>> pickMeshes(sceneModels.size());
+
+    lampModel.SetFallbackTextures({Texture{lampTexture, "texture_diffuse", "lamp.jpg"}});
+    sofaModel.SetFallbackTextures({Texture{sofaDiffuse, "texture_diffuse", "sofa_diffuse.jpg"},
+                                   Texture{sofaSpecular, "texture_specular", "sofa_specular.jpg"}});
+    // sofa and tv not rendering correctly with culling
+    tvModel.SetRenderState(false, false);
+    sofaModel.SetRenderState(false, false);
+
+    // all model meshes in shared buffers, drawn with one multi-draw per texture set
+    MultiDrawBatch modelBatch;
+    for (SceneModel &sceneModel : sceneModels)
+        sceneModel.batchHandle = modelBatch.Add(*sceneModel.model, scene.World(sceneModel.object));
+    modelBatch.Build();
+
+    // one atlas per scene model, baked now; the stress cats share the cat's
+    Shader impostorBakeShader("resources/shaders/impostor_bake.vs", "resources/shaders/impostor_bake.fs");
+    std::vector<ImpostorAtlas> impostorAtlases(sceneModels.size());
+    for (unsigned int i = 0; i < sceneModels.size(); i++)
+        impostorAtlases[i].Bake(*sceneModels[i].model, impostorBakeShader);
+    // the model materials were bound with it; ShaderVariants may get its name back later
+    Material::ForgetProgram(impostorBakeShader.ID);
+    glDeleteProgram(impostorBakeShader.ID);
+    const ImpostorAtlas &catAtlas = impostorAtlases[0];
+    ImpostorRenderer impostorRenderer;
+
+    RenderQueue renderQueue;
+    FrustumCuller culler;
+
+    // occluders are the real triangles, so whatever they hide is really hidden
+    OccluderMesh wallsOccluder, tvOccluder, sofaOccluder;
+    wallsOccluder.Append(wallsMesh);
+    for (const Mesh &mesh : tvModel.meshes)
+        tvOccluder.Append(mesh);
+    for (const Mesh &mesh : sofaModel.meshes)
+        sofaOccluder.Append(mesh);
+    WorkerPool workerPool;
+    OcclusionRasterizer occlusionRasterizer;
+
+    InstanceBuffer stressInstances;
+    // the stress cats that survive occlusion culling
+    InstanceBuffer visibleStressInstances;
+    std::vector<glm::mat4> visibleStressTransforms;
+
+    // GPU path for the stress cats: tested against last frame's depth pyramid
+    GpuInstanceCuller gpuCuller;
+    HiZBuffer hiz;
+    glm::mat4 hizViewProjection = glm::mat4(1.0f);
+    if (cullInstancesShader != nullptr) {
+        gpuCuller.Create(catModel);
+        hiz.Create(targets.RenderWidth(), targets.RenderHeight());
+    }
+
     PointLight& pointLight = programState->pointLight;
     pointLight.position = glm::vec3(0.0f, 8.0f, 0.0f);
     pointLight.ambient = glm::vec3(0.9f, 0.9f, 0.9f);
@@ -525,8 +786,63 @@ int main() {
     spotLight.outerCutOff = glm::cos(glm::radians(87.0f));
 
 
-    hdrShader.use();
-    hdrShader.setInt("hdrBuffer", 0);
+    ClusteredLights clusteredLights;
+    clusteredLights.Create();
+    std::vector<Light> extraLights;
+
+    // The opaque room surfaces get the three lights baked, direct and bounced, one layer per
+    // light. Models shadow and bounce as they stand now with a neutral albedo; the lamp holds
+    // the lights and the glass lets them through. Only rebaked when the cache is out of date.
+    LightmapBaker lightmapBaker;
+    unsigned int floorReceiver = lightmapBaker.AddReceiver(floorMesh, floorTransform, floorAlbedo);
+    unsigned int wallsReceiver = lightmapBaker.AddReceiver(wallsMesh, wallsTransform, wallsAlbedo);
+    std::vector<unsigned int> tableLegReceivers;
+    for (const glm::mat4 &transform : tableLegTransforms)
+        tableLegReceivers.push_back(lightmapBaker.AddReceiver(tableLegMesh, transform, woodAlbedo));
+    for (const SceneModel &sceneModel : sceneModels)
+        if (sceneModel.object != lampObject)
+            for (const Mesh &mesh : sceneModel.model->meshes)
+                lightmapBaker.AddOccluder(mesh, scene.World(sceneModel.object), glm::vec3(0.5f));
+    unsigned int dirLightLayer = lightmapBaker.AddDirectionalLight(dirLight.direction, dirLight.ambient, dirLight.diffuse);
+    unsigned int pointLightLayer = lightmapBaker.AddLight(toLight(pointLight));
+    unsigned int spotLightLayer = lightmapBaker.AddLight(toLight(spotLight));
+    lightmapBaker.Bake(workerPool, "resources/room_lightmap.cache");
+    lightmapBaker.Upload();
+    lightmapBaker.Bind(LIGHTMAP_UNIT);
+    staticBatcher.SetLightmapCoords(floorBatchObject, lightmapBaker.Coords(floorReceiver));
+    staticBatcher.SetLightmapCoords(wallsBatchObject, lightmapBaker.Coords(wallsReceiver));
+    for (unsigned int i = 0; i < tableLegBatchObjects.size(); i++)
+        staticBatcher.SetLightmapCoords(tableLegBatchObjects[i], lightmapBaker.Coords(tableLegReceivers[i]));
+    staticBatcher.Build();
+    roomLightmapShader.use();
+    roomLightmapShader.setInt("lightmap", LIGHTMAP_UNIT);
+    roomLightmapShader.setInt("lightmapLayers", lightmapBaker.LayerCount());
+
+    // The room and every model that has never moved are static casters, kept in a cached
+    // map per light; a model joins the dynamic casters the first time it moves. The lamp
+    // holds both lights and the glass lets light through, so neither casts anything.
+    SpotShadowMap spotShadow;
+    spotShadow.Create(GL_TEXTURE_2D, 2048);
+    PointShadowMap pointShadow;
+    pointShadow.Create(GL_TEXTURE_CUBE_MAP, 1024);
+    std::vector<char> castsDynamic(sceneModels.size(), 0);
+    std::vector<AABB> casterBounds(sceneBounds);
+    std::vector<ShadowCaster> staticCasters, dynamicCasters;
+
+    deferredLightingShader.SetInitializer([](Shader &shader) {
+        shader.setInt("gAlbedoSpecular", 0);
+        shader.setInt("gNormal", 1);
+        shader.setInt("gDepth", 2);
+    });
+
+    // scene passes on the GPU, lighting included, tonemapping and ImGui not
+    GpuTimer sceneTimer;
+    sceneTimer.Create();
+    unsigned int sceneTimerResults = 0;
+    // the bloom chain, down and up
+    GpuTimer bloomTimer;
+    bloomTimer.Create();
+    cameraPath.Load("resources/camera_path.txt");
 
     // render loop
     // -----------
@@ -541,224 +857,515 @@ int main() {
         // -----
         processInput(window);
 
+        // a replay takes the camera over until the recorded frames run out
+        bool deferred = programState->DeferredShadingEnabled;
+        bool newSceneTime = sceneTimer.ResultCount() != sceneTimerResults;
+        sceneTimerResults = sceneTimer.ResultCount();
+        bool wasReplaying = cameraPath.Playing();
+        bool replayed = cameraPath.Replay(programState->camera, deltaTime * 1000.0f, newSceneTime,
+                                          sceneTimer.Milliseconds());
+        if (!replayed && wasReplaying) {
+            if (!formatComparison.Running())
+                replayTimings[(deferred ? 1 : 0) + (programState->DepthPrepassEnabled ? 2 : 0)] = cameraPath.LastTiming();
+            else if (formatComparison.ReplayFinished()) {
+                // straight into the second run, from this frame on
+                cameraPath.StartReplay();
+                replayed = cameraPath.Replay(programState->camera, 0.0f, false, 0.0f);
+            }
+        }
+        cameraPath.Record(programState->camera);
+
+        // the targets follow the window, the controller picks how much of them the scene covers
+        targets.Resize(framebufferWidth, framebufferHeight);
+        bloom.Resize(framebufferWidth, framebufferHeight);
+        post.Resize(framebufferWidth, framebufferHeight);
+        targets.SetColorFormat(formatComparison.Running() ? formatComparison.Format() : programState->HdrColorFormat);
+        // a format comparison draws both of its runs at full size
+        if (!programState->DynamicResolutionEnabled || formatComparison.Running())
+            dynamicResolution.Reset();
+        else if (newSceneTime)
+            dynamicResolution.Update(sceneTimer.Milliseconds(), programState->FrameBudgetMs,
+                                     programState->MinRenderScale);
+        targets.SetRenderScale(dynamicResolution.Scale());
+        int renderWidth = targets.RenderWidth(), renderHeight = targets.RenderHeight();
+        if (cullInstancesShader != nullptr)
+            hiz.Resize(renderWidth, renderHeight);
+
         // render into fbo
 
         glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
-        glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, targets.HdrFramebuffer());
+        glViewport(0, 0, renderWidth, renderHeight);
 
 
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
-        // don't forget to enable shader before setting uniforms
-        roomShader.use();
+        renderStats().BeginFrame();
+        renderStats().cpuFrameMs = deltaTime * 1000.0f;
+        renderStats().gpuSceneMs = sceneTimer.Milliseconds();
+        renderStats().gpuBloomMs = bloomTimer.Milliseconds();
+        renderStats().renderWidth = renderWidth;
+        renderStats().renderHeight = renderHeight;
+        sceneTimer.Begin();
+
+        // the deferred path fills the G-buffer first; same depth, so nothing to clear
+        if (deferred) {
+            glBindFramebuffer(GL_FRAMEBUFFER, targets.GBufferFramebuffer());
+            glEnable(GL_FRAMEBUFFER_SRGB);
+        }
+        ShaderVariants &meshShader = deferred ? gBufferShader : roomShader;
+        ShaderVariants &roomSurfaceShader = deferred ? gBufferArrayShader : roomArrayShader;
+        ShaderVariants *meshMdiShader = deferred ? gBufferMdiShader : roomMdiShader;
 
-        //pointlight
-        if (programState->PointLightEnabled) { // turn on/off pointlight
+        // fixed per light setup, until the histogram has a measurement of the frame
+        if (programState->PointLightEnabled)
             exposure = 0.3f;
-            roomShader.setVec3("pointLight.ambient", pointLight.ambient);
-            roomShader.setVec3("pointLight.diffuse", pointLight.diffuse);
-            roomShader.setVec3("pointLight.specular", pointLight.specular);
-        } else {
-            roomShader.setVec3("pointLight.ambient", glm::vec3(0.0f, 0.0f, 0.0f));
-            roomShader.setVec3("pointLight.diffuse", glm::vec3(0.0f, 0.0f, 0.0f));
-            roomShader.setVec3("pointLight.specular", glm::vec3(0.0f, 0.0f, 0.0f));
-        }
-        roomShader.setVec3("pointLight.position", pointLight.position);
-        roomShader.setFloat("pointLight.constant", pointLight.constant);
-        roomShader.setFloat("pointLight.linear", pointLight.linear);
-        roomShader.setFloat("pointLight.quadratic", pointLight.quadratic);
-
-        //dirlight
-        roomShader.setVec3("dirLight.direction", dirLight.direction);
-        roomShader.setVec3("dirLight.ambient", dirLight.ambient);
-        roomShader.setVec3("dirLight.diffuse", dirLight.diffuse);
-        roomShader.setVec3("dirLight.specular", dirLight.specular);
-
-        //spotlight
-        if (programState->SpotLightEnabled) { //turn on/off spotlight
+        if (programState->SpotLightEnabled)
             exposure = 2.0f;
-            roomShader.setVec3("spotLight.ambient", spotLight.ambient);
-            roomShader.setVec3("spotLight.diffuse", spotLight.diffuse);
-            roomShader.setVec3("spotLight.specular", spotLight.specular);
-        } else {
-            roomShader.setVec3("spotLight.ambient", glm::vec3(0.0f, 0.0f, 0.0f));
-            roomShader.setVec3("spotLight.diffuse", glm::vec3(0.0f, 0.0f, 0.0f));
-            roomShader.setVec3("spotLight.specular", glm::vec3(0.0f, 0.0f, 0.0f));
-        }
         if(!programState->SpotLightEnabled && !programState->PointLightEnabled)
             exposure = 0.7f;
         if(programState->SpotLightEnabled && programState->PointLightEnabled)
             exposure = 0.2f;
-
-        roomShader.setVec3("spotLight.direction", spotLight.direction);
-        roomShader.setVec3("spotLight.position", spotLight.position);
-        roomShader.setFloat("spotLight.constant", spotLight.constant);
-        roomShader.setFloat("spotLight.linear", spotLight.linear);
-        roomShader.setFloat("spotLight.quadratic", spotLight.quadratic);
-        roomShader.setFloat("spotLight.cutOff", spotLight.cutOff);
-        roomShader.setFloat("spotLight.outerCutOff", spotLight.outerCutOff);
-
-        roomShader.setVec3("viewPosition", programState->camera.Position);
-        roomShader.setFloat("material.shininess", 32.0f);
+        bool autoExposureEnabled = programState->AutoExposureEnabled && luminanceHistogramShader != nullptr;
+        if (autoExposureEnabled) {
+            // held where it is over a format comparison, so both runs see the same exposure
+            if (!formatComparison.Running())
+                autoExposure.Adapt(deltaTime, programState->ExposureCompensation);
+            if (autoExposure.Ready())
+                exposure = autoExposure.Exposure();
+        }
 
         // view/projection transformations
         glm::mat4 projection = glm::perspective(glm::radians(programState->camera.Zoom),
-                                                (float) SCR_WIDTH / (float) SCR_HEIGHT, 0.1f, 100.0f);
+                                                (float) targets.Width() / (float) targets.Height(), 0.1f, 100.0f);
         glm::mat4 view = programState->camera.GetViewMatrix();
-        roomShader.setMat4("projection", projection);
-        roomShader.setMat4("view", view);
-
-        //render floor
-
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, floorDiffuseMap);
-
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, floorSpecularMap);
-
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::scale(model, glm::vec3(30.0f, 0.0f, 30.0f));
-        roomShader.setMat4("model", model);
-
-        glBindVertexArray(floorVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-
-        //render walls
-
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, wallsDiffuseMap);
-
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, wallsSpecularMap);
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0, 5.0, 0.0));
-        model = glm::scale(model, glm::vec3(30.0f, 10.0f, 30.0f));
-        roomShader.setMat4("model", model);
-
-        glBindVertexArray(wallsVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 24);
-
-        //render table legs
+        glm::mat4 viewProjection = projection * view;
+
+        // a format comparison animates by replay frame, so both runs capture the same poses
+        float animationTime = formatComparison.Running() && replayed ? cameraPath.Frame() / 60.0f : currentFrame;
+        if (programState->SpinCat)
+            scene.SetRotation(catObject, glm::angleAxis(animationTime, glm::vec3(0.0f, 1.0f, 0.0f)) * catRotation);
+        glm::mat4 glassWorld = glassTransform;
+        if (programState->FloatGlass) {
+            float lift = 0.5f + 0.5f * std::sin(animationTime);
+            glassWorld = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, lift, 0.0f)) * glassTransform;
+            // baked where it stood: its batch is rebuilt without it, the others stay as they are
+            staticBatcher.Remove(glassBatchObject);
+        }
+        scene.Update();
+        renderStats().transformsUpdated = scene.Changed().size();
+        for (unsigned int object : scene.Changed()) {
+            for (unsigned int i = 0; i < sceneModels.size(); i++) {
+                if (sceneModels[i].object != object)
+                    continue;
+                modelBatch.SetTransform(sceneModels[i].batchHandle, scene.World(object));
+                sceneBVH.Update(i, scene.WorldBounds(object));
+                if (!castsDynamic[i]) {
+                    castsDynamic[i] = 1;
+                    spotShadow.InvalidateStatic();
+                    pointShadow.InvalidateStatic();
+                }
+                spotShadow.CasterMoved(casterBounds[i], scene.WorldBounds(object));
+                pointShadow.CasterMoved(casterBounds[i], scene.WorldBounds(object));
+                casterBounds[i] = scene.WorldBounds(object);
+            }
+        }
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, woodDiffuseMap);
+        // shadow maps: statics only after the light or the static set changed, dynamics after a move
+        bool shadows = programState->ShadowsEnabled;
+        Light spotLightShaded = toLight(programState->spotLight);
+        Light pointLightShaded = toLight(programState->pointLight);
+        if (shadows) {
+            staticCasters = {{&floorMesh, floorTransform, nullptr}, {&wallsMesh, wallsTransform, nullptr},
+                             {&tableLegMesh, glm::mat4(1.0f), &tableLegInstances}};
+            dynamicCasters.clear();
+            for (unsigned int i = 0; i < sceneModels.size(); i++) {
+                if (sceneModels[i].object == lampObject)
+                    continue;
+                std::vector<ShadowCaster> &casters = castsDynamic[i] ? dynamicCasters : staticCasters;
+                for (Mesh &mesh : sceneModels[i].model->meshes)
+                    casters.push_back({&mesh, scene.World(sceneModels[i].object), nullptr});
+            }
+            if (programState->SpotLightEnabled) {
+                const SpotLight &light = programState->spotLight;
+                spotShadow.SetLight(light.position, light.direction, light.outerCutOff, lightRange(spotLightShaded));
+                renderStats().shadowPasses += spotShadow.Render(shadowDepthShader, staticCasters, dynamicCasters);
+                spotLightShaded.shadow = SHADOW_SPOT;
+            }
+            if (programState->PointLightEnabled) {
+                pointShadow.SetLight(programState->pointLight.position, lightRange(pointLightShaded));
+                renderStats().shadowPasses += pointShadow.Render(shadowCubeShader, staticCasters, dynamicCasters);
+                pointLightShaded.shadow = SHADOW_POINT;
+            }
+        }
+        spotShadow.Bind(SPOT_SHADOW_UNIT);
+        pointShadow.Bind(POINT_SHADOW_UNIT);
+
+        // a light that is off is simply not there, rather than evaluated with zero color
+        clusteredLights.Begin();
+        if (programState->PointLightEnabled)
+            clusteredLights.Add(pointLightShaded);
+        if (programState->SpotLightEnabled)
+            clusteredLights.Add(spotLightShaded);
+        if (extraLights.size() != (unsigned int) programState->ExtraLightCount)
+            extraLights = scatteredLights(programState->ExtraLightCount);
+        for (const Light &light : extraLights)
+            clusteredLights.Add(light);
+        clusteredLights.Update(view, projection, 0.1f, 100.0f, targets.RenderSize());
+        renderStats().lights = clusteredLights.LightCount();
+        renderStats().clusterLightIndices = clusteredLights.IndexCount();
+        renderStats().maxClusterLights = clusteredLights.MaxPerCluster();
+
+        // lights that are off, or on without a shadow map, leave their code out of the lit variants
+        unsigned int lightFeatures = 0;
+        if (clusteredLights.LightCount() > 0)
+            lightFeatures |= FEATURE_CLUSTERED_LIGHTS;
+        if (spotLightShaded.shadow != SHADOW_NONE || pointLightShaded.shadow != SHADOW_NONE)
+            lightFeatures |= FEATURE_SHADOWS;
+        for (ShaderVariants *variants : shaderVariants) {
+            variants->Update();
+            variants->SetFrameFeatures(lightFeatures);
+            renderStats().shaderVariants += variants->ReadyCount();
+            renderStats().shaderVariantsPending += variants->PendingCount();
+        }
 
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, woodSpecularMap);
+        // every linked variant gets them, whichever the draws end up with
+        auto setFrameUniforms = [&](Shader &shader) {
+            setRoomUniforms(shader, programState, clusteredLights, spotShadow, pointShadow, view, projection);
+        };
+        bool multiDraw = programState->MultiDrawIndirectEnabled;
+        if (multiDraw && roomMdiShader != nullptr)
+            roomMdiShader->ForEachReady(setFrameUniforms);
+        roomShader.ForEachReady(setFrameUniforms);
+        roomArrayShader.ForEachReady(setFrameUniforms);
+        impostorShader.ForEachReady(setFrameUniforms);
+        if (deferred) {
+            if (multiDraw && gBufferMdiShader != nullptr)
+                gBufferMdiShader->ForEachReady(setFrameUniforms);
+            gBufferShader.ForEachReady(setFrameUniforms);
+            gBufferArrayShader.ForEachReady(setFrameUniforms);
+            deferredLightingShader.ForEachReady([&](Shader &shader) {
+                setFrameUniforms(shader);
+                shader.setMat4("inverseProjection", glm::inverse(projection));
+                shader.setMat4("inverseView", glm::inverse(view));
+            });
+        }
+        bool prepass = programState->DepthPrepassEnabled;
+        if (prepass) {
+            depthShader.use();
+            depthShader.setMat4("projection", projection);
+            depthShader.setMat4("view", view);
+            if (multiDraw && depthMdiShader != nullptr) {
+                depthMdiShader->use();
+                depthMdiShader->setMat4("projection", projection);
+                depthMdiShader->setMat4("view", view);
+            }
+        }
+        // The lightmap has no G-buffer path, the deferred room is lit like everything else.
+        // Nor does it follow the overlay's light sliders: once a light differs from what was
+        // baked, the room goes back to the live shader.
+        lightmapCurrent = lightmapBaker.MatchesDirectional(dirLightLayer, programState->dirLight.direction,
+                                                           programState->dirLight.ambient,
+                                                           programState->dirLight.diffuse)
+                          && lightmapBaker.Matches(pointLightLayer, toLight(programState->pointLight))
+                          && lightmapBaker.Matches(spotLightLayer, toLight(programState->spotLight));
+        bool lightmapped = programState->LightmapEnabled && !deferred && lightmapCurrent;
+        if (lightmapped) {
+            roomLightmapShader.use();
+            roomLightmapShader.setMat4("projection", projection);
+            roomLightmapShader.setMat4("view", view);
+            float weights[LIGHTMAP_MAX_LAYERS] = {0.0f};
+            weights[dirLightLayer] = 1.0f;
+            weights[pointLightLayer] = programState->PointLightEnabled ? 1.0f : 0.0f;
+            weights[spotLightLayer] = programState->SpotLightEnabled ? 1.0f : 0.0f;
+            for (unsigned int layer = 0; layer < LIGHTMAP_MAX_LAYERS; layer++)
+                roomLightmapShader.setFloat("lightmapWeights[" + std::to_string(layer) + "]", weights[layer]);
+        }
 
-        glBindVertexArray(cubeVAO);
+        renderQueue.Begin(view, 100.0f);
 
-        for (int i = 0; i < 4; i++) {
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, tableLegsPosition[i]);
-            model = glm::scale(model, glm::vec3(0.5f, 2.0f, 0.5f));
+        bool portals = programState->PortalCullingEnabled;
+        if (portals) {
+            cells.Update(projection * view, programState->camera.Position);
+            renderStats().visibleCells = cells.VisibleCount();
+        }
 
-            roomShader.setMat4("model", model);
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+        // only false from outside, looking away from the ceiling opening
+        bool roomVisible = !portals || cells.Visible(roomCell);
+        if (roomVisible && programState->StaticBatchingEnabled) {
+            // floor, walls, table legs and glass
+            staticBatcher.Build();
+            if (lightmapped)
+                staticBatcher.Submit(renderQueue, roomLightmapShader, roomArrayShader);
+            else
+                staticBatcher.Submit(renderQueue, roomSurfaceShader, roomArrayShader);
+            if (!staticBatcher.Contains(glassBatchObject))
+                renderQueue.Submit(roomArrayShader, glassMesh, glassWorld);
+        } else if (roomVisible) {
+            //render floor
+            renderQueue.Submit(roomSurfaceShader, floorMesh, floorTransform);
+
+            //render walls
+            renderQueue.Submit(roomSurfaceShader, wallsMesh, wallsTransform);
+
+            //render table legs
+            renderQueue.Submit(roomSurfaceShader, tableLegMesh, glm::mat4(1.0f), &tableLegInstances);
+
+            //table glass
+            renderQueue.Submit(roomArrayShader, glassMesh, glassWorld);
         }
 
         // render the loaded models
 
-        //cat
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(7.0f, 0.0f, 0.0f));
-        model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0, 0.0, 0.0));
-        model = glm::rotate(model, glm::radians(-45.0f), glm::vec3(0.0, 0.0, 1.0));
-        model = glm::scale(model, glm::vec3(0.08f));
-        roomShader.setMat4("model", model);
-        catModel.Draw(roomShader);
-
-
-        //lamp
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, lampTexture);
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model,glm::vec3(0.0f, 8.0f, 0.0f));
-        model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(0.03f));
-        roomShader.setMat4("model", model);
-        lampModel.Draw(roomShader);
-
-        //tv
-
-        glDisable(GL_CULL_FACE); // sofa ana tv not rendering correctly
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model,glm::vec3(-3.0, 3.0, -11.0));
-
-        roomShader.setMat4("model", model);
-        tvModel.Draw(roomShader);
+        bool occlusion = programState->OcclusionCullingEnabled;
+        if (occlusion) {
+            auto occlusionStart = std::chrono::high_resolution_clock::now();
+            occlusionRasterizer.Begin(projection * view);
+            occlusionRasterizer.AddOccluder(wallsOccluder, wallsTransform);
+            occlusionRasterizer.AddOccluder(tvOccluder, scene.World(tvObject));
+            occlusionRasterizer.AddOccluder(sofaOccluder, scene.World(sofaObject));
+            occlusionRasterizer.Rasterize(workerPool);
+            renderStats().occlusionMs = std::chrono::duration<float, std::milli>(
+                    std::chrono::high_resolution_clock::now() - occlusionStart).count();
+        }
 
-        //sofa
+        bool impostors = programState->ImpostorsEnabled;
+        impostorRenderer.Begin();
+
+        culler.Begin(view, projection, programState->camera.Position, (float) renderHeight, programState->CullMinPixelSize);
+        // hierarchical frustum test through the BVH, then screen size per survivor
+        visibleItems.clear();
+        sceneBVH.Cull(culler.Planes(), visibleItems);
+        std::fill(itemVisible.begin(), itemVisible.end(), 0);
+        for (unsigned int item : visibleItems)
+            itemVisible[item] = 1;
+        for (unsigned int i = 0; i < sceneModels.size(); i++) {
+            const SceneModel &sceneModel = sceneModels[i];
+            const glm::mat4 &world = scene.World(sceneModel.object);
+            bool visible = true;
+            BoundingSphere worldSphere = transformSphere(sceneModel.model->sphere, world);
+            if (programState->FrustumCullingEnabled) {
+                visible = itemVisible[i] && culler.LargeEnough(worldSphere);
+                if (!visible)
+                    culler.Reject(sceneModel.model->triangleCount);
+            }
+            if (visible && portals) {
+                // only what is seen through the portals leading to the object's cell
+                const AABB &bounds = scene.WorldBounds(sceneModel.object);
+                const CellGraph::CellView &cellView = cells.View(cells.FindCell(bounds.Center()));
+                visible = cellView.visible && intersects(cellView.frustum, bounds);
+                if (!visible)
+                    culler.Reject(sceneModel.model->triangleCount);
+            }
+            if (visible && occlusion && !occlusionRasterizer.IsVisible(scene.WorldBounds(sceneModel.object))) {
+                visible = false;
+                renderStats().occludedObjects++;
+            }
+            // far enough away: the billboard takes over, dithered in over the mesh first
+            bool meshVisible = visible;
+            if (visible && impostors) {
+                float opacity = impostorOpacity(glm::length(worldSphere.center - programState->camera.Position),
+                                                programState->ImpostorDistance, programState->ImpostorFadeRange);
+                if (opacity > 0.0f)
+                    impostorRenderer.Add(impostorAtlases[i], world, opacity);
+                meshVisible = opacity < 1.0f;
+            }
+            if (multiDraw)
+                modelBatch.SetVisible(sceneModel.batchHandle, meshVisible);
+            else if (meshVisible)
+                renderQueue.Submit(meshShader, *sceneModel.model, world);
+        }
+        if (pickRequested) {
+            pickRequested = false;
+            int windowWidth, windowHeight;
+            glfwGetWindowSize(window, &windowWidth, &windowHeight);
+            Ray ray = cursorRay(pickX, pickY, glm::vec2(windowWidth, windowHeight), view, projection);
+            // box hits from the BVH are refined against the model's triangles in object space
+            auto hitModel = [&](unsigned int item, const Ray &worldRay, float maxDistance) {
+                const SceneModel &sceneModel = sceneModels[item];
+                glm::mat4 toObject = glm::inverse(scene.World(sceneModel.object));
+                // not renormalized, so distances stay in world units
+                Ray objectRay{glm::vec3(toObject * glm::vec4(worldRay.origin, 1.0f)),
+                              glm::mat3(toObject) * worldRay.direction};
+                std::vector<std::unique_ptr<TriangleBVH>> &meshes = pickMeshes[item];
+                if (meshes.empty())
+                    for (const Mesh &mesh : sceneModel.model->meshes)
+                        meshes.emplace_back(new TriangleBVH(mesh));
+                float closest = maxDistance;
+                for (const std::unique_ptr<TriangleBVH> &mesh : meshes)
+                    closest = std::min(closest, mesh->Raycast(objectRay, closest));
+                return closest < maxDistance ? closest : FLT_MAX;
+            };
+            unsigned int item;
+            float distance;
+            if (sceneBVH.Raycast(ray, hitModel, item, distance))
+                programState->PickedObject = std::string(sceneModels[item].name) + " at " + std::to_string(distance);
+            else
+                programState->PickedObject = "none";
+        }
 
+        if (programState->BVHStressRequested) {
+            programState->BVHStressRequested = false;
+            bvhStressResult = runBVHStress(100000, culler.Planes(), programState->camera.Position);
+        }
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, sofaDiffuse);
+        // instancing stress test: copies of the cat laid out on the floor, one call per mesh
+        if (stressInstances.Count() != (unsigned int) programState->StressInstanceCount) {
+            stressInstances.SetTransforms(gridTransforms(programState->StressInstanceCount, scene.World(catObject)));
+            if (cullInstancesShader != nullptr)
+                gpuCuller.SetInstances(stressInstances.Transforms(), catModel.bounds);
+        }
+        bool gpuCulling = programState->GpuCullingEnabled && cullInstancesShader != nullptr;
+        if (gpuCulling) {
+            // drawn with the model batch, outside the queue; the CPU never learns which ones survived
+            gpuCuller.Cull(*cullInstancesShader, culler.Planes(), hiz, hizViewProjection);
+            renderStats().gpuInstances = gpuCuller.InstanceCount();
+            renderStats().gpuVisibleInstances = gpuCuller.VisibleCount();
+        } else if ((occlusion || impostors) && stressInstances.Count() > 0) {
+            visibleStressTransforms.clear();
+            for (const glm::mat4 &transform : stressInstances.Transforms()) {
+                if (occlusion && !occlusionRasterizer.IsVisible(transformAABB(catModel.bounds, transform))) {
+                    renderStats().occludedObjects++;
+                    continue;
+                }
+                if (impostors) {
+                    glm::vec3 center = glm::vec3(transform * glm::vec4(catModel.sphere.center, 1.0f));
+                    float opacity = impostorOpacity(glm::length(center - programState->camera.Position),
+                                                    programState->ImpostorDistance, programState->ImpostorFadeRange);
+                    if (opacity > 0.0f)
+                        impostorRenderer.Add(catAtlas, transform, opacity);
+                    if (opacity >= 1.0f)
+                        continue;
+                }
+                visibleStressTransforms.push_back(transform);
+            }
+            visibleStressInstances.SetTransforms(visibleStressTransforms);
+            renderQueue.Submit(meshShader, catModel, glm::mat4(1.0f), &visibleStressInstances);
+        } else {
+            renderQueue.Submit(meshShader, catModel, glm::mat4(1.0f), &stressInstances);
+        }
 
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, sofaSpecular);
+        renderQueue.Sort();
+        // Everything opaque that is lit goes through here first: the model batch, the GPU-culled
+        // cats and the queue's opaque items. Impostors dither with discard and are left out;
+        // they test and write depth as usual after the lit pass.
+        if (prepass) {
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            if (multiDraw)
+                modelBatch.Draw(depthMdiShader, depthShader);
+            if (gpuCulling)
+                gpuCuller.Draw(depthShader);
+            renderQueue.ExecuteDepth(depthShader);
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            glDepthFunc(GL_EQUAL);
+            glDepthMask(GL_FALSE);
+        }
+        if (multiDraw)
+            modelBatch.Draw(meshMdiShader, meshShader);
+        if (gpuCulling)
+            gpuCuller.Draw(meshShader);
+        renderQueue.Execute(PASS_OPAQUE);
+        if (prepass) {
+            glDepthFunc(GL_LESS);
+            glDepthMask(GL_TRUE);
+        }
+        if (deferred) {
+            glDisable(GL_FRAMEBUFFER_SRGB);
+
+            // every covered pixel lit once, then the forward-only draws on top
+            glBindFramebuffer(GL_FRAMEBUFFER, targets.HdrFramebuffer());
+            deferredLightingShader.Select().use();
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, targets.GAlbedoSpecular());
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, targets.GNormal());
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_2D, targets.DepthTexture());
+            glActiveTexture(GL_TEXTURE0);
+            glDisable(GL_DEPTH_TEST);
+            renderQuad();
+            glEnable(GL_DEPTH_TEST);
+        }
+        impostorRenderer.Draw(impostorShader.Select());
+        renderQueue.Execute(PASS_TRANSPARENT);
 
-        model = glm::mat4(1.0f);
-        model = glm::translate(model,glm::vec3(-5.0f, 0.6f, 9.0f));
-        model = glm::scale(model, glm::vec3(0.025f));
-        roomShader.setMat4("model", model);
-        sofaModel.Draw(roomShader);
+        //cubemap
 
-        //table glass
+        // the sky only shows through portals to the outside, and only inside what they cover
+        if (!portals || cells.Visible(OUTSIDE_CELL)) {
+            if (portals) {
+                const glm::vec4 &rect = cells.View(OUTSIDE_CELL).rect;
+                int x0 = (int) std::floor((rect.x * 0.5f + 0.5f) * renderWidth);
+                int y0 = (int) std::floor((rect.y * 0.5f + 0.5f) * renderHeight);
+                int x1 = (int) std::ceil((rect.z * 0.5f + 0.5f) * renderWidth);
+                int y1 = (int) std::ceil((rect.w * 0.5f + 0.5f) * renderHeight);
+                glEnable(GL_SCISSOR_TEST);
+                glScissor(x0, y0, x1 - x0, y1 - y0);
+            }
+            glDepthFunc(GL_LEQUAL);
+            cubemapShader.use();
+            view = glm::mat4(glm::mat3(programState->camera.GetViewMatrix()));
+            cubemapShader.setMat4("view", view);
+            cubemapShader.setMat4("projection", projection);
+            // skybox cube
+            glBindVertexArray(cubemapVAO);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+            glDrawArrays(GL_TRIANGLES, 0, 36);
+            renderStats().AddDraw(36);
+            glBindVertexArray(0);
+            glDepthFunc(GL_LESS);
+            glDisable(GL_SCISSOR_TEST);
+        }
 
-        glEnable(GL_BLEND);
+        sceneTimer.End();
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, glassDiffuseMap);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, glassSpecularMap);
+        renderCube();
 
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-1.53f, 2.01f, 1.49f));
-        model = glm::scale(model, glm::vec3(9.6f, 0.0f, 7.6f));
-        roomShader.setMat4("model", model);
+        if (gpuCulling) {
+            // the depth of this frame culls the next one
+            hiz.Build(*hizReduceShader, targets.DepthTexture());
+            hizViewProjection = viewProjection;
+        }
 
-        glBindVertexArray(glassVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+        // measured now, read back a few frames later for the exposure of those frames
+        if (autoExposureEnabled)
+            autoExposure.Measure(*luminanceHistogramShader, targets.ColorBuffer(), renderWidth, renderHeight);
 
-        glDisable(GL_BLEND);
-        glEnable(GL_CULL_FACE); // glass have both sides
+        bool bloomEnabled = programState->BloomEnabled && bloom.LevelCount() > 0;
+        if (bloomEnabled) {
+            bloomTimer.Begin();
+            bloom.Render(bloomDownsampleShader, bloomUpsampleShader, targets.ColorBuffer(), renderWidth, renderHeight);
+            bloomTimer.End();
+        }
 
-        //cubemap
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, targets.Width(), targets.Height());
 
-        glDepthFunc(GL_LEQUAL);
-        cubemapShader.use();
-        view = glm::mat4(glm::mat3(programState->camera.GetViewMatrix()));
-        cubemapShader.setMat4("view", view);
-        cubemapShader.setMat4("projection", projection);
-        // skybox cube
-        glBindVertexArray(cubemapVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
-        glDepthFunc(GL_LESS);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+        // hdr off is the old plain gamma: no tone curve in the table and no exposure
+        post.SetGrading(programState->Grading, hdr);
+        PostInputs postInputs;
+        postInputs.sceneTexture = targets.ColorBuffer();
+        // the part of the color buffer the scene covered, stretched over the window
+        postInputs.sceneSize = targets.RenderSize();
+        postInputs.bloomTexture = bloom.Texture();
+        postInputs.bloomExtent = bloom.Extent();
+        postInputs.bloomStrength = bloomEnabled ? programState->BloomStrength : 0.0f;
+        postInputs.exposure = hdr ? exposure : 1.0f;
+        if (programState->ComputePostEnabled && postComputeShader != nullptr)
+            post.Dispatch(*postComputeShader, postInputs);
+        else
+            post.Draw(postShader, postInputs);
+        if (formatComparison.Running() && replayed)
+            formatComparison.Capture(cameraPath.Frame(), targets.Width(), targets.Height());
 
+        // over the resolved frame, at window resolution whatever the scene's scale
         if (programState->ImGuiEnabled)
             DrawImGui(programState);
 
-        renderCube();
-
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
-        hdrShader.use();
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, colorBuffer);
-        hdrShader.setInt("hdr", hdr);
-        hdrShader.setFloat("exposure", exposure);
-        renderQuad();
-
         std::cout << "hdr: " << (hdr ? "on" : "off") << std::endl;
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
@@ -769,20 +1376,54 @@ int main() {
 
     programState->SaveToFile("resources/program_state.txt");
     delete programState;
+    for (ShaderVariants *variants : shaderVariants)
+        variants->Delete();
+    if (roomMdiShader != nullptr) {
+        glDeleteProgram(depthMdiShader->ID);
+        delete roomMdiShader;
+        delete gBufferMdiShader;
+        delete depthMdiShader;
+    }
+    sceneTimer.Delete();
+    bloomTimer.Delete();
+    bloom.Delete();
+    glDeleteProgram(bloomDownsampleShader.ID);
+    glDeleteProgram(bloomUpsampleShader.ID);
+    post.Delete();
+    glDeleteProgram(postShader.ID);
+    targets.Delete();
+    if (luminanceHistogramShader != nullptr) {
+        glDeleteProgram(luminanceHistogramShader->ID);
+        glDeleteProgram(postComputeShader->ID);
+        delete luminanceHistogramShader;
+        delete postComputeShader;
+        autoExposure.Delete();
+    }
+    if (cullInstancesShader != nullptr) {
+        glDeleteProgram(cullInstancesShader->ID);
+        glDeleteProgram(hizReduceShader->ID);
+        delete cullInstancesShader;
+        delete hizReduceShader;
+        gpuCuller.Delete();
+        hiz.Delete();
+    }
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
 
-    glDeleteVertexArrays(1, &floorVAO);
-    glDeleteVertexArrays(1, &wallsVAO);
-    glDeleteVertexArrays(1, &cubeVAO);
-    glDeleteVertexArrays(1, &glassVAO);
     glDeleteVertexArrays(1, &cubemapVAO);
-    glDeleteBuffers(1, &floorVBO);
-    glDeleteBuffers(1, &wallsVBO);
-    glDeleteBuffers(1, &cubeVBO);
-    glDeleteBuffers(1, &glassVBO);
     glDeleteBuffers(1, &cubemapVBO);
+    tableLegInstances.Delete();
+    staticBatcher.Delete();
+    stressInstances.Delete();
+    visibleStressInstances.Delete();
+    impostorRenderer.Delete();
+    clusteredLights.Delete();
+    lightmapBaker.Delete();
+    spotShadow.Delete();
+    pointShadow.Delete();
+    for (ImpostorAtlas &atlas : impostorAtlases)
+        atlas.Delete();
 
     glfwTerminate();
     return 0;
@@ -817,9 +1458,10 @@ void processInput(GLFWwindow *window) {
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
 // ---------------------------------------------------------------------------------------------
 void framebuffer_size_callback(GLFWwindow *window, int width, int height) {
-    // make sure the viewport matches the new window dimensions; note that width and
-    // height will be significantly larger than specified on retina displays.
-    glViewport(0, 0, width, height);
+    // the next frame resizes the scene targets and sets the viewports from this; note that
+    // width and height will be significantly larger than specified on retina displays.
+    framebufferWidth = width;
+    framebufferHeight = height;
 }
 
 // glfw: whenever the mouse moves, this callback is called
@@ -847,6 +1489,177 @@ void scroll_callback(GLFWwindow *window, double xoffset, double yoffset) {
     programState->camera.ProcessMouseScroll(yoffset);
 }
 
+// lights, camera and material uniforms shared by every program that runs room.fs
+// -----------------------------------------------------------------------------
+void setRoomUniforms(Shader &shader, ProgramState *programState, const ClusteredLights &lights,
+                     const SpotShadowMap &spotShadow, const PointShadowMap &pointShadow,
+                     const glm::mat4 &view, const glm::mat4 &projection) {
+    const DirLight& dirLight = programState->dirLight;
+
+    //dirlight
+    shader.setVec3("dirLight.direction", dirLight.direction);
+    shader.setVec3("dirLight.ambient", dirLight.ambient);
+    shader.setVec3("dirLight.diffuse", dirLight.diffuse);
+    shader.setVec3("dirLight.specular", dirLight.specular);
+
+    // point and spot lights come from the clusters
+    lights.SetUniforms(shader);
+    spotShadow.SetUniforms(shader);
+    pointShadow.SetUniforms(shader);
+    shader.setInt("shadowPcfRadius", programState->ShadowPcfRadius);
+
+    shader.setVec3("viewPosition", programState->camera.Position);
+    shader.setFloat("material.shininess", 32.0f);
+
+    shader.setMat4("projection", projection);
+    shader.setMat4("view", view);
+}
+
+Light toLight(const PointLight &pointLight) {
+    Light light;
+    light.position = pointLight.position;
+    light.constant = pointLight.constant;
+    light.linear = pointLight.linear;
+    light.quadratic = pointLight.quadratic;
+    light.ambient = pointLight.ambient;
+    light.diffuse = pointLight.diffuse;
+    light.specular = pointLight.specular;
+    return light;
+}
+
+Light toLight(const SpotLight &spotLight) {
+    Light light;
+    light.position = spotLight.position;
+    light.direction = spotLight.direction;
+    light.cutOff = spotLight.cutOff;
+    light.outerCutOff = spotLight.outerCutOff;
+    light.constant = spotLight.constant;
+    light.linear = spotLight.linear;
+    light.quadratic = spotLight.quadratic;
+    light.ambient = spotLight.ambient;
+    light.diffuse = spotLight.diffuse;
+    light.specular = spotLight.specular;
+    return light;
+}
+
+// count short-range colored lights just above the floor, the same ones for the same count
+// -----------------------------------------------------------------------------------------
+std::vector<Light> scatteredLights(int count) {
+    std::mt19937 random(7);
+    std::uniform_real_distribution<float> across(-14.0f, 14.0f), height(0.5f, 4.0f), channel(0.2f, 1.0f);
+    std::vector<Light> lights;
+    lights.reserve(count);
+    for (int i = 0; i < count; i++) {
+        glm::vec3 color(channel(random), channel(random), channel(random));
+        Light light;
+        light.position = glm::vec3(across(random), height(random), across(random));
+        light.constant = 1.0f;
+        light.linear = 0.7f;
+        light.quadratic = 1.8f;
+        light.ambient = color * 0.05f;
+        light.diffuse = color * 1.5f;
+        light.specular = color;
+        lights.push_back(light);
+    }
+    return lights;
+}
+
+// count copies of base spread over a square grid covering the floor
+// -----------------------------------------------------------------
+std::vector<glm::mat4> gridTransforms(int count, const glm::mat4 &base) {
+    std::vector<glm::mat4> transforms;
+    transforms.reserve(count);
+    int side = (int) std::ceil(std::sqrt((float) count));
+    float spacing = side > 0 ? 28.0f / side : 0.0f;
+    float scale = std::min(1.0f, spacing / 3.0f);
+    glm::mat4 local = base;
+    local[3] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    for (int i = 0; i < count; i++) {
+        glm::vec3 position(-14.0f + spacing * (i % side + 0.5f), 0.0f, -14.0f + spacing * (i / side + 0.5f));
+        glm::mat4 model = glm::translate(glm::mat4(1.0f), position);
+        model = glm::scale(model, glm::vec3(scale));
+        transforms.push_back(model * local);
+    }
+    return transforms;
+}
+
+// ray from the camera through a cursor position in window coordinates
+Ray cursorRay(double x, double y, const glm::vec2 &windowSize, const glm::mat4 &view, const glm::mat4 &projection) {
+    glm::mat4 inverseViewProjection = glm::inverse(projection * view);
+    float ndcX = 2.0f * (float) x / windowSize.x - 1.0f;
+    float ndcY = 1.0f - 2.0f * (float) y / windowSize.y;
+    glm::vec4 nearPoint = inverseViewProjection * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+    glm::vec4 farPoint = inverseViewProjection * glm::vec4(ndcX, ndcY, 1.0f, 1.0f);
+    glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+    glm::vec3 target = glm::vec3(farPoint) / farPoint.w;
+    return Ray{origin, glm::normalize(target - origin)};
+}
+
+// Random boxes filling the room, timed through build, frustum cull, rays from the camera,
+// sphere queries and refits. Averages per query.
+BVHStressResult runBVHStress(unsigned int count, const Frustum &frustum, const glm::vec3 &cameraPosition) {
+    typedef std::chrono::high_resolution_clock Clock;
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> x(-15.0f, 15.0f), y(0.0f, 10.0f), size(0.05f, 0.5f);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+    std::vector<AABB> boxes(count);
+    for (AABB &box : boxes) {
+        glm::vec3 center(x(random), y(random), x(random));
+        glm::vec3 extents(size(random), size(random), size(random));
+        box.min = center - extents;
+        box.max = center + extents;
+    }
+
+    BVHStressResult result;
+    result.objects = count;
+    BVH bvh;
+    Clock::time_point start = Clock::now();
+    bvh.Build(boxes);
+    result.buildMs = std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+    result.nodes = bvh.NodeCount();
+
+    const unsigned int culls = 20;
+    std::vector<unsigned int> found;
+    start = Clock::now();
+    for (unsigned int i = 0; i < culls; i++) {
+        found.clear();
+        bvh.Cull(frustum, found);
+    }
+    result.cullMs = std::chrono::duration<float, std::milli>(Clock::now() - start).count() / culls;
+    result.visible = found.size();
+
+    const unsigned int queries = 1000;
+    std::vector<Ray> rays(queries);
+    for (Ray &ray : rays)
+        ray = Ray{cameraPosition, glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) + glm::vec3(0.0f, 0.0f, 0.001f))};
+    unsigned int item;
+    float distance;
+    start = Clock::now();
+    for (const Ray &ray : rays)
+        bvh.Raycast(ray, item, distance);
+    result.raycastUs = std::chrono::duration<float, std::micro>(Clock::now() - start).count() / queries;
+
+    start = Clock::now();
+    for (unsigned int i = 0; i < queries; i++) {
+        found.clear();
+        bvh.Overlap(BoundingSphere{glm::vec3(x(random), y(random), x(random)), 1.0f}, found);
+    }
+    result.overlapUs = std::chrono::duration<float, std::micro>(Clock::now() - start).count() / queries;
+
+    start = Clock::now();
+    for (unsigned int i = 0; i < queries; i++) {
+        unsigned int moved = random() % count;
+        AABB box = boxes[moved];
+        glm::vec3 offset(unit(random) * 0.1f, 0.0f, unit(random) * 0.1f);
+        box.min += offset;
+        box.max += offset;
+        bvh.Update(moved, box);
+    }
+    result.refitUs = std::chrono::duration<float, std::micro>(Clock::now() - start).count() / queries;
+    return result;
+}
+
 void DrawImGui(ProgramState *programState) {
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
@@ -867,6 +1680,7 @@ void DrawImGui(ProgramState *programState) {
 
         ImGui::Checkbox("Turn on point light", &programState->PointLightEnabled);
         ImGui::Checkbox("Turn on spot light", &programState->SpotLightEnabled);
+        ImGui::SliderInt("Extra point lights", &programState->ExtraLightCount, 0, 1000);
 
         ImGui::End();
     }
@@ -881,6 +1695,151 @@ void DrawImGui(ProgramState *programState) {
         ImGui::End();
     }
 
+    {
+        ImGui::Begin("Stats");
+        const RenderStats& stats = renderStats();
+        ImGui::Text("Frame time: %.2f ms, GPU scene %.2f ms, bloom %.2f ms",
+                    stats.cpuFrameMs, stats.gpuSceneMs, stats.gpuBloomMs);
+        ImGui::Checkbox("Deferred shading", &programState->DeferredShadingEnabled);
+        ImGui::Checkbox("Dynamic resolution", &programState->DynamicResolutionEnabled);
+        if (programState->DynamicResolutionEnabled) {
+            ImGui::DragFloat("GPU budget (ms)", &programState->FrameBudgetMs, 0.1f, 1.0f, 100.0f);
+            ImGui::SliderFloat("Min render scale", &programState->MinRenderScale, 0.25f, 1.0f);
+        }
+        ImGui::Text("Scene resolution: %u x %u", stats.renderWidth, stats.renderHeight);
+        if (ImGui::BeginCombo("Scene color", sceneColorFormatName(programState->HdrColorFormat))) {
+            for (int i = 0; i < SCENE_COLOR_FORMAT_COUNT; i++) {
+                SceneColorFormat format = (SceneColorFormat) i;
+                char label[64];
+                snprintf(label, sizeof(label), "%s (%u bytes)", sceneColorFormatName(format),
+                         sceneColorFormatBytes(format));
+                ImGuiSelectableFlags flags = sceneColorFormatSupported[i] ? 0 : ImGuiSelectableFlags_Disabled;
+                if (ImGui::Selectable(label, format == programState->HdrColorFormat, flags))
+                    programState->HdrColorFormat = format;
+            }
+            ImGui::EndCombo();
+        }
+        if (rg::glCaps().compute) {
+            ImGui::Checkbox("Auto exposure", &programState->AutoExposureEnabled);
+            if (programState->AutoExposureEnabled)
+                ImGui::SliderFloat("Exposure compensation (EV)", &programState->ExposureCompensation, -4.0f, 4.0f);
+        }
+        ImGui::Text("Exposure: %.3f", exposure);
+        ImGui::Checkbox("Bloom", &programState->BloomEnabled);
+        if (programState->BloomEnabled)
+            ImGui::SliderFloat("Bloom strength", &programState->BloomStrength, 0.0f, 0.3f);
+        const std::vector<ColorGradingLook> &looks = colorGradingLooks();
+        if (ImGui::BeginCombo("Look", looks[programState->ColorGradingLook].name)) {
+            for (int i = 0; i < (int) looks.size(); i++)
+                if (ImGui::Selectable(looks[i].name, i == programState->ColorGradingLook)) {
+                    programState->ColorGradingLook = i;
+                    programState->Grading = looks[i].grading;
+                }
+            ImGui::EndCombo();
+        }
+        ImGui::ColorEdit3("Color filter", &programState->Grading.colorFilter.x);
+        ImGui::SliderFloat("Contrast", &programState->Grading.contrast, 0.5f, 2.0f);
+        ImGui::SliderFloat("Saturation", &programState->Grading.saturation, 0.0f, 2.0f);
+        ImGui::ColorEdit3("Lift", &programState->Grading.lift.x);
+        ImGui::ColorEdit3("Gain", &programState->Grading.gain.x);
+        if (rg::glCaps().compute)
+            ImGui::Checkbox("Compute post pass", &programState->ComputePostEnabled);
+        if (cameraPath.Recording()) {
+            if (ImGui::Button("Stop recording")) {
+                cameraPath.StopRecording();
+                cameraPath.Save("resources/camera_path.txt");
+            }
+        } else if (!cameraPath.Playing()) {
+            if (ImGui::Button("Record camera"))
+                cameraPath.StartRecording();
+            if (cameraPath.FrameCount() > 0) {
+                ImGui::SameLine();
+                if (ImGui::Button("Replay"))
+                    cameraPath.StartReplay();
+                if (programState->HdrColorFormat != SCENE_COLOR_RGBA16F) {
+                    ImGui::SameLine();
+                    if (ImGui::Button("Compare with RGBA16F")) {
+                        formatComparison.Start(cameraPath.FrameCount(), SCENE_COLOR_RGBA16F,
+                                               programState->HdrColorFormat);
+                        cameraPath.StartReplay();
+                    }
+                }
+            }
+        }
+        ImGui::Text("Camera path: %u frames", cameraPath.FrameCount());
+        if (formatComparison.Running())
+            ImGui::Text("Comparing scene color formats...");
+        else if (formatComparison.HasResult()) {
+            const FormatComparison::Result &result = formatComparison.LastResult();
+            if (result.frames == 0)
+                ImGui::Text("%s vs %s: no frames compared", sceneColorFormatName(result.candidate),
+                            sceneColorFormatName(result.reference));
+            else
+                ImGui::Text("%s vs %s: PSNR %.1f dB (worst frame %.1f dB), max error %d/255, %u frames",
+                            sceneColorFormatName(result.candidate), sceneColorFormatName(result.reference),
+                            result.psnr, result.worstFramePsnr, result.maxError, result.frames);
+        }
+        ImGui::Checkbox("Depth prepass", &programState->DepthPrepassEnabled);
+        const char *rendererNames[4] = {"forward", "deferred", "forward + prepass", "deferred + prepass"};
+        for (unsigned int i = 0; i < 4; i++)
+            if (replayTimings[i].frames > 0)
+                ImGui::Text("Replay %s: CPU %.2f ms, GPU %.2f ms", rendererNames[i],
+                            replayTimings[i].AverageCpuMs(), replayTimings[i].AverageGpuMs());
+        ImGui::Text("Draw calls: %u", stats.drawCalls);
+        ImGui::Text("Triangles: %u", stats.triangles);
+        ImGui::Text("Model draw calls: %u (%u meshes)", stats.modelDrawCalls, stats.modelMeshes);
+        ImGui::Checkbox("Multi-draw indirect", &programState->MultiDrawIndirectEnabled);
+        ImGui::Checkbox("Static batching", &programState->StaticBatchingEnabled);
+        ImGui::Text("Transforms updated: %u", stats.transformsUpdated);
+        ImGui::Checkbox("Spin cat", &programState->SpinCat);
+        ImGui::Checkbox("Float table glass", &programState->FloatGlass);
+        ImGui::Checkbox("Frustum culling", &programState->FrustumCullingEnabled);
+        ImGui::DragFloat("Min size (px)", &programState->CullMinPixelSize, 0.5f, 0.0f, 100.0f);
+        ImGui::Text("Culled: %u objects, %u triangles", stats.culledObjects, stats.culledTriangles);
+        ImGui::Checkbox("Occlusion culling", &programState->OcclusionCullingEnabled);
+        if (programState->OcclusionCullingEnabled)
+            ImGui::Text("Occluded: %u objects, rasterizer %.2f ms", stats.occludedObjects, stats.occlusionMs);
+        ImGui::Checkbox("Portal culling", &programState->PortalCullingEnabled);
+        if (programState->PortalCullingEnabled)
+            ImGui::Text("Visible cells: %u (outside counts as one)", stats.visibleCells);
+        ImGui::Checkbox("Impostors", &programState->ImpostorsEnabled);
+        if (programState->ImpostorsEnabled) {
+            ImGui::DragFloat("Impostor distance", &programState->ImpostorDistance, 0.5f, 0.0f, 100.0f);
+            ImGui::DragFloat("Impostor fade", &programState->ImpostorFadeRange, 0.1f, 0.0f, 20.0f);
+            ImGui::Text("Impostors drawn: %u", stats.impostors);
+        }
+        ImGui::Text("Lights: %u, %u cluster entries, at most %u in a cluster",
+                    stats.lights, stats.clusterLightIndices, stats.maxClusterLights);
+        ImGui::Text("Shader variants: %u linked, %u compiling", stats.shaderVariants, stats.shaderVariantsPending);
+        ImGui::Checkbox("Baked room lighting", &programState->LightmapEnabled);
+        if (programState->LightmapEnabled && !lightmapCurrent) {
+            ImGui::SameLine();
+            ImGui::Text("(lights changed since the bake, shaded live)");
+        }
+        ImGui::Checkbox("Shadows", &programState->ShadowsEnabled);
+        if (programState->ShadowsEnabled) {
+            ImGui::SliderInt("Shadow PCF radius", &programState->ShadowPcfRadius, 0, 3);
+            ImGui::Text("Shadow passes: %u", stats.shadowPasses);
+        }
+        ImGui::Checkbox("GPU culling (instanced cats)", &programState->GpuCullingEnabled);
+        if (programState->GpuCullingEnabled)
+            ImGui::Text("GPU visible: %u of %u (a few frames old)", stats.gpuVisibleInstances, stats.gpuInstances);
+        ImGui::Checkbox("Pick mode (left click)", &programState->PickMode);
+        ImGui::Text("Picked: %s", programState->PickedObject.c_str());
+        if (ImGui::Button("BVH stress (100k objects)"))
+            programState->BVHStressRequested = true;
+        if (bvhStressResult.objects > 0) {
+            const BVHStressResult &r = bvhStressResult;
+            ImGui::Text("%u objects, %u nodes, build %.1f ms", r.objects, r.nodes, r.buildMs);
+            ImGui::Text("frustum cull %.2f ms (%u visible)", r.cullMs, r.visible);
+            ImGui::Text("ray %.2f us, sphere query %.2f us, refit %.2f us", r.raycastUs, r.overlapUs, r.refitUs);
+        }
+        ImGui::SliderInt("Instanced cats", &programState->StressInstanceCount, 0, 10000);
+        if (!rg::glCaps().multiDrawIndirect)
+            ImGui::TextDisabled("OpenGL 4.3 not available, batch falls back to a draw loop");
+        ImGui::End();
+    }
+
     ImGui::Render();
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 }
@@ -896,6 +1855,15 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
         }
     }
 }
+void mouse_button_callback(GLFWwindow *window, int button, int action, int mods) {
+    if (button != GLFW_MOUSE_BUTTON_LEFT || action != GLFW_PRESS)
+        return;
+    if (!programState->PickMode || ImGui::GetIO().WantCaptureMouse)
+        return;
+    glfwGetCursorPos(window, &pickX, &pickY);
+    pickRequested = true;
+}
+
 // utility function for loading a 2D texture from file
 // ---------------------------------------------------
 unsigned int loadTexture(char const * path, bool gammaCorrection)